@@ -0,0 +1,155 @@
+#include <QPainter>
+
+#include "animationplayer.h"
+
+AnimationPlayer::AnimationPlayer(QWidget* parent)
+: QWidget(parent),
+  m_current(0),
+  m_zoom(2),
+  m_lastPainted(-1)
+{
+  setBackgroundRole(QPalette::Dark);
+  setAutoFillBackground(true);
+
+  m_timer.setTimerType(Qt::PreciseTimer);
+  connect(&m_timer, SIGNAL(timeout()), this, SLOT(advance()));
+
+  setRate(DEFAULT_RATE);
+}
+
+void AnimationPlayer::setFrames(const QList<QImage>& images, const QList<QPoint>& positions, const QVector<int>& sequence)
+{
+  m_atlasRects.clear();
+  m_positions = positions.toVector();
+  m_sequence = sequence;
+  m_bounds = QRect();
+
+  // Shelf packing, in order: a new shelf starts when a frame does not fit
+  // the width that is left.
+  QPoint cursor(0, 0);
+  int shelfHeight = 0;
+  QSize atlasSize(0, 0);
+
+  foreach (const QImage& image, images) {
+    if (cursor.x() > 0 && cursor.x() + image.width() > ATLAS_WIDTH) {
+      cursor = QPoint(0, cursor.y() + shelfHeight);
+      shelfHeight = 0;
+    }
+
+    m_atlasRects.append(QRect(cursor, image.size()));
+    cursor.rx() += image.width();
+    shelfHeight = qMax(shelfHeight, image.height());
+    atlasSize = atlasSize.expandedTo(QSize(cursor.x(), cursor.y() + shelfHeight));
+  }
+
+  QImage atlas(atlasSize.expandedTo(QSize(1, 1)), QImage::Format_ARGB32_Premultiplied);
+  atlas.fill(0);
+
+  QPainter painter(&atlas);
+  painter.setCompositionMode(QPainter::CompositionMode_Source);
+  for (int i = 0; i < images.size(); i++) {
+    painter.drawImage(m_atlasRects[i].topLeft(), images[i]);
+  }
+  painter.end();
+
+  m_atlas = QPixmap::fromImage(atlas);
+
+  foreach (int index, m_sequence) {
+    if (index >= 0 && index < m_atlasRects.size()) {
+      m_bounds |= QRect(m_positions.value(index), m_atlasRects[index].size());
+    }
+  }
+
+  m_current = 0;
+  m_lastPainted = -1;
+  resetStats();
+  updateGeometry();
+  update();
+}
+
+void AnimationPlayer::setRate(int framesPerSecond)
+{
+  m_timer.setInterval(1000 / qMax(1, framesPerSecond));
+  resetStats();
+}
+
+void AnimationPlayer::setZoom(int zoom)
+{
+  m_zoom = qMax(1, zoom);
+  updateGeometry();
+  update();
+}
+
+QSize AnimationPlayer::sizeHint() const
+{
+  return m_bounds.size() * m_zoom + QSize(16, 16);
+}
+
+void AnimationPlayer::play()
+{
+  resetStats();
+  m_timer.start();
+}
+
+void AnimationPlayer::stop()
+{
+  m_timer.stop();
+}
+
+void AnimationPlayer::advance()
+{
+  if (!m_sequence.isEmpty()) {
+    m_current = (m_current + 1) % m_sequence.size();
+    update();
+  }
+}
+
+void AnimationPlayer::paintEvent(QPaintEvent* /*event*/)
+{
+  if (m_sequence.isEmpty()) {
+    return;
+  }
+
+  QElapsedTimer paintClock;
+  paintClock.start();
+
+  int index = m_sequence[m_current];
+  if (index >= 0 && index < m_atlasRects.size()) {
+    const QRect& source = m_atlasRects[index];
+    QPoint origin((width() - m_bounds.width() * m_zoom) / 2, (height() - m_bounds.height() * m_zoom) / 2);
+    QRect target(origin + (m_positions.value(index) - m_bounds.topLeft()) * m_zoom, source.size() * m_zoom);
+
+    QPainter painter(this);
+    painter.setRenderHint(QPainter::SmoothPixmapTransform, false);
+    painter.drawPixmap(target, m_atlas, source);
+  }
+
+  // Repaints of the same frame, e.g. on resizing, do not count.
+  if (m_current == m_lastPainted) {
+    return;
+  }
+
+  qint64 now = m_clock.nsecsElapsed();
+  if (m_frames > 0) {
+    double interval = (now - m_lastFrame) / 1e6;
+    m_intervalSum += interval;
+    m_intervalMax = qMax(m_intervalMax, interval);
+  }
+
+  m_lastFrame = now;
+  m_lastPainted = m_current;
+  m_paintSum += paintClock.nsecsElapsed() / 1e6;
+  m_frames++;
+
+  emit frameShown(m_current);
+}
+
+void AnimationPlayer::resetStats()
+{
+  m_clock.start();
+  m_frames = 0;
+  m_lastFrame = 0;
+  m_intervalSum = 0.0;
+  m_intervalMax = 0.0;
+  m_paintSum = 0.0;
+}
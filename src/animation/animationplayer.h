@@ -0,0 +1,70 @@
+#pragma once
+
+#include <QElapsedTimer>
+#include <QImage>
+#include <QPixmap>
+#include <QTimer>
+#include <QVector>
+#include <QWidget>
+
+// Plays a sequence of bitmaps. The distinct frames are packed into a single
+// pixmap atlas once, so showing a frame is one blit from the atlas and no
+// bitmap is converted again during playback. Frames are drawn at their
+// screen position, relative to the box around all of them.
+class AnimationPlayer : public QWidget
+{
+  Q_OBJECT
+
+public:
+  AnimationPlayer(QWidget* parent = 0);
+
+  // Sequence entries index the images, -1 shows an empty frame.
+  void              setFrames(const QList<QImage>& images, const QList<QPoint>& positions, const QVector<int>& sequence);
+  void              setRate(int framesPerSecond);
+  void              setZoom(int zoom);
+
+  QSize             sizeHint() const;
+
+  // Measured time between frames and time spent drawing one, in ms.
+  double            averageInterval() const { return m_frames > 1 ? m_intervalSum / (m_frames - 1) : 0.0; }
+  double            maxInterval() const     { return m_intervalMax; }
+  double            averagePaint() const    { return m_frames > 0 ? m_paintSum / m_frames : 0.0; }
+
+  static const int  DEFAULT_RATE = 20;
+
+public slots:
+  void              play();
+  void              stop();
+
+signals:
+  void              frameShown(int frame);
+
+protected:
+  void              paintEvent(QPaintEvent* event);
+
+private slots:
+  void              advance();
+
+private:
+  void              resetStats();
+
+  QPixmap           m_atlas;
+  QVector<QRect>    m_atlasRects;
+  QVector<QPoint>   m_positions;
+  QVector<int>      m_sequence;
+  QRect             m_bounds;
+
+  QTimer            m_timer;
+  QElapsedTimer     m_clock;
+  int               m_current;
+  int               m_zoom;
+  int               m_lastPainted;
+
+  int               m_frames;
+  qint64            m_lastFrame;
+  double            m_intervalSum;
+  double            m_intervalMax;
+  double            m_paintSum;
+
+  static const int  ATLAS_WIDTH = 1024;
+};
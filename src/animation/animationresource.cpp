@@ -5,14 +5,14 @@ AnimationResource::AnimationResource(QString id, QWidget* parent, Qt::WindowFlag
 : Resource(id, parent, flags),
   m_ui(new Ui::AnimationResource)
 {
-  m_ui->setupUi(this);
+  setup();
 }
 
 AnimationResource::AnimationResource(const AnimationResource& res)
 : Resource(res.id(), qobject_cast<QWidget*>(res.parent()), res.windowFlags()),
   m_ui(new Ui::AnimationResource)
 {
-  m_ui->setupUi(this);
+  setup();
 
   m_ui->framesEdit->setPlainText(res.m_ui->framesEdit->toPlainText());
 }
@@ -21,7 +21,7 @@ AnimationResource::AnimationResource(QString id, QDataStream* in, QWidget* paren
 : Resource(id, parent, flags),
   m_ui(new Ui::AnimationResource)
 {
-  m_ui->setupUi(this);
+  setup();
 
   parse(in);
 }
@@ -31,6 +31,24 @@ AnimationResource::~AnimationResource()
   delete m_ui;
 }
 
+void AnimationResource::setup()
+{
+  m_ui->setupUi(this);
+
+  connect(m_ui->playButton, SIGNAL(clicked()), this, SIGNAL(playRequested()));
+}
+
+QVector<int> AnimationResource::frames() const
+{
+  QVector<int> frames;
+  foreach (const QString& f, m_ui->framesEdit->toPlainText().split('\n', Qt::SkipEmptyParts)) {
+    quint8 i = f.toInt();
+    frames.append(i ? i : 1);
+  }
+
+  return frames;
+}
+
 // Read NULL-terminated array from QDataStream.
 void AnimationResource::parse(QDataStream* in)
 {
@@ -52,11 +70,8 @@ void AnimationResource::parse(QDataStream* in)
 // Write NULL-terminated array to QDataStream.
 void AnimationResource::write(QDataStream* out) const
 {
-  QStringList frames = m_ui->framesEdit->toPlainText().split('\n', Qt::SkipEmptyParts);
-
-  foreach (const QString& f, frames) {
-    quint8 i = f.toInt();
-    *out << (quint8)(i ? i : 1);
+  foreach (int i, frames()) {
+    *out << (quint8)i;
   }
 
   *out << (qint8)0;
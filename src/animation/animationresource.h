@@ -19,10 +19,18 @@ public:
   QString                type() const  { return "animation"; }
   Resource*              clone() const { return new AnimationResource(*this); }
 
+  // Bitmap indices, one based.
+  QVector<int>           frames() const;
+
+signals:
+  void                   playRequested();
+
 protected:
   void                   parse(QDataStream* in);
   void                   write(QDataStream* out) const;
 
 private:
+  void                   setup();
+
   Ui::AnimationResource*  m_ui;
 };
@@ -1,20 +1,49 @@
 #include <QApplication>
+#include <QTextStream>
 
 #include "mainwindow.h"
 #include "settings.h"
 
+static const int BENCHMARK_FRAMES = 360;
+
 int main(int argc, char** argv)
 {
   QApplication app(argc, argv);
   app.setOrganizationName(Settings::ORG_NAME);
   app.setApplicationName(Settings::APP_NAME);
 
-  // Scan argument list for filename.
+  // Scan argument list for filename and options.
   QString fileName;
+  QStringList fileNames;
+  QString thumbnailDir;
+  bool software = false;
+  int benchmarkFrames = 0;
   for (int i = 1; i < argc; i++) {
-    if (argv[i][0] != '-') {
-      fileName = argv[i];
-      break;
+    QString arg = argv[i];
+
+    if (!arg.startsWith('-')) {
+      if (fileName.isEmpty()) {
+        fileName = arg;
+      }
+      fileNames.append(arg);
+    }
+    else if (arg == "--benchmark") {
+      benchmarkFrames = BENCHMARK_FRAMES;
+    }
+    else if (arg.startsWith("--benchmark=")) {
+      bool ok;
+      benchmarkFrames = arg.mid(12).toInt(&ok);
+
+      if (!ok || benchmarkFrames < 1) {
+        QTextStream(stderr) << QCoreApplication::translate("main", "Invalid frame count \"%1\". Usage: --benchmark[=<frames>]").arg(arg.mid(12)) << Qt::endl;
+        return 1;
+      }
+    }
+    else if (arg.startsWith("--thumbnails=")) {
+      thumbnailDir = arg.mid(13);
+    }
+    else if (arg == "--software") {
+      software = true;
     }
   }
 
@@ -23,6 +52,17 @@ int main(int argc, char** argv)
 
   // Init main window.
   MainWindow mainWindow;
+
+  // Time offscreen rendering of all shapes in the file and quit.
+  if (benchmarkFrames > 0) {
+    return mainWindow.benchmarkShapes(fileName, benchmarkFrames);
+  }
+
+  // Render previews of all shapes in all files and quit.
+  if (!thumbnailDir.isEmpty()) {
+    return mainWindow.renderThumbnails(fileNames, thumbnailDir, software);
+  }
+
   mainWindow.show();
 
   // Load file from command line argument.
@@ -1,16 +1,42 @@
+#include <QApplication>
 #include <QCloseEvent>
 #include <QDesktopServices>
+#include <QDialog>
+#include <QDialogButtonBox>
+#include <QElapsedTimer>
 #include <QFileDialog>
+#include <QHBoxLayout>
+#include <QInputDialog>
 #include <QLabel>
+#include <QListWidget>
 #include <QMessageBox>
+#include <QPushButton>
+#include <QSpinBox>
+#include <QTextStream>
+#include <QUndoStack>
 #include <QUrl>
+#include <QVBoxLayout>
 #include <QtGlobal>
 
+#include "animation/animationplayer.h"
+#include "animation/animationresource.h"
+#include "bitmap/bitmapdiff.h"
+#include "bitmap/bitmapresource.h"
+#include "bitmap/bitmapview.h"
 #include "mainwindow.h"
+#include "palette/paletteresource.h"
+#include "palettemanager.h"
+#include "paletteremapcommand.h"
 #include "resourcesmodel.h"
 #include "settings.h"
+#include "shape/shapeoffscreen.h"
+#include "shape/shaperesource.h"
+#include "shape/shapesceneview.h"
+#include "shape/shapethumbnailer.h"
+#include "taskbatch.h"
 
 const char MainWindow::FILE_SETTINGS_PATH[] = "paths/resource";
+const char MainWindow::EXPORT_SETTINGS_PATH[] = "paths/export";
 const char MainWindow::FILE_FILTERS_LOAD[] =
     "All known resource files (*.vsh *.pvs *.esh *.pes *.3sh *.p3s *.vce *.pvc *.kms *.pkm *.sfx *.psf *.res *.pre);;"
     "Bitmaps (*.vsh *.pvs);;"
@@ -33,6 +59,14 @@ const char MainWindow::FILE_FILTERS_SAVE[] =
     "Misc (*.res);;"
     "All files (*)";
 
+const char MainWindow::DELTA_FILE_FILTERS[] =
+    "Bitmap deltas (*.sbd);;"
+    "All files (*)";
+
+const char MainWindow::ATLAS_FILE_FILTERS[] =
+    "Portable Network Graphics (*.png);;"
+    "All files (*)";
+
 MainWindow::MainWindow(QWidget* parent, Qt::WindowFlags flags)
 : QMainWindow(parent, flags)
 {
@@ -46,8 +80,20 @@ MainWindow::MainWindow(QWidget* parent, Qt::WindowFlags flags)
   connect(m_ui.resourcesView->selectionModel(), SIGNAL(currentChanged(QModelIndex, QModelIndex)),
       this, SLOT(setCurrent(QModelIndex)));
 
+  m_undoStack = new QUndoStack(this);
+  connect(m_undoStack, SIGNAL(indexChanged(int)), this, SLOT(isModified()));
+
+  QAction* undoAction = m_undoStack->createUndoAction(this, tr("&Undo"));
+  undoAction->setShortcuts(QKeySequence::Undo);
+  QAction* redoAction = m_undoStack->createRedoAction(this, tr("&Redo"));
+  redoAction->setShortcuts(QKeySequence::Redo);
+  m_ui.menu_Edit->insertAction(m_ui.action_RemapPalette, undoAction);
+  m_ui.menu_Edit->insertAction(m_ui.action_RemapPalette, redoAction);
+  m_ui.menu_Edit->insertSeparator(m_ui.action_RemapPalette);
+
   m_currentResource = NULL;
   m_modified = false;
+  m_generation = 0;
   updateWindowTitle();
 
   m_statusLabel = new QLabel(m_ui.statusBar);
@@ -61,6 +107,7 @@ void MainWindow::loadFile(const QString& fileName)
 
   try {
     m_modified = (!Resource::parse(fileName, m_resourcesModel, this));
+    activateFilePalette();
 
     m_currentFileName = fileName;
     updateWindowTitle();
@@ -76,6 +123,109 @@ void MainWindow::loadFile(const QString& fileName)
   }
 }
 
+// Bitmaps and shapes of a file with its own palette are shown in it.
+void MainWindow::activateFilePalette()
+{
+  for (int i = 0; i < m_resourcesModel->rowCount(); i++) {
+    if (PaletteResource* palette = dynamic_cast<PaletteResource*>(m_resourcesModel->at(i))) {
+      palette->activate();
+      break;
+    }
+  }
+}
+
+// Headless, so errors go to stderr instead of a message box.
+int MainWindow::benchmarkShapes(const QString& fileName, int frames)
+{
+  QTextStream out(stdout);
+  QTextStream err(stderr);
+
+  if (fileName.isEmpty()) {
+    err << tr("No file to benchmark given.") << Qt::endl;
+    return 1;
+  }
+
+  QStringList skipped;
+  try {
+    if (!Resource::parse(fileName, m_resourcesModel, this, &skipped)) {
+      foreach (const QString& msg, skipped) {
+        err << msg << Qt::endl;
+      }
+    }
+  }
+  catch (QString msg) {
+    err << tr("Error loading \"%1\": %2").arg(fileName, msg) << Qt::endl;
+    return 1;
+  }
+
+  activateFilePalette();
+
+  ShapeOffscreen offscreen(QSize(640, 480));
+  if (!offscreen.isValid()) {
+    err << tr("Offscreen rendering is not available: %1").arg(offscreen.log()) << Qt::endl;
+    return 1;
+  }
+
+  int count = 0;
+  foreach (ShapeResource* shape, m_resourcesModel->resources<ShapeResource>()) {
+    double time = offscreen.benchmark(shape->shapeModel(), frames);
+    out << QString("%1\t%2 ms").arg(shape->id()).arg(time, 0, 'f', 3) << Qt::endl;
+    count++;
+  }
+
+  if (!count) {
+    err << tr("There are no shapes to benchmark.") << Qt::endl;
+    return 1;
+  }
+
+  return 0;
+}
+
+// Writes a PNG preview of every shape in the files, named like the shape
+// export. Archives are parsed one at a time and only the shape data is kept
+// until rendering. Resources that fail to parse are reported, not asked about.
+int MainWindow::renderThumbnails(const QStringList& fileNames, const QString& dirPath, bool software)
+{
+  QTextStream out(stdout);
+  ShapeThumbnailer thumbnailer(dirPath, QSize(THUMBNAIL_WIDTH, THUMBNAIL_HEIGHT), software);
+  QStringList errors;
+
+  foreach (const QString& fileName, fileNames) {
+    ResourcesModel resourcesModel;
+    QStringList skipped;
+
+    try {
+      if (!Resource::parse(fileName, &resourcesModel, this, &skipped)) {
+        foreach (const QString& msg, skipped) {
+          errors.append(QString("%1: %2").arg(fileName, msg));
+        }
+      }
+    }
+    catch (QString msg) {
+      errors.append(QString("%1: %2").arg(fileName, msg));
+      resourcesModel.clear();
+      continue;
+    }
+
+    QString prefix = QFileInfo(fileName).fileName().replace('.', '_');
+    foreach (ShapeResource* shape, resourcesModel.resources<ShapeResource>()) {
+      thumbnailer.add(shape->shapeModel(), QString("%1-%2").arg(prefix, shape->id()));
+    }
+
+    resourcesModel.clear();
+  }
+
+  errors.append(thumbnailer.run());
+
+  foreach (const QString& error, errors) {
+    out << error << Qt::endl;
+  }
+
+  out << tr("%1 thumbnails rendered, %2 from cache.").arg(thumbnailer.rendered()).arg(thumbnailer.cached()) << Qt::endl;
+
+  return errors.isEmpty() ? 0 : 1;
+}
+
 void MainWindow::saveFile(const QString& fileName)
 {
   try {
@@ -129,9 +279,12 @@ bool MainWindow::reset()
   }
 
   m_ui.resourcesView->clearSelection();
+  m_undoStack->clear();
   m_resourcesModel->clear();
+  PaletteManager::instance()->restoreDefault();
 
   m_modified = false;
+  m_generation++;
   m_currentFileName.clear();
   updateWindowTitle();
   updateStatusBar();
@@ -223,6 +376,676 @@ void MainWindow::saveAsAsIs(bool nameWasChanged)
   }
 }
 
+void MainWindow::exportShapes()
+{
+  QList<ShapeResource*> shapes = m_resourcesModel->resources<ShapeResource>();
+
+  if (shapes.isEmpty()) {
+    QMessageBox::information(
+        this,
+        QCoreApplication::applicationName(),
+        tr("There are no shapes to export."));
+    return;
+  }
+
+  QStringList formats = QStringList() << tr("Wavefront OBJ (*.obj)") << tr("Binary glTF (*.glb)") << tr("Binary PLY (*.ply)");
+  QStringList suffixes = QStringList() << "obj" << "glb" << "ply";
+
+  bool success;
+  QString format = QInputDialog::getItem(
+      this,
+      tr("Export all shapes"),
+      tr("File format:"),
+      formats, 0, false, &success);
+
+  if (!success) {
+    return;
+  }
+
+  QString dirPath = QFileDialog::getExistingDirectory(
+      this,
+      tr("Export all shapes"),
+      Settings().getFilePath(EXPORT_SETTINGS_PATH));
+
+  if (dirPath.isEmpty()) {
+    return;
+  }
+
+  Settings().setFilePath(EXPORT_SETTINGS_PATH, dirPath);
+
+  // Finishes in the background, the window stays usable meanwhile.
+  int count = shapes.size();
+  TaskBatch* batch = ShapeResource::exportShapes(shapes, dirPath, suffixes[formats.indexOf(format)], this);
+  m_ui.statusBar->showMessage(tr("Exporting %1 shapes...").arg(count));
+
+  connect(batch, &TaskBatch::finished, [this, batch, count, dirPath]() {
+    m_ui.statusBar->clearMessage();
+
+    QStringList errors = *batch->errors();
+    if (errors.isEmpty()) {
+      QMessageBox::information(
+          this,
+          QCoreApplication::applicationName(),
+          tr("Exported %1 shapes to \"%2\".").arg(count).arg(dirPath));
+    }
+    else {
+      QMessageBox::warning(
+          this,
+          QCoreApplication::applicationName(),
+          tr("Exported %1 of %2 shapes to \"%3\". Errors:\n%4")
+            .arg(count - errors.size())
+            .arg(count)
+            .arg(dirPath, errors.join("\n")));
+    }
+  });
+}
+
+void MainWindow::exportBitmaps()
+{
+  QList<BitmapResource*> bitmaps = m_resourcesModel->resources<BitmapResource>();
+
+  if (bitmaps.isEmpty()) {
+    QMessageBox::information(
+        this,
+        QCoreApplication::applicationName(),
+        tr("There are no bitmaps to export."));
+    return;
+  }
+
+  QString dirPath = QFileDialog::getExistingDirectory(
+      this,
+      tr("Export all bitmaps"),
+      Settings().getFilePath(EXPORT_SETTINGS_PATH));
+
+  if (dirPath.isEmpty()) {
+    return;
+  }
+
+  Settings().setFilePath(EXPORT_SETTINGS_PATH, dirPath);
+
+  int count = bitmaps.size();
+  TaskBatch* batch = BitmapResource::exportBitmaps(bitmaps, dirPath, this);
+  m_ui.statusBar->showMessage(tr("Exporting %1 bitmaps...").arg(count));
+
+  connect(batch, &TaskBatch::finished, [this, batch, count, dirPath]() {
+    m_ui.statusBar->clearMessage();
+
+    QStringList errors = *batch->errors();
+    if (errors.isEmpty()) {
+      QMessageBox::information(
+          this,
+          QCoreApplication::applicationName(),
+          tr("Exported %1 bitmaps to \"%2\".").arg(count).arg(dirPath));
+    }
+    else {
+      QMessageBox::warning(
+          this,
+          QCoreApplication::applicationName(),
+          tr("Exported %1 of %2 bitmaps to \"%3\". Errors:\n%4")
+            .arg(count - errors.size())
+            .arg(count)
+            .arg(dirPath, errors.join("\n")));
+    }
+  });
+}
+
+void MainWindow::importBitmaps()
+{
+  QList<BitmapResource*> bitmaps = m_resourcesModel->resources<BitmapResource>();
+
+  if (bitmaps.isEmpty()) {
+    QMessageBox::information(
+        this,
+        QCoreApplication::applicationName(),
+        tr("There are no bitmaps to import."));
+    return;
+  }
+
+  QString dirPath = QFileDialog::getExistingDirectory(
+      this,
+      tr("Import all bitmaps"),
+      Settings().getFilePath(EXPORT_SETTINGS_PATH));
+
+  if (dirPath.isEmpty()) {
+    return;
+  }
+
+  Settings().setFilePath(EXPORT_SETTINGS_PATH, dirPath);
+
+  // The bitmaps are updated by the batch before this hears of it. If the
+  // file was closed meanwhile, the result belongs to no file shown.
+  int count = bitmaps.size();
+  int generation = m_generation;
+  TaskBatch* batch = BitmapResource::importBitmaps(bitmaps, dirPath, this);
+  m_ui.statusBar->showMessage(tr("Importing %1 bitmaps...").arg(count));
+
+  connect(batch, &TaskBatch::finished, [this, batch, count, dirPath, generation]() {
+    m_ui.statusBar->clearMessage();
+
+    if (generation != m_generation) {
+      return;
+    }
+
+    QStringList errors = *batch->errors();
+    int imported = batch->count() - errors.size();
+
+    // Only the current resource reports its changes by itself.
+    if (imported > 0) {
+      isModified();
+    }
+
+    if (errors.isEmpty()) {
+      QMessageBox::information(
+          this,
+          QCoreApplication::applicationName(),
+          tr("Imported %1 of %2 bitmaps from \"%3\".").arg(imported).arg(count).arg(dirPath));
+    }
+    else {
+      QMessageBox::warning(
+          this,
+          QCoreApplication::applicationName(),
+          tr("Imported %1 of %2 bitmaps from \"%3\". Errors:\n%4")
+            .arg(imported)
+            .arg(count)
+            .arg(dirPath, errors.join("\n")));
+    }
+  });
+}
+
+void MainWindow::exportBitmapAtlas()
+{
+  QList<BitmapResource*> bitmaps = m_resourcesModel->resources<BitmapResource>();
+
+  if (bitmaps.isEmpty()) {
+    QMessageBox::information(
+        this,
+        QCoreApplication::applicationName(),
+        tr("There are no bitmaps to export."));
+    return;
+  }
+
+  QString filePath = QFileDialog::getSaveFileName(
+      this,
+      tr("Export bitmap atlas"),
+      QDir(Settings().getFilePath(EXPORT_SETTINGS_PATH)).absoluteFilePath(QString(Resource::fileName()).replace('.', '_') + ".png"),
+      ATLAS_FILE_FILTERS);
+
+  if (filePath.isEmpty()) {
+    return;
+  }
+
+  Settings().setFilePath(EXPORT_SETTINGS_PATH, QFileInfo(filePath).path());
+
+  try {
+    QApplication::setOverrideCursor(Qt::WaitCursor);
+    BitmapResource::exportAtlas(bitmaps, filePath);
+    QApplication::restoreOverrideCursor();
+  }
+  catch (QString msg) {
+    QApplication::restoreOverrideCursor();
+    QMessageBox::critical(
+        this,
+        QCoreApplication::applicationName(),
+        tr("Error exporting bitmap atlas \"%1\":\n%2").arg(filePath, msg));
+  }
+}
+
+void MainWindow::importBitmapAtlas()
+{
+  QList<BitmapResource*> bitmaps = m_resourcesModel->resources<BitmapResource>();
+
+  if (bitmaps.isEmpty()) {
+    QMessageBox::information(
+        this,
+        QCoreApplication::applicationName(),
+        tr("There are no bitmaps to import."));
+    return;
+  }
+
+  QString filePath = QFileDialog::getOpenFileName(
+      this,
+      tr("Import bitmap atlas"),
+      Settings().getFilePath(EXPORT_SETTINGS_PATH),
+      ATLAS_FILE_FILTERS);
+
+  if (filePath.isEmpty()) {
+    return;
+  }
+
+  Settings().setFilePath(EXPORT_SETTINGS_PATH, QFileInfo(filePath).path());
+
+  int imported;
+  QStringList errors;
+  try {
+    QApplication::setOverrideCursor(Qt::WaitCursor);
+    errors = BitmapResource::importAtlas(bitmaps, filePath, imported);
+    QApplication::restoreOverrideCursor();
+  }
+  catch (QString msg) {
+    QApplication::restoreOverrideCursor();
+    QMessageBox::critical(
+        this,
+        QCoreApplication::applicationName(),
+        tr("Error importing bitmap atlas \"%1\":\n%2").arg(filePath, msg));
+    return;
+  }
+
+  if (imported > 0) {
+    isModified();
+  }
+
+  if (errors.isEmpty()) {
+    QMessageBox::information(
+        this,
+        QCoreApplication::applicationName(),
+        tr("Imported %1 of %2 bitmaps from \"%3\".").arg(imported).arg(bitmaps.size()).arg(filePath));
+  }
+  else {
+    QMessageBox::warning(
+        this,
+        QCoreApplication::applicationName(),
+        tr("Imported %1 of %2 bitmaps from \"%3\". Errors:\n%4")
+          .arg(imported)
+          .arg(bitmaps.size())
+          .arg(filePath, errors.join("\n")));
+  }
+}
+
+// Compares the bitmaps of the current file with those of the same id in
+// another file, which is read into a scratch model. The changes can be saved
+// as a delta that turns the current bitmaps into the other ones.
+void MainWindow::compareBitmaps()
+{
+  QList<BitmapResource*> bitmaps = m_resourcesModel->resources<BitmapResource>();
+
+  if (bitmaps.isEmpty()) {
+    QMessageBox::information(
+        this,
+        QCoreApplication::applicationName(),
+        tr("There are no bitmaps to compare."));
+    return;
+  }
+
+  QString fileName = QFileDialog::getOpenFileName(
+      this,
+      tr("Compare bitmaps with file"),
+      m_currentFilePath,
+      FILE_FILTERS_LOAD,
+      &m_currentFileFilter);
+
+  if (fileName.isEmpty()) {
+    return;
+  }
+
+  // Parsing renames the current file, which the resources use for exports.
+  QString resourceFileName = Resource::fileName();
+  QMap<QString, QImage> others;
+  ResourcesModel resourcesModel;
+
+  try {
+    Resource::parse(fileName, &resourcesModel, this);
+  }
+  catch (QString msg) {
+    Resource::setFileName(resourceFileName);
+    resourcesModel.clear();
+
+    QMessageBox::critical(
+        this,
+        QCoreApplication::applicationName(),
+        tr("Error loading \"%1\":\n%2").arg(fileName, msg));
+    return;
+  }
+
+  Resource::setFileName(resourceFileName);
+
+  foreach (BitmapResource* bitmap, resourcesModel.resources<BitmapResource>()) {
+    if (bitmap->image()) {
+      others.insert(bitmap->id(), *bitmap->image());
+    }
+  }
+
+  resourcesModel.clear();
+
+  QElapsedTimer timer;
+  timer.start();
+
+  QList<BitmapDiff::Change> changes;
+  int compared = 0;
+  foreach (BitmapResource* bitmap, bitmaps) {
+    if (!others.contains(bitmap->id())) {
+      continue;
+    }
+
+    BitmapDiff::Change change;
+    change.id = bitmap->id();
+    change.base = bitmap->image() ? *bitmap->image() : QImage();
+    change.baseSize = change.base.size();
+    change.revised = others.value(bitmap->id());
+    change.rects = BitmapDiff::compare(change.base, change.revised);
+    compared++;
+
+    if (!change.rects.isEmpty()) {
+      changes.append(change);
+    }
+  }
+
+  double elapsed = timer.nsecsElapsed() / 1e6;
+
+  if (changes.isEmpty()) {
+    QMessageBox::information(
+        this,
+        QCoreApplication::applicationName(),
+        tr("None of %1 bitmaps differ from \"%2\" (%3 ms).").arg(compared).arg(fileName).arg(elapsed, 0, 'f', 2));
+    return;
+  }
+
+  // Modal, so the list can refer to the changes and the mask directly.
+  QDialog dialog(this);
+  dialog.setWindowTitle(tr("Bitmap changes in %1").arg(QFileInfo(fileName).fileName()));
+  dialog.resize(800, 600);
+
+  QListWidget* list = new QListWidget(&dialog);
+  foreach (const BitmapDiff::Change& change, changes) {
+    list->addItem(change.base.size() == change.revised.size() ?
+        tr("%1 (%n rectangles)", 0, change.rects.size()).arg(change.id) :
+        tr("%1 (resized)").arg(change.id));
+  }
+
+  BitmapView* view = new BitmapView(&dialog);
+  view->setZoom(2);
+
+  QImage mask;
+  connect(list, &QListWidget::currentRowChanged, [&](int row) {
+    mask = BitmapDiff::mask(changes[row], qRgba(255, 0, 255, 160));
+    view->setImage(&changes[row].revised);
+    view->setOverlay(&mask);
+  });
+
+  QDialogButtonBox* buttons = new QDialogButtonBox(QDialogButtonBox::Close, &dialog);
+  QPushButton* saveButton = buttons->addButton(tr("&Save delta..."), QDialogButtonBox::ActionRole);
+  connect(buttons, &QDialogButtonBox::rejected, &dialog, &QDialog::reject);
+  connect(saveButton, &QPushButton::clicked, [&]() {
+    QString deltaFileName = QFileDialog::getSaveFileName(
+        &dialog,
+        tr("Save bitmap delta"),
+        Settings().getFilePath(EXPORT_SETTINGS_PATH),
+        DELTA_FILE_FILTERS);
+
+    if (deltaFileName.isEmpty()) {
+      return;
+    }
+
+    Settings().setFilePath(EXPORT_SETTINGS_PATH, QFileInfo(deltaFileName).path());
+
+    QFile file(deltaFileName);
+    QByteArray delta = BitmapDiff::writeDelta(changes);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate) || file.write(delta) != delta.size()) {
+      QMessageBox::critical(
+          &dialog,
+          QCoreApplication::applicationName(),
+          tr("Error saving \"%1\":\n%2").arg(deltaFileName, file.errorString()));
+    }
+  });
+
+  QHBoxLayout* panes = new QHBoxLayout;
+  panes->addWidget(list, 1);
+  panes->addWidget(view, 3);
+
+  QVBoxLayout* layout = new QVBoxLayout(&dialog);
+  layout->addLayout(panes);
+  layout->addWidget(new QLabel(tr("%1 of %2 bitmaps differ, compared in %3 ms.")
+      .arg(changes.size()).arg(compared).arg(elapsed, 0, 'f', 2), &dialog));
+  layout->addWidget(buttons);
+
+  list->setCurrentRow(0);
+  dialog.exec();
+}
+
+void MainWindow::applyBitmapDelta()
+{
+  QString fileName = QFileDialog::getOpenFileName(
+      this,
+      tr("Apply bitmap delta"),
+      Settings().getFilePath(EXPORT_SETTINGS_PATH),
+      DELTA_FILE_FILTERS);
+
+  if (fileName.isEmpty()) {
+    return;
+  }
+
+  Settings().setFilePath(EXPORT_SETTINGS_PATH, QFileInfo(fileName).path());
+
+  QList<BitmapDiff::Change> changes;
+  try {
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly)) {
+      throw file.errorString();
+    }
+
+    changes = BitmapDiff::readDelta(file.readAll());
+  }
+  catch (QString msg) {
+    QMessageBox::critical(
+        this,
+        QCoreApplication::applicationName(),
+        tr("Error loading \"%1\":\n%2").arg(fileName, msg));
+    return;
+  }
+
+  QMap<QString, BitmapResource*> bitmaps;
+  foreach (BitmapResource* bitmap, m_resourcesModel->resources<BitmapResource>()) {
+    bitmaps.insert(bitmap->id(), bitmap);
+  }
+
+  QStringList errors;
+  int applied = 0;
+  foreach (const BitmapDiff::Change& change, changes) {
+    BitmapResource* bitmap = bitmaps.value(change.id);
+    if (!bitmap) {
+      errors.append(tr("%1: No such bitmap.").arg(change.id));
+      continue;
+    }
+
+    try {
+      bitmap->replaceImage(BitmapDiff::apply(bitmap->image() ? *bitmap->image() : QImage(), change));
+      applied++;
+    }
+    catch (QString msg) {
+      errors.append(QString("%1: %2").arg(change.id, msg));
+    }
+  }
+
+  if (applied > 0) {
+    isModified();
+  }
+
+  if (errors.isEmpty()) {
+    QMessageBox::information(
+        this,
+        QCoreApplication::applicationName(),
+        tr("Applied %1 bitmap changes from \"%2\".").arg(applied).arg(fileName));
+  }
+  else {
+    QMessageBox::warning(
+        this,
+        QCoreApplication::applicationName(),
+        tr("Applied %1 of %2 bitmap changes from \"%3\". Errors:\n%4")
+          .arg(applied)
+          .arg(changes.size())
+          .arg(fileName, errors.join("\n")));
+  }
+}
+
+void MainWindow::viewShapes()
+{
+  QList<ShapeModel*> models;
+  QStringList names;
+  foreach (ShapeResource* shape, m_resourcesModel->resources<ShapeResource>()) {
+    models.append(shape->shapeModel());
+    names.append(shape->id());
+  }
+
+  if (models.isEmpty()) {
+    QMessageBox::information(
+        this,
+        QCoreApplication::applicationName(),
+        tr("There are no shapes to view."));
+    return;
+  }
+
+  // Modal, so the resources cannot change while the scene holds their models.
+  QDialog dialog(this);
+  dialog.setWindowTitle(tr("All shapes"));
+  dialog.resize(960, 720);
+
+  ShapeSceneView* sceneView = new ShapeSceneView(&dialog);
+  sceneView->setShapes(models, names);
+
+  QVBoxLayout* layout = new QVBoxLayout(&dialog);
+  layout->setContentsMargins(0, 0, 0, 0);
+  layout->addWidget(sceneView);
+
+  dialog.exec();
+}
+
+// Frame indices count the bitmaps of the file in order, starting at one.
+// Every bitmap the animation uses is copied into the player once.
+void MainWindow::playAnimation()
+{
+  AnimationResource* animation = qobject_cast<AnimationResource*>(m_currentResource);
+  if (!animation) {
+    return;
+  }
+
+  QList<BitmapResource*> bitmaps = m_resourcesModel->resources<BitmapResource>();
+
+  QVector<int> frames = animation->frames();
+  if (frames.isEmpty()) {
+    QMessageBox::information(
+        this,
+        QCoreApplication::applicationName(),
+        tr("The animation has no frames."));
+    return;
+  }
+
+  QList<QImage> images;
+  QList<QPoint> positions;
+  QMap<int, int> imageIndices;
+  QVector<int> sequence;
+  int missing = 0;
+
+  foreach (int frame, frames) {
+    BitmapResource* bitmap = bitmaps.value(frame - 1);
+    if (!bitmap || !bitmap->image()) {
+      sequence.append(-1);
+      missing++;
+      continue;
+    }
+
+    if (!imageIndices.contains(frame)) {
+      imageIndices.insert(frame, images.size());
+      images.append(*bitmap->image());
+      positions.append(bitmap->position());
+    }
+
+    sequence.append(imageIndices.value(frame));
+  }
+
+  QDialog dialog(this);
+  dialog.setWindowTitle(tr("Animation %1").arg(animation->id()));
+
+  AnimationPlayer* player = new AnimationPlayer(&dialog);
+  player->setFrames(images, positions, sequence);
+
+  QSpinBox* rateSpinBox = new QSpinBox(&dialog);
+  rateSpinBox->setRange(1, 70);
+  rateSpinBox->setSuffix(tr(" fps"));
+  rateSpinBox->setValue(AnimationPlayer::DEFAULT_RATE);
+  connect(rateSpinBox, QOverload<int>::of(&QSpinBox::valueChanged), player, &AnimationPlayer::setRate);
+
+  QLabel* statsLabel = new QLabel(&dialog);
+  connect(player, &AnimationPlayer::frameShown, [&](int frame) {
+    statsLabel->setText(tr("Frame %1 of %2 (bitmap %3), interval %4 ms (max %5 ms), drawing %6 ms")
+        .arg(frame + 1).arg(frames.size()).arg(frames[frame])
+        .arg(player->averageInterval(), 0, 'f', 1)
+        .arg(player->maxInterval(), 0, 'f', 1)
+        .arg(player->averagePaint(), 0, 'f', 3));
+  });
+
+  QHBoxLayout* controls = new QHBoxLayout;
+  controls->addWidget(new QLabel(tr("Rate:"), &dialog));
+  controls->addWidget(rateSpinBox);
+  controls->addWidget(statsLabel, 1);
+
+  QVBoxLayout* layout = new QVBoxLayout(&dialog);
+  layout->addWidget(player, 1);
+  layout->addLayout(controls);
+
+  if (missing > 0) {
+    layout->addWidget(new QLabel(tr("%n frame(s) refer to no bitmap of this file.", 0, missing), &dialog));
+  }
+
+  player->play();
+  dialog.exec();
+}
+
+// The table is given as pairs of palette indices, "from to" on each line.
+// Other indices stay as they are.
+void MainWindow::remapPalette()
+{
+  bool ok;
+  QString text = QInputDialog::getMultiLineText(
+      this,
+      tr("Remap palette"),
+      tr("Index pairs for all bitmaps and shape materials, \"from to\" on each line:"),
+      QString(),
+      &ok);
+
+  if (!ok || text.trimmed().isEmpty()) {
+    return;
+  }
+
+  QVector<quint8> table(256);
+  for (int i = 0; i < table.size(); i++) {
+    table[i] = i;
+  }
+
+  foreach (const QString& line, text.split('\n', Qt::SkipEmptyParts)) {
+    QStringList pair = line.split(QRegExp("[\\s,=>-]+"), Qt::SkipEmptyParts);
+    bool fromOk = false, toOk = false;
+    int from = pair.size() == 2 ? pair[0].toInt(&fromOk) : -1;
+    int to = pair.size() == 2 ? pair[1].toInt(&toOk) : -1;
+
+    if (!fromOk || !toOk || from < 0 || from > 255 || to < 0 || to > 255) {
+      QMessageBox::critical(
+          this,
+          QCoreApplication::applicationName(),
+          tr("Invalid index pair \"%1\".").arg(line.trimmed()));
+      return;
+    }
+
+    table[from] = to;
+  }
+
+  QList<BitmapResource*> bitmaps = m_resourcesModel->resources<BitmapResource>();
+  QList<ShapeResource*> shapes = m_resourcesModel->resources<ShapeResource>();
+
+  QApplication::setOverrideCursor(Qt::WaitCursor);
+  PaletteRemapCommand* command = new PaletteRemapCommand(table, bitmaps, shapes);
+  QApplication::restoreOverrideCursor();
+
+  if (command->changed() == 0) {
+    delete command;
+    QMessageBox::information(
+        this,
+        QCoreApplication::applicationName(),
+        tr("No bitmap or shape uses the remapped indices."));
+    return;
+  }
+
+  m_undoStack->push(command);
+}
+
 bool MainWindow::changeToSafeFileName(const QString& safeFileName)
 {
   int ret = QMessageBox::question(
@@ -329,6 +1152,10 @@ void MainWindow::setCurrent(const QModelIndex& index)
     m_currentResource->show();
 
     connect(m_currentResource, SIGNAL(dataChanged()), this, SLOT(isModified()));
+
+    if (qobject_cast<AnimationResource*>(m_currentResource)) {
+      connect(m_currentResource, SIGNAL(playRequested()), this, SLOT(playAnimation()), Qt::UniqueConnection);
+    }
   }
 }
 
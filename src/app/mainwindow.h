@@ -7,6 +7,7 @@
 
 class ResourcesModel;
 class QLabel;
+class QUndoStack;
 
 class MainWindow : public QMainWindow
 {
@@ -16,6 +17,8 @@ public:
   MainWindow(QWidget* parent = 0, Qt::WindowFlags flags = Qt::WindowFlags());
 
   void              loadFile(const QString& fileName);
+  int               benchmarkShapes(const QString& fileName, int frames);
+  int               renderThumbnails(const QStringList& fileNames, const QString& dirPath, bool software);
 
 protected:
   void              closeEvent(QCloseEvent* event);
@@ -25,6 +28,16 @@ private slots:
   void              open();
   void              save();
   void              saveAs();
+  void              exportShapes();
+  void              exportBitmaps();
+  void              importBitmaps();
+  void              exportBitmapAtlas();
+  void              importBitmapAtlas();
+  void              compareBitmaps();
+  void              applyBitmapDelta();
+  void              viewShapes();
+  void              playAnimation();
+  void              remapPalette();
 
   void              manual();
   void              about();
@@ -48,6 +61,7 @@ private slots:
 
 private:
   void              saveFile(const QString& fileName);
+  void              activateFilePalette();
   void              updateWindowTitle();
   void              updateStatusBar();
   QString           unpackedExtension(const QString& extension);
@@ -58,6 +72,7 @@ private:
   Ui::MainWindow    m_ui;
 
   ResourcesModel*   m_resourcesModel;
+  QUndoStack*       m_undoStack;
   Resource*         m_currentResource;
 
   QLabel*           m_statusLabel;
@@ -67,8 +82,15 @@ private:
   QString           m_currentFileFilter;
 
   bool              m_modified;
+  int               m_generation;
 
   static const char FILE_SETTINGS_PATH[];
+  static const char EXPORT_SETTINGS_PATH[];
   static const char FILE_FILTERS_LOAD[];
   static const char FILE_FILTERS_SAVE[];
+  static const char DELTA_FILE_FILTERS[];
+  static const char ATLAS_FILE_FILTERS[];
+
+  static const int  THUMBNAIL_WIDTH = 256;
+  static const int  THUMBNAIL_HEIGHT = 192;
 };
@@ -0,0 +1,32 @@
+#include "palettemanager.h"
+
+PaletteManager::PaletteManager()
+{
+}
+
+PaletteManager* PaletteManager::instance()
+{
+  static PaletteManager manager;
+  return &manager;
+}
+
+// Padded to 256 colors like the configured palette.
+void PaletteManager::setPalette(const Palette& palette)
+{
+  Palette padded = palette.mid(0, 256);
+  while (padded.size() < 256) {
+    padded.append(QColor().rgb());
+  }
+
+  if (padded == Settings::m_loadedPalette) {
+    return;
+  }
+
+  Settings::m_loadedPalette = padded;
+  emit paletteChanged();
+}
+
+void PaletteManager::restoreDefault()
+{
+  setPalette(Settings().getPalette(Settings::PATH_PALETTES_VGA));
+}
@@ -0,0 +1,25 @@
+#pragma once
+
+#include <QObject>
+
+#include "settings.h"
+
+// Owns the switch of the active palette, Settings::m_loadedPalette. Bitmaps
+// and shape views follow paletteChanged() and take the new colors without
+// being parsed again.
+class PaletteManager : public QObject
+{
+  Q_OBJECT
+
+public:
+  static PaletteManager* instance();
+
+  void              setPalette(const Palette& palette);
+  void              restoreDefault();
+
+signals:
+  void              paletteChanged();
+
+private:
+  PaletteManager();
+};
@@ -0,0 +1,113 @@
+#include <QApplication>
+#include <QMessageBox>
+#include <string.h>
+
+#include "bitmap/bitmapquantizer.h"
+#include "bitmap/bitmapresource.h"
+#include "paletteremapcommand.h"
+#include "shape/shapemodel.h"
+#include "shape/shaperesource.h"
+
+// Only resources the table changes are kept.
+PaletteRemapCommand::PaletteRemapCommand(const QVector<quint8>& table, const QList<BitmapResource*>& bitmaps, const QList<ShapeResource*>& shapes)
+: QUndoCommand(QObject::tr("Remap palette"))
+{
+  foreach (BitmapResource* bitmap, bitmaps) {
+    if (!bitmap->image()) {
+      continue;
+    }
+
+    BitmapState state;
+    state.resource = bitmap;
+    state.before = *bitmap->image();
+    state.after = BitmapQuantizer::remap(state.before, table.constData());
+
+    if (state.after != state.before) {
+      m_bitmaps.append(state);
+    }
+  }
+
+  foreach (ShapeResource* shape, shapes) {
+    ShapeState state;
+    state.resource = shape;
+    state.before = shape->shapeModel()->materials();
+    state.after = state.before;
+
+    for (int i = 0; i < state.after.size(); i++) {
+      for (int j = 0; j < state.after[i].size(); j++) {
+        state.after[i][j] = table[state.after[i][j]];
+      }
+    }
+
+    if (state.after != state.before) {
+      m_shapes.append(state);
+    }
+  }
+}
+
+void PaletteRemapCommand::undo()
+{
+  apply(false);
+}
+
+void PaletteRemapCommand::redo()
+{
+  apply(true);
+}
+
+void PaletteRemapCommand::apply(bool remapped)
+{
+  QStringList skipped;
+
+  foreach (const BitmapState& state, m_bitmaps) {
+    if (!state.resource || !state.resource->image()) {
+      continue;
+    }
+
+    if (samePixels(*state.resource->image(), remapped ? state.before : state.after)) {
+      state.resource->replaceImage(remapped ? state.after : state.before);
+    }
+    else {
+      skipped.append(state.resource->id());
+    }
+  }
+
+  foreach (const ShapeState& state, m_shapes) {
+    if (!state.resource) {
+      continue;
+    }
+
+    if (state.resource->shapeModel()->materials() == (remapped ? state.before : state.after)) {
+      state.resource->shapeModel()->setMaterials(remapped ? state.after : state.before);
+    }
+    else {
+      skipped.append(state.resource->id());
+    }
+  }
+
+  if (!skipped.isEmpty()) {
+    QMessageBox::warning(
+        QApplication::activeWindow(),
+        QCoreApplication::applicationName(),
+        QObject::tr("These resources were changed since the palette remap and are left as they are:\n%1").arg(skipped.join(", ")));
+  }
+}
+
+// The colour table follows the alpha setting and the active palette, only the
+// indices tell whether a bitmap was edited.
+bool PaletteRemapCommand::samePixels(const QImage& image1, const QImage& image2)
+{
+  if (image1.size() != image2.size() || image1.format() != image2.format()) {
+    return false;
+  }
+
+  // Padding at the end of the lines is not initialized.
+  int bytes = (image1.width() * image1.depth() + 7) / 8;
+  for (int y = 0; y < image1.height(); y++) {
+    if (memcmp(image1.constScanLine(y), image2.constScanLine(y), bytes)) {
+      return false;
+    }
+  }
+
+  return true;
+}
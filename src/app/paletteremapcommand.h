@@ -0,0 +1,46 @@
+#pragma once
+
+#include <QImage>
+#include <QPointer>
+#include <QUndoCommand>
+
+#include "shape/types.h"
+
+class BitmapResource;
+class ShapeResource;
+
+// Sends every bitmap pixel and every shape material of a file through one
+// index table, undone as a single step. The states before and after are
+// kept, so undo does not depend on the table being reversible. Resources
+// removed in the meantime are skipped, as are those changed since in a way
+// the stack does not know about, e.g. by an import, so those changes are
+// never thrown away. The user is told which ones were left alone.
+class PaletteRemapCommand : public QUndoCommand
+{
+public:
+  PaletteRemapCommand(const QVector<quint8>& table, const QList<BitmapResource*>& bitmaps, const QList<ShapeResource*>& shapes);
+
+  void              undo();
+  void              redo();
+
+  int               changed() const { return m_bitmaps.size() + m_shapes.size(); }
+
+private:
+  void              apply(bool remapped);
+  static bool       samePixels(const QImage& image1, const QImage& image2);
+
+  typedef struct {
+    QPointer<BitmapResource> resource;
+    QImage          before;
+    QImage          after;
+  } BitmapState;
+
+  typedef struct {
+    QPointer<ShapeResource> resource;
+    QList<MaterialsList> before;
+    QList<MaterialsList> after;
+  } ShapeState;
+
+  QList<BitmapState> m_bitmaps;
+  QList<ShapeState> m_shapes;
+};
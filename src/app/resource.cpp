@@ -6,6 +6,7 @@
 
 #include "animation/animationresource.h"
 #include "bitmap/bitmapresource.h"
+#include "palette/paletteresource.h"
 #include "raw/rawresource.h"
 #include "shape/shaperesource.h"
 #include "speed/speedresource.h"
@@ -15,7 +16,7 @@
 #include "settings.h"
 #include "stunpack.h"
 
-const QStringList Resource::TYPES = (QStringList() << tr("Animation") << tr("Bitmap") << tr("Path") << tr("Shape") << tr("Speed") << tr("Text") << tr("Tuning"));
+const QStringList Resource::TYPES = (QStringList() << tr("Animation") << tr("Bitmap") << tr("Palette") << tr("Path") << tr("Shape") << tr("Speed") << tr("Text") << tr("Tuning"));
 const QStringList Resource::LOAD_TYPES = (QStringList() << tr("Ignore this resource") << tr("Raw data") << Resource::TYPES);
 
 QString Resource::m_fileName;
@@ -26,7 +27,9 @@ Resource::Resource(QString id, QWidget* parent, Qt::WindowFlags flags)
 {
 }
 
-bool Resource::parse(const QString& fileName, ResourcesModel* resourcesModel, QWidget* parent)
+// Returns false if resources were ignored. With a skipped list the user is
+// never asked, resources that fail to parse are left out and listed there.
+bool Resource::parse(const QString& fileName, ResourcesModel* resourcesModel, QWidget* parent, QStringList* skipped)
 {
   bool modified = false;
 
@@ -187,6 +190,9 @@ bool Resource::parse(const QString& fileName, ResourcesModel* resourcesModel, QW
         else if (type == "animation") {
           resource = new AnimationResource(toc[i].id, &in);
         }
+        else if (type == "palette") {
+          resource = new PaletteResource(toc[i].id, toc[i].size, &in);
+        }
         else if (type == "speed") {
           resource = new SpeedResource(toc[i].id, &in);
         }
@@ -208,6 +214,12 @@ bool Resource::parse(const QString& fileName, ResourcesModel* resourcesModel, QW
       catch (QString msg) {
         in.resetStatus(); // Clear errors for retry/next.
 
+        if (skipped) {
+          skipped->append(tr("Parsing %1 resource \"%2\" failed: %3").arg(type, toc[i].id, msg));
+          modified = true;
+          continue;
+        }
+
         bool ok;
         QString item = QInputDialog::getItem(parent, tr("Error"),
             tr("Parsing %1 resource \"%2\" failed: %3\n\nCancel, ignore or retry with another type:").arg(type).arg(toc[i].id).arg(msg),
@@ -223,6 +235,9 @@ bool Resource::parse(const QString& fileName, ResourcesModel* resourcesModel, QW
           else if (item == tr("Bitmap")) {
             type = "bitmap";
           }
+          else if (item == tr("Palette")) {
+            type = "palette";
+          }
           else if (item == tr("Path")) {
             type = "path";
           }
@@ -365,6 +380,9 @@ Resource* Resource::typeDialog(QWidget* parent)
     else if (item == tr("Bitmap")) {
       resource = new BitmapResource("bmap");
     }
+    else if (item == tr("Palette")) {
+      resource = new PaletteResource("palt");
+    }
     else if (item == tr("Path")) {
       resource = new RawResource("path", "path", RawResource::LENGTH_PATH);
     }
@@ -23,11 +23,12 @@ public:
   Resource(QString id, QWidget* parent = 0, Qt::WindowFlags flags = Qt::WindowFlags());
   virtual ~Resource() {};
 
-  static bool       parse(const QString& fileName, ResourcesModel* resourcesModel, QWidget* parent = 0);
+  static bool       parse(const QString& fileName, ResourcesModel* resourcesModel, QWidget* parent = 0, QStringList* skipped = 0);
   static void       write(const QString& fileName, const ResourcesModel* resourcesModel);
   static Resource*  typeDialog(QWidget* parent = 0);
 
   static QString    fileName()        { return m_fileName; }
+  static void       setFileName(const QString& fileName) { m_fileName = fileName; }
   QString           id() const        { return m_id; }
   void              setId(QString id) { m_id = id; }
   virtual QString   type() const = 0;
@@ -2,7 +2,8 @@
 
 #include <QAbstractListModel>
 
-class Resource;
+#include "resource.h"
+
 class QItemSelectionModel;
 
 typedef QList<Resource*> ResourcesList;
@@ -31,9 +32,25 @@ public:
 
   Resource*         at(int index) const                                              { return m_resources[index]; }
   Resource*         at(const QModelIndex& index) const;
+  template <class T>
+  QList<T*>         resources() const;
 
   static const int  ROWS_MAX = 65536;
 
 private:
   ResourcesList     m_resources;
 };
+
+// Resources of type T, in row order.
+template <class T>
+QList<T*> ResourcesModel::resources() const
+{
+  QList<T*> res;
+  foreach (Resource* resource, m_resources) {
+    if (T* typed = dynamic_cast<T*>(resource)) {
+      res.append(typed);
+    }
+  }
+
+  return res;
+}
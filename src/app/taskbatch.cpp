@@ -0,0 +1,75 @@
+#include <QRunnable>
+
+#include "taskbatch.h"
+
+// Runs the task and reports back through the event loop of the batch.
+class TaskBatch::Task : public QRunnable
+{
+public:
+  Task(QRunnable* task, TaskBatch* batch)
+  : m_task(task),
+    m_batch(batch)
+  {
+  }
+
+  ~Task()
+  {
+    delete m_task;
+  }
+
+  void run()
+  {
+    m_task->run();
+    QMetaObject::invokeMethod(m_batch, "taskDone", Qt::QueuedConnection);
+  }
+
+private:
+  QRunnable*        m_task;
+  TaskBatch*        m_batch;
+};
+
+TaskBatch::TaskBatch(QObject* parent)
+: QObject(parent),
+  m_count(0),
+  m_pending(0),
+  m_closed(false),
+  m_finished(false)
+{
+}
+
+// Tasks refer to the error list and the mutex, so they have to be done
+// first. Reports still queued for a deleted batch are dropped.
+TaskBatch::~TaskBatch()
+{
+  m_pool.waitForDone();
+}
+
+void TaskBatch::start(QRunnable* task)
+{
+  m_count++;
+  m_pending++;
+  m_pool.start(new Task(task, this));
+}
+
+void TaskBatch::close()
+{
+  m_closed = true;
+  QMetaObject::invokeMethod(this, "finish", Qt::QueuedConnection);
+}
+
+void TaskBatch::taskDone()
+{
+  m_pending--;
+  finish();
+}
+
+void TaskBatch::finish()
+{
+  if (!m_closed || m_pending > 0 || m_finished) {
+    return;
+  }
+
+  m_finished = true;
+  emit finished();
+  deleteLater();
+}
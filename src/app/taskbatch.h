@@ -0,0 +1,49 @@
+#pragma once
+
+#include <QMutex>
+#include <QObject>
+#include <QStringList>
+#include <QThreadPool>
+
+class QRunnable;
+
+// Runs a batch of tasks on a pool of its own, so neither the calling thread
+// nor unrelated work on the global pool is waited for. Tasks append their
+// errors to the shared list under the mutex. Once closed and done, the batch
+// emits finished() on the thread it lives in and deletes itself.
+class TaskBatch : public QObject
+{
+  Q_OBJECT
+
+public:
+  TaskBatch(QObject* parent = 0);
+  ~TaskBatch();
+
+  // Takes ownership of the task.
+  void              start(QRunnable* task);
+  // No more tasks follow. finished() comes from the event loop, never from
+  // within this call.
+  void              close();
+
+  int               count() const { return m_count; }
+  QStringList*      errors()      { return &m_errors; }
+  QMutex*           mutex()       { return &m_mutex; }
+
+signals:
+  void              finished();
+
+private slots:
+  void              taskDone();
+  void              finish();
+
+private:
+  class Task;
+
+  QThreadPool       m_pool;
+  QMutex            m_mutex;
+  QStringList       m_errors;
+  int               m_count;
+  int               m_pending;
+  bool              m_closed;
+  bool              m_finished;
+};
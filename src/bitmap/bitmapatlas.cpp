@@ -0,0 +1,130 @@
+#include <algorithm>
+#include <limits.h>
+#include <math.h>
+#include <string.h>
+
+#include "bitmapatlas.h"
+
+QImage BitmapAtlas::pack(const QList<QImage>& images, int background, QVector<QRect>& rects)
+{
+  rects.fill(QRect(), images.size());
+
+  QVector<int> order;
+  qint64 area = 0;
+  int widest = 1;
+  for (int i = 0; i < images.size(); i++) {
+    if (!images[i].isNull()) {
+      order.append(i);
+      area += (qint64)(images[i].width() + GAP) * (images[i].height() + GAP);
+      widest = qMax(widest, images[i].width() + GAP);
+    }
+  }
+
+  std::stable_sort(order.begin(), order.end(), [&](int lhv, int rhv) { return images[lhv].height() > images[rhv].height(); });
+
+  // Roughly square, unless a single image is wider.
+  int atlasWidth = qMax(widest, (int)ceil(sqrt((double)area)));
+  int atlasHeight = 1;
+
+  QVector<SkylineNode> skyline;
+  SkylineNode ground = { 0, 0, atlasWidth };
+  skyline.append(ground);
+
+  foreach (int i, order) {
+    int width = images[i].width() + GAP;
+    int height = images[i].height() + GAP;
+
+    int best = -1;
+    int bestY = 0;
+    int bestBottom = INT_MAX;
+    for (int node = 0; node < skyline.size(); node++) {
+      int y = fit(skyline, node, width, atlasWidth);
+      if (y >= 0 && y + height < bestBottom) {
+        best = node;
+        bestY = y;
+        bestBottom = y + height;
+      }
+    }
+
+    QRect rect(skyline[best].x, bestY, width, height);
+    place(skyline, best, rect);
+
+    rects[i] = QRect(rect.topLeft(), images[i].size());
+    atlasHeight = qMax(atlasHeight, bestBottom);
+  }
+
+  QImage atlas(atlasWidth, atlasHeight, QImage::Format_Indexed8);
+  if (!order.isEmpty()) {
+    atlas.setColorTable(images[order.first()].colorTable());
+  }
+  atlas.fill(background);
+
+  foreach (int i, order) {
+    const QImage& image = images[i];
+    const QRect& rect = rects[i];
+    for (int y = 0; y < image.height(); y++) {
+      memcpy(atlas.scanLine(rect.top() + y) + rect.left(), image.constScanLine(y), image.width());
+    }
+  }
+
+  return atlas;
+}
+
+QImage BitmapAtlas::slice(const QImage& atlas, const QRect& rect)
+{
+  QImage image(rect.size(), QImage::Format_Indexed8);
+  image.setColorTable(atlas.colorTable());
+
+  for (int y = 0; y < rect.height(); y++) {
+    memcpy(image.scanLine(y), atlas.constScanLine(rect.top() + y) + rect.left(), rect.width());
+  }
+
+  return image;
+}
+
+// Height at which a rect of the width rests when its left edge is at the
+// node, or -1 if it sticks out on the right.
+int BitmapAtlas::fit(const QVector<SkylineNode>& skyline, int node, int width, int atlasWidth)
+{
+  if (skyline[node].x + width > atlasWidth) {
+    return -1;
+  }
+
+  int y = 0;
+  for (int i = node, left = width; left > 0; i++) {
+    y = qMax(y, skyline[i].y);
+    left -= skyline[i].width;
+  }
+
+  return y;
+}
+
+void BitmapAtlas::place(QVector<SkylineNode>& skyline, int node, const QRect& rect)
+{
+  SkylineNode top = { rect.left(), rect.bottom() + 1, rect.width() };
+  skyline.insert(node, top);
+
+  // Cut back the nodes now covered by the new one.
+  int end = top.x + top.width;
+  for (int i = node + 1; i < skyline.size() && skyline[i].x < end; ) {
+    int covered = end - skyline[i].x;
+    if (covered >= skyline[i].width) {
+      skyline.remove(i);
+    }
+    else {
+      skyline[i].x += covered;
+      skyline[i].width -= covered;
+      break;
+    }
+  }
+
+  for (int i = 0; i + 1 < skyline.size(); ) {
+    if (skyline[i].y == skyline[i + 1].y) {
+      skyline[i].width += skyline[i + 1].width;
+      skyline.remove(i + 1);
+    }
+    else {
+      i++;
+    }
+  }
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <QImage>
+#include <QList>
+#include <QRect>
+#include <QVector>
+
+// Packs indexed images into one sheet and cuts them out again. Placement
+// follows a skyline: tallest images first, each at the lowest spot that
+// fits, with a gap between neighbours so edits do not run into each other.
+// Pixels are moved a scanline at a time.
+class BitmapAtlas
+{
+public:
+  // The rects receive the place of every image, in order. The sheet is
+  // filled with the background index and takes the first color table.
+  static QImage     pack(const QList<QImage>& images, int background, QVector<QRect>& rects);
+  static QImage     slice(const QImage& atlas, const QRect& rect);
+
+private:
+  typedef struct {
+    int x;
+    int y;
+    int width;
+  } SkylineNode;
+
+  static int        fit(const QVector<SkylineNode>& skyline, int node, int width, int atlasWidth);
+  static void       place(QVector<SkylineNode>& skyline, int node, const QRect& rect);
+
+  static const int  GAP = 1;
+};
@@ -0,0 +1,129 @@
+#include <QVarLengthArray>
+
+#include <string.h>
+
+#include "bitmapcodec.h"
+
+BitmapCodec::Layout BitmapCodec::layout(quint8 flags)
+{
+  if (flags & FLAG_COLUMNS) {
+    return LAYOUT_COLUMNS;
+  }
+  if (flags & FLAG_INTERLACED) {
+    return LAYOUT_INTERLACED;
+  }
+  return LAYOUT_ROWS;
+}
+
+void BitmapCodec::decode(const uchar* data, QImage& image, Layout layout)
+{
+  if (image.isNull()) {
+    return;
+  }
+
+  if (layout == LAYOUT_ROWS) {
+    decodeRows(data, image);
+    return;
+  }
+
+  QVarLengthArray<int, 256> rows(image.height());
+  columnRows(image.height(), layout, rows.data());
+  decodeColumns(data, image, rows.constData());
+}
+
+void BitmapCodec::encode(const QImage& image, uchar* data, Layout layout)
+{
+  if (image.isNull()) {
+    return;
+  }
+
+  if (layout == LAYOUT_ROWS) {
+    for (int y = 0; y < image.height(); y++) {
+      memcpy(data + y * image.width(), image.constScanLine(y), image.width());
+    }
+    return;
+  }
+
+  QVarLengthArray<int, 256> rows(image.height());
+  columnRows(image.height(), layout, rows.data());
+  encodeColumns(image, data, rows.constData());
+}
+
+// Scanlines are padded to 32 bits in the image, so one copy per line.
+void BitmapCodec::decodeRows(const uchar* data, QImage& image)
+{
+  int width = image.width();
+
+  for (int y = 0; y < image.height(); y++) {
+    memcpy(image.scanLine(y), data + y * width, width);
+  }
+}
+
+// Column x holds row y at sourceRows[y]. Blocks of columns are read into
+// blocks of scanlines so that both sides stay in the cache.
+void BitmapCodec::decodeColumns(const uchar* data, QImage& image, const int* sourceRows)
+{
+  int width = image.width();
+  int height = image.height();
+  int stride = image.bytesPerLine();
+  uchar* bits = image.bits();
+
+  for (int y0 = 0; y0 < height; y0 += BLOCK_SIZE) {
+    int y1 = qMin(y0 + BLOCK_SIZE, height);
+
+    for (int x0 = 0; x0 < width; x0 += BLOCK_SIZE) {
+      int x1 = qMin(x0 + BLOCK_SIZE, width);
+
+      for (int y = y0; y < y1; y++) {
+        uchar* dst = bits + y * stride;
+        const uchar* src = data + sourceRows[y];
+
+        for (int x = x0; x < x1; x++) {
+          dst[x] = src[x * height];
+        }
+      }
+    }
+  }
+}
+
+// The inverse of decodeColumns(), with the same blocking.
+void BitmapCodec::encodeColumns(const QImage& image, uchar* data, const int* sourceRows)
+{
+  int width = image.width();
+  int height = image.height();
+  int stride = image.bytesPerLine();
+  const uchar* bits = image.constBits();
+
+  for (int y0 = 0; y0 < height; y0 += BLOCK_SIZE) {
+    int y1 = qMin(y0 + BLOCK_SIZE, height);
+
+    for (int x0 = 0; x0 < width; x0 += BLOCK_SIZE) {
+      int x1 = qMin(x0 + BLOCK_SIZE, width);
+
+      for (int y = y0; y < y1; y++) {
+        const uchar* src = bits + y * stride;
+        uchar* dst = data + sourceRows[y];
+
+        for (int x = x0; x < x1; x++) {
+          dst[x * height] = src[x];
+        }
+      }
+    }
+  }
+}
+
+// Where each row is found in a column. Interlaced columns hold the even rows
+// first and the odd rows after them.
+void BitmapCodec::columnRows(int height, Layout layout, int* rows)
+{
+  int evenRows = (height + 1) / 2;
+
+  for (int y = 0; y < height; y++) {
+    if (layout != LAYOUT_INTERLACED) {
+      rows[y] = y;
+    }
+    else {
+      rows[y] = (y % 2) ? evenRows + y / 2 : y / 2;
+    }
+  }
+}
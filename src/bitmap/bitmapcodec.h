@@ -0,0 +1,29 @@
+#pragma once
+
+#include <QImage>
+
+// Pixel layouts of bitmap resources. Flags in the fifth unknown header byte
+// select row-major data, column-major data, or columns with the even rows
+// first and the odd rows after them. Both directions work on whole scanlines
+// of an 8-bit indexed image, column data is transposed in cache-sized blocks.
+class BitmapCodec
+{
+public:
+  enum Layout { LAYOUT_ROWS, LAYOUT_COLUMNS, LAYOUT_INTERLACED };
+
+  static Layout     layout(quint8 flags);
+
+  // The image must be Format_Indexed8 and the data width * height bytes.
+  static void       decode(const uchar* data, QImage& image, Layout layout);
+  static void       encode(const QImage& image, uchar* data, Layout layout);
+
+private:
+  static void       decodeRows(const uchar* data, QImage& image);
+  static void       decodeColumns(const uchar* data, QImage& image, const int* sourceRows);
+  static void       encodeColumns(const QImage& image, uchar* data, const int* sourceRows);
+  static void       columnRows(int height, Layout layout, int* rows);
+
+  static const quint8 FLAG_COLUMNS    = 0x10;
+  static const quint8 FLAG_INTERLACED = 0x20;
+  static const int  BLOCK_SIZE        = 64;
+};
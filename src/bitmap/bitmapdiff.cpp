@@ -0,0 +1,305 @@
+#include <QDataStream>
+
+#include <string.h>
+
+#include "bitmapdiff.h"
+
+QVector<QRect> BitmapDiff::compare(const QImage& base, const QImage& revised)
+{
+  QVector<QRect> rects;
+
+  if (revised.isNull()) {
+    return rects;
+  }
+
+  if (base.size() != revised.size()) {
+    rects.append(revised.rect());
+    return rects;
+  }
+
+  QRect current;
+  for (int y = 0; y < revised.height(); y++) {
+    int left, right;
+    if (findSpan(base.constScanLine(y), revised.constScanLine(y), revised.width(), left, right)) {
+      current |= QRect(left, y, right - left + 1, 1);
+    }
+    else if (!current.isNull()) {
+      rects.append(current);
+      current = QRect();
+    }
+  }
+
+  if (!current.isNull()) {
+    rects.append(current);
+  }
+
+  return rects;
+}
+
+// Marks every changed pixel in the given color, for drawing over the revised
+// image. Only the rectangles are looked at.
+QImage BitmapDiff::mask(const Change& change, QRgb color)
+{
+  QImage mask(change.revised.size(), QImage::Format_ARGB32_Premultiplied);
+  mask.fill(0);
+
+  bool sameSize = (change.base.size() == change.revised.size());
+  QRgb premultiplied = qPremultiply(color);
+
+  foreach (const QRect& rect, change.rects) {
+    for (int y = rect.top(); y <= rect.bottom(); y++) {
+      const uchar* base = sameSize ? change.base.constScanLine(y) : 0;
+      const uchar* revised = change.revised.constScanLine(y);
+      QRgb* line = (QRgb*)mask.scanLine(y);
+
+      for (int x = rect.left(); x <= rect.right(); x++) {
+        if (!base || base[x] != revised[x]) {
+          line[x] = premultiplied;
+        }
+      }
+    }
+  }
+
+  return mask;
+}
+
+// Little endian, like the resource files:
+//   magic, version, change count,
+//   per change: id, base width and height, revised width and height, rect count,
+//   per rect: x, y, width, height, packed length, packed pixels.
+QByteArray BitmapDiff::writeDelta(const QList<Change>& changes)
+{
+  QByteArray delta;
+  QDataStream out(&delta, QIODevice::WriteOnly);
+  out.setByteOrder(QDataStream::LittleEndian);
+
+  out << DELTA_MAGIC << DELTA_VERSION << (quint32)changes.size();
+
+  QByteArray pixels;
+  QByteArray packed;
+
+  foreach (const Change& change, changes) {
+    out << change.id.toLatin1();
+    out << (quint16)change.baseSize.width() << (quint16)change.baseSize.height();
+    out << (quint16)change.revised.width() << (quint16)change.revised.height();
+    out << (quint32)change.rects.size();
+
+    foreach (const QRect& rect, change.rects) {
+      pixels.resize(rect.width() * rect.height());
+      for (int y = 0; y < rect.height(); y++) {
+        memcpy(pixels.data() + y * rect.width(), change.revised.constScanLine(rect.top() + y) + rect.left(), rect.width());
+      }
+
+      packed.clear();
+      packBits((const uchar*)pixels.constData(), pixels.size(), packed);
+
+      out << (quint16)rect.x() << (quint16)rect.y() << (quint16)rect.width() << (quint16)rect.height();
+      out << (quint32)packed.size();
+      out.writeRawData(packed.constData(), packed.size());
+    }
+  }
+
+  return delta;
+}
+
+QList<BitmapDiff::Change> BitmapDiff::readDelta(const QByteArray& delta)
+{
+  QDataStream in(delta);
+  in.setByteOrder(QDataStream::LittleEndian);
+
+  quint32 magic, count;
+  quint16 version;
+  in >> magic >> version >> count;
+
+  if (in.status() != QDataStream::Ok || magic != DELTA_MAGIC) {
+    throw tr("Not a bitmap delta file.");
+  }
+  if (version != DELTA_VERSION) {
+    throw tr("Unsupported bitmap delta version %1.").arg(version);
+  }
+
+  QList<Change> changes;
+  QByteArray pixels;
+  QByteArray packed;
+
+  for (quint32 i = 0; i < count; i++) {
+    QByteArray id;
+    quint16 baseWidth, baseHeight, width, height;
+    quint32 rectCount;
+    in >> id >> baseWidth >> baseHeight >> width >> height >> rectCount;
+
+    if (in.status() != QDataStream::Ok) {
+      throw tr("Truncated bitmap delta.");
+    }
+
+    Change change;
+    change.id = QString::fromLatin1(id);
+    change.baseSize = QSize(baseWidth, baseHeight);
+    change.revised = QImage(width, height, QImage::Format_Indexed8);
+    change.revised.fill(0);
+
+    for (quint32 j = 0; j < rectCount; j++) {
+      quint16 x, y, w, h;
+      quint32 length;
+      in >> x >> y >> w >> h >> length;
+
+      QRect rect(x, y, w, h);
+      if (in.status() != QDataStream::Ok || rect.isEmpty() || !change.revised.rect().contains(rect) || length > (quint32)(delta.size())) {
+        throw tr("Invalid rectangle in bitmap delta for \"%1\".").arg(change.id);
+      }
+
+      packed.resize(length);
+      pixels.resize(w * h);
+      if (in.readRawData(packed.data(), length) != (int)length ||
+          !unpackBits(packed.constData(), packed.constData() + length, (uchar*)pixels.data(), pixels.size())) {
+        throw tr("Corrupt pixel data in bitmap delta for \"%1\".").arg(change.id);
+      }
+
+      for (int row = 0; row < h; row++) {
+        memcpy(change.revised.scanLine(y + row) + x, pixels.constData() + row * w, w);
+      }
+
+      change.rects.append(rect);
+    }
+
+    changes.append(change);
+  }
+
+  return changes;
+}
+
+QImage BitmapDiff::apply(const QImage& base, const Change& change)
+{
+  if (base.size() != change.baseSize) {
+    throw tr("Bitmap is %1x%2, the delta expects %3x%4.")
+        .arg(base.width()).arg(base.height())
+        .arg(change.baseSize.width()).arg(change.baseSize.height());
+  }
+
+  QImage result;
+  if (change.revised.size() == base.size()) {
+    result = base.copy();
+  }
+  else {
+    result = QImage(change.revised.size(), QImage::Format_Indexed8);
+    result.setColorTable(base.colorTable());
+    result.fill(0);
+  }
+
+  foreach (const QRect& rect, change.rects) {
+    for (int y = rect.top(); y <= rect.bottom(); y++) {
+      memcpy(result.scanLine(y) + rect.left(), change.revised.constScanLine(y) + rect.left(), rect.width());
+    }
+  }
+
+  return result;
+}
+
+// Most lines of a revised bitmap are unchanged, so the whole line is compared
+// first, which the C library does with vector instructions. Changed lines are
+// then narrowed down a word at a time from both ends.
+bool BitmapDiff::findSpan(const uchar* base, const uchar* revised, int width, int& left, int& right)
+{
+  if (memcmp(base, revised, width) == 0) {
+    return false;
+  }
+
+  int words = width / 8;
+
+  int word = 0;
+  for (; word < words; word++) {
+    quint64 a, b;
+    memcpy(&a, base + word * 8, 8);
+    memcpy(&b, revised + word * 8, 8);
+    if (a != b) {
+      break;
+    }
+  }
+
+  left = word * 8;
+  while (base[left] == revised[left]) {
+    left++;
+  }
+
+  right = width - 1;
+  while (right >= words * 8 && base[right] == revised[right]) {
+    right--;
+  }
+
+  if (right < words * 8) {
+    for (word = words - 1; word >= 0; word--) {
+      quint64 a, b;
+      memcpy(&a, base + word * 8, 8);
+      memcpy(&b, revised + word * 8, 8);
+      if (a != b) {
+        break;
+      }
+    }
+
+    right = word * 8 + 7;
+    while (base[right] == revised[right]) {
+      right--;
+    }
+  }
+
+  return true;
+}
+
+// PackBits: a header n of 0..127 is followed by n + 1 literal bytes, one of
+// -127..-1 by a single byte repeated 1 - n times.
+void BitmapDiff::packBits(const uchar* data, int length, QByteArray& out)
+{
+  int i = 0;
+  while (i < length) {
+    int run = 1;
+    while (i + run < length && run < 128 && data[i + run] == data[i]) {
+      run++;
+    }
+
+    if (run > 1) {
+      out.append((char)(1 - run));
+      out.append((char)data[i]);
+      i += run;
+      continue;
+    }
+
+    int start = i;
+    while (i < length && i - start < 128 && !(i + 1 < length && data[i] == data[i + 1])) {
+      i++;
+    }
+
+    out.append((char)(i - start - 1));
+    out.append((const char*)data + start, i - start);
+  }
+}
+
+bool BitmapDiff::unpackBits(const char* data, const char* end, uchar* out, int length)
+{
+  int i = 0;
+  while (i < length) {
+    if (data >= end) {
+      return false;
+    }
+
+    int n = (qint8)*data++;
+    if (n >= 0) {
+      int count = n + 1;
+      if (count > length - i || count > end - data) {
+        return false;
+      }
+      memcpy(out + i, data, count);
+      data += count;
+      i += count;
+    }
+    else if (n != -128) {
+      int count = 1 - n;
+      if (count > length - i || data >= end) {
+        return false;
+      }
+      memset(out + i, (uchar)*data++, count);
+      i += count;
+    }
+  }
+
+  return true;
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <QCoreApplication>
+#include <QImage>
+#include <QList>
+#include <QRect>
+#include <QVector>
+
+// Compares indexed bitmaps by palette index and stores the differences as
+// deltas. Scanlines are compared whole first, the changed span of a line is
+// then narrowed down with 64-bit words, and the spans of adjacent lines are
+// merged into rectangles. A delta holds the revised pixels of the rectangles,
+// PackBits compressed, and turns the base image into the revised one.
+class BitmapDiff
+{
+  Q_DECLARE_TR_FUNCTIONS(BitmapDiff)
+
+public:
+  typedef struct {
+    QString         id;
+    QSize           baseSize;
+    QImage          base;     // Null when read from a delta.
+    QImage          revised;  // Only the pixels inside the rects are valid when read from a delta.
+    QVector<QRect>  rects;
+  } Change;
+
+  // Images of different sizes differ as a whole.
+  static QVector<QRect> compare(const QImage& base, const QImage& revised);
+  static QImage     mask(const Change& change, QRgb color);
+
+  // A delta holds any number of changes, keyed by resource id.
+  static QByteArray writeDelta(const QList<Change>& changes);
+  static QList<Change> readDelta(const QByteArray& delta);
+  static QImage     apply(const QImage& base, const Change& change);
+
+private:
+  static bool       findSpan(const uchar* base, const uchar* revised, int width, int& left, int& right);
+  static void       packBits(const uchar* data, int length, QByteArray& out);
+  static bool       unpackBits(const char* data, const char* end, uchar* out, int length);
+
+  static const quint32 DELTA_MAGIC   = 0x4C444253; // "SBDL"
+  static const quint16 DELTA_VERSION = 1;
+};
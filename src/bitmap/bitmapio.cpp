@@ -0,0 +1,73 @@
+#include <QImageReader>
+#include <QImageWriter>
+#include <QMutex>
+
+#include "bitmapio.h"
+#include "bitmapquantizer.h"
+
+BitmapExportTask::BitmapExportTask(const QImage& image, const BitmapText& text, const QString& name, const QString& filePath, QStringList* errors, QMutex* mutex)
+: m_image(image),
+  m_text(text),
+  m_name(name),
+  m_filePath(filePath),
+  m_errors(errors),
+  m_mutex(mutex)
+{
+}
+
+void BitmapExportTask::run()
+{
+  QImageWriter writer(m_filePath);
+
+  for (BitmapText::const_iterator i = m_text.constBegin(); i != m_text.constEnd(); ++i) {
+    writer.setText(i.key(), i.value());
+  }
+
+  if (!writer.write(m_image)) {
+    QMutexLocker locker(m_mutex);
+    m_errors->append(QString("%1: %2").arg(m_name, writer.errorString()));
+  }
+}
+
+BitmapImportTask::BitmapImportTask(const QString& filePath, const QSize& maxSize, const BitmapQuantizer* opaque, const BitmapQuantizer* transparent, int alphaIndex,
+                                   QImage* image, BitmapText* text, const QString& name, QStringList* errors, QMutex* mutex)
+: m_filePath(filePath),
+  m_maxSize(maxSize),
+  m_opaque(opaque),
+  m_transparent(transparent),
+  m_alphaIndex(alphaIndex),
+  m_image(image),
+  m_text(text),
+  m_name(name),
+  m_errors(errors),
+  m_mutex(mutex)
+{
+}
+
+void BitmapImportTask::run()
+{
+  try {
+    QImageReader reader(m_filePath);
+
+    QSize size = reader.size();
+    if (size.width() > m_maxSize.width() || size.height() > m_maxSize.height()) {
+      throw tr("Source file exceeds max dimensions.");
+    }
+
+    QImage image;
+    if (!reader.read(&image)) {
+      throw reader.errorString();
+    }
+
+    foreach (const QString& key, image.textKeys()) {
+      m_text->insert(key, image.text(key));
+    }
+
+    const BitmapQuantizer* quantizer = image.hasAlphaChannel() ? m_transparent : m_opaque;
+    *m_image = quantizer->quantize(image, BitmapQuantizer::DITHER_NONE, m_alphaIndex);
+  }
+  catch (QString msg) {
+    QMutexLocker locker(m_mutex);
+    m_errors->append(QString("%1: %2").arg(m_name, msg));
+  }
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <QCoreApplication>
+#include <QImage>
+#include <QMap>
+#include <QRunnable>
+#include <QStringList>
+
+class BitmapQuantizer;
+class QMutex;
+
+typedef QMap<QString, QString> BitmapText;
+
+// Encodes one image to a file with the given text chunks. Errors are
+// collected in the shared list.
+class BitmapExportTask : public QRunnable
+{
+public:
+  BitmapExportTask(const QImage& image, const BitmapText& text, const QString& name, const QString& filePath, QStringList* errors, QMutex* mutex);
+
+  void              run();
+
+private:
+  QImage            m_image;
+  BitmapText        m_text;
+  QString           m_name;
+  QString           m_filePath;
+  QStringList*      m_errors;
+  QMutex*           m_mutex;
+};
+
+// Reads and quantizes one image file. The quantizers are shared and only
+// read, the one for images with alpha leaves out the transparent index. The
+// result and its text chunks go to slots owned by the caller.
+class BitmapImportTask : public QRunnable
+{
+  Q_DECLARE_TR_FUNCTIONS(BitmapImportTask)
+
+public:
+  BitmapImportTask(const QString& filePath, const QSize& maxSize, const BitmapQuantizer* opaque, const BitmapQuantizer* transparent, int alphaIndex,
+                   QImage* image, BitmapText* text, const QString& name, QStringList* errors, QMutex* mutex);
+
+  void              run();
+
+private:
+  QString           m_filePath;
+  QSize             m_maxSize;
+  const BitmapQuantizer* m_opaque;
+  const BitmapQuantizer* m_transparent;
+  int               m_alphaIndex;
+  QImage*           m_image;
+  BitmapText*       m_text;
+  QString           m_name;
+  QStringList*      m_errors;
+  QMutex*           m_mutex;
+};
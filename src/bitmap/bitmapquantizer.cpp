@@ -0,0 +1,252 @@
+#include <QSet>
+#include <limits.h>
+#include <string.h>
+
+#include "bitmapquantizer.h"
+
+const int BitmapQuantizer::BAYER[4][4] = {
+  {  0,  8,  2, 10 },
+  { 12,  4, 14,  6 },
+  {  3, 11,  1,  9 },
+  { 15,  7, 13,  5 }
+};
+
+BitmapQuantizer::BitmapQuantizer(const QVector<QRgb>& palette, int excluded)
+: m_palette(palette),
+  m_excluded(excluded)
+{
+  const int size = 1 << CUBE_BITS;
+  const int half = 1 << (7 - CUBE_BITS);
+
+  // Matched at the center of each cell.
+  m_cube.resize(size * size * size);
+  for (int r = 0; r < size; r++) {
+    for (int g = 0; g < size; g++) {
+      for (int b = 0; b < size; b++) {
+        m_cube[(r * size + g) * size + b] = nearest(
+            (r << (8 - CUBE_BITS)) + half,
+            (g << (8 - CUBE_BITS)) + half,
+            (b << (8 - CUBE_BITS)) + half);
+      }
+    }
+  }
+
+  // The center of a cell may be nearer to another entry than a palette
+  // color inside it. The first of equal entries wins, as in the search.
+  // Entries are the color with the index in the top byte, grouped by cell.
+  QSet<QRgb> unique;
+  QVector<int> cells;
+  for (int i = 0; i < m_palette.size(); i++) {
+    QRgb color = m_palette[i] & RGB_MASK;
+    if (i == m_excluded || unique.contains(color)) {
+      continue;
+    }
+
+    unique.insert(color);
+    cells.append(((qRed(color) >> (8 - CUBE_BITS)) << (2 * CUBE_BITS)) | ((qGreen(color) >> (8 - CUBE_BITS)) << CUBE_BITS) | (qBlue(color) >> (8 - CUBE_BITS)));
+    m_exactColors.append(color | ((quint32)i << 24));
+  }
+
+  m_exactStart.fill(0, size * size * size + 1);
+  foreach (int cell, cells) {
+    m_exactStart[cell + 1]++;
+  }
+  for (int cell = 0; cell < size * size * size; cell++) {
+    m_exactStart[cell + 1] += m_exactStart[cell];
+  }
+
+  QVector<quint16> next = m_exactStart;
+  QVector<quint32> entries(m_exactColors.size());
+  for (int i = 0; i < cells.size(); i++) {
+    entries[next[cells[i]]++] = m_exactColors[i];
+  }
+  m_exactColors = entries;
+}
+
+// Weights the channels by the mean red level, which follows perceived
+// differences much better than plain RGB distance at no real cost.
+int BitmapQuantizer::nearest(int red, int green, int blue) const
+{
+  int best = 0;
+  int bestDistance = INT_MAX;
+
+  for (int i = 0; i < m_palette.size(); i++) {
+    if (i == m_excluded) {
+      continue;
+    }
+
+    QRgb color = m_palette[i];
+    int mean = (red + qRed(color)) / 2;
+    int dr = red - qRed(color);
+    int dg = green - qGreen(color);
+    int db = blue - qBlue(color);
+    int distance = (((512 + mean) * dr * dr) >> 8) + 4 * dg * dg + (((767 - mean) * db * db) >> 8);
+
+    if (distance < bestDistance) {
+      bestDistance = distance;
+      best = i;
+    }
+  }
+
+  return best;
+}
+
+QImage BitmapQuantizer::quantize(const QImage& source, Dither dither, int alphaIndex) const
+{
+  if (source.format() == QImage::Format_Indexed8) {
+    return quantizeIndexed(source, alphaIndex);
+  }
+
+  QImage image = source.convertToFormat(QImage::Format_ARGB32);
+  QImage result(image.size(), QImage::Format_Indexed8);
+  result.setColorTable(m_palette);
+
+  if (image.isNull() || m_palette.isEmpty()) {
+    return result;
+  }
+
+  int width = image.width();
+  bool alpha = alphaIndex >= 0 && source.hasAlphaChannel();
+
+  // Errors of the current and the next row, in 1/16 units, one pixel of
+  // margin on both sides.
+  QVector<int> errors[2];
+  if (dither == DITHER_DIFFUSION) {
+    errors[0].fill(0, (width + 2) * 3);
+    errors[1].fill(0, (width + 2) * 3);
+  }
+
+  for (int y = 0; y < image.height(); y++) {
+    const QRgb* src = reinterpret_cast<const QRgb*>(image.constScanLine(y));
+    uchar* dst = result.scanLine(y);
+
+    if (dither == DITHER_ORDERED) {
+      const int* bayer = BAYER[y & 3];
+
+      for (int x = 0; x < width; x++) {
+        int offset = (bayer[x & 3] * 2 - 15) * ORDERED_AMPLITUDE / 32;
+        dst[x] = lookup(
+            qBound(0, qRed(src[x]) + offset, 255),
+            qBound(0, qGreen(src[x]) + offset, 255),
+            qBound(0, qBlue(src[x]) + offset, 255));
+      }
+    }
+    else if (dither == DITHER_DIFFUSION) {
+      int* current = errors[y & 1].data();
+      int* next = errors[(y + 1) & 1].data();
+      memset(next, 0, (width + 2) * 3 * sizeof(int));
+
+      for (int x = 0; x < width; x++) {
+        int* error = current + (x + 1) * 3;
+        int red = qBound(0, qRed(src[x]) + error[0] / 16, 255);
+        int green = qBound(0, qGreen(src[x]) + error[1] / 16, 255);
+        int blue = qBound(0, qBlue(src[x]) + error[2] / 16, 255);
+
+        quint8 index = lookup(red, green, blue);
+        dst[x] = index;
+
+        QRgb color = m_palette.value(index);
+        int diff[3] = { red - qRed(color), green - qGreen(color), blue - qBlue(color) };
+
+        // 7/16 right, 3/16 below left, 5/16 below, 1/16 below right.
+        for (int c = 0; c < 3; c++) {
+          error[3 + c] += diff[c] * 7;
+          next[x * 3 + c] += diff[c] * 3;
+          next[(x + 1) * 3 + c] += diff[c] * 5;
+          next[(x + 2) * 3 + c] += diff[c];
+        }
+      }
+    }
+    else {
+      for (int x = 0; x < width; x++) {
+        dst[x] = lookup(qRed(src[x]), qGreen(src[x]), qBlue(src[x]));
+      }
+    }
+
+    // A select without branches, which the compiler vectorises.
+    if (alpha) {
+      const quint8 transparent = alphaIndex;
+      for (int x = 0; x < width; x++) {
+        dst[x] = (src[x] >> 24) < ALPHA_THRESHOLD ? transparent : dst[x];
+      }
+    }
+  }
+
+  return result;
+}
+
+// Indexed images with the colors of the palette, apart from the transparent
+// entry, keep their indices, so images exported with the same palette come
+// back unchanged even where entries share a color. Other color tables are
+// matched with the exact search.
+QImage BitmapQuantizer::quantizeIndexed(const QImage& image, int alphaIndex) const
+{
+  QImage result(image.size(), QImage::Format_Indexed8);
+  result.setColorTable(m_palette);
+
+  if (image.isNull() || m_palette.isEmpty()) {
+    return result;
+  }
+
+  QVector<QRgb> colors = image.colorTable();
+
+  bool samePalette = colors.size() <= m_palette.size();
+  for (int i = 0; samePalette && i < colors.size(); i++) {
+    samePalette = i == alphaIndex || !((colors[i] ^ m_palette[i]) & RGB_MASK);
+  }
+
+  quint8 table[256];
+  for (int i = 0; i < 256; i++) {
+    QRgb color = colors.value(i);
+    if (alphaIndex >= 0 && image.hasAlphaChannel() && qAlpha(color) < ALPHA_THRESHOLD) {
+      table[i] = alphaIndex;
+    }
+    else if (samePalette) {
+      table[i] = i;
+    }
+    else {
+      table[i] = nearest(qRed(color), qGreen(color), qBlue(color));
+    }
+  }
+
+  for (int y = 0; y < image.height(); y++) {
+    const uchar* src = image.constScanLine(y);
+    uchar* dst = result.scanLine(y);
+
+    for (int x = 0; x < image.width(); x++) {
+      dst[x] = table[src[x]];
+    }
+  }
+
+  return result;
+}
+
+// A byte table lookup is a gather, which SSE/AVX shuffles only do for 16
+// entries, so the lookups are unrolled by eight per step instead and the
+// loop stays bound by memory.
+QImage BitmapQuantizer::remap(const QImage& image, const quint8* table)
+{
+  QImage result = image.copy();
+
+  int width = result.width();
+  for (int y = 0; y < result.height(); y++) {
+    uchar* line = result.scanLine(y);
+
+    int x = 0;
+    for (; x + 8 <= width; x += 8) {
+      line[x]     = table[line[x]];
+      line[x + 1] = table[line[x + 1]];
+      line[x + 2] = table[line[x + 2]];
+      line[x + 3] = table[line[x + 3]];
+      line[x + 4] = table[line[x + 4]];
+      line[x + 5] = table[line[x + 5]];
+      line[x + 6] = table[line[x + 6]];
+      line[x + 7] = table[line[x + 7]];
+    }
+    for (; x < width; x++) {
+      line[x] = table[line[x]];
+    }
+  }
+
+  return result;
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <QImage>
+#include <QVector>
+
+// Maps true-color images onto a palette. The nearest entry by a weighted
+// "redmean" distance is looked up once for every cell of a 32x32x32 cube,
+// not for every pixel. The palette colors inside a cell are kept in a flat
+// list and compared first, so images made of palette colors map
+// losslessly. Dithering is optional, either with a 4x4 Bayer matrix or by
+// Floyd-Steinberg error diffusion. Pixels with an alpha below one half
+// become the given transparent index. Indexed images keep their indices if
+// they use the palette, otherwise their color table is matched exactly.
+class BitmapQuantizer
+{
+public:
+  enum Dither { DITHER_NONE, DITHER_ORDERED, DITHER_DIFFUSION };
+
+  // The excluded entry is never matched, e.g. the transparent index.
+  BitmapQuantizer(const QVector<QRgb>& palette, int excluded = -1);
+
+  QImage            quantize(const QImage& image, Dither dither = DITHER_NONE, int alphaIndex = -1) const;
+
+  // Replaces every index of an indexed image through a 256 entry table.
+  static QImage     remap(const QImage& image, const quint8* table);
+
+private:
+  QImage            quantizeIndexed(const QImage& image, int alphaIndex) const;
+  int               nearest(int red, int green, int blue) const;
+  quint8            lookup(int red, int green, int blue) const
+  {
+    int cell = ((red >> (8 - CUBE_BITS)) << (2 * CUBE_BITS)) | ((green >> (8 - CUBE_BITS)) << CUBE_BITS) | (blue >> (8 - CUBE_BITS));
+    quint32 rgb = (red << 16) | (green << 8) | blue;
+    for (int i = m_exactStart[cell]; i < m_exactStart[cell + 1]; i++) {
+      if ((m_exactColors[i] & RGB_MASK) == rgb) {
+        return m_exactColors[i] >> 24;
+      }
+    }
+    return m_cube[cell];
+  }
+
+  QVector<QRgb>     m_palette;
+  QVector<quint8>   m_cube;
+  QVector<quint16>  m_exactStart;
+  QVector<quint32>  m_exactColors;
+  int               m_excluded;
+
+  static const int  CUBE_BITS = 5;
+  static const int  ORDERED_AMPLITUDE = 32;
+  static const int  ALPHA_THRESHOLD = 0x80;
+  static const int  BAYER[4][4];
+};
@@ -2,17 +2,32 @@
 #include <QImageReader>
 #include <QImageWriter>
 #include <QIntValidator>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
 #include <QMessageBox>
+#include <QPointer>
+#include <QSharedPointer>
 
+#include "app/palettemanager.h"
 #include "app/settings.h"
+#include "app/taskbatch.h"
+#include "bitmapatlas.h"
+#include "bitmapcodec.h"
+#include "bitmapio.h"
+#include "bitmapquantizer.h"
 #include "bitmapresource.h"
 
 #include "ui_bitmapresource.h"
 
 QString BitmapResource::m_currentFilePath;
 QString BitmapResource::m_currentFileFilter;
+QVector<QRgb> BitmapResource::m_opaquePalette;
+QVector<QRgb> BitmapResource::m_transparentPalette;
 
 const char BitmapResource::FILE_SETTINGS_PATH[] = "paths/bitmap";
+const char BitmapResource::TEXT_PREFIX[] = "Stunts";
+const char* const BitmapResource::HEADER_KEYS[] = { "X", "Y", "Unk1", "Unk2", "Unk3", "Unk4", "Unk5", "Unk6" };
 const char BitmapResource::FILE_FILTERS[] =
     "Image files (*.png *.bmp *.gif *.jpg *.jpeg);;"
     "Portable Network Graphics (*.png);;"
@@ -92,6 +107,8 @@ void BitmapResource::setup()
   m_ui->editY->setValidator(posValidator);
 
   m_image = 0;
+
+  connect(PaletteManager::instance(), SIGNAL(paletteChanged()), this, SLOT(updatePalette()));
 }
 
 void BitmapResource::parse(QDataStream* in)
@@ -140,31 +157,8 @@ void BitmapResource::parse(QDataStream* in)
 
     // Process data.
     m_image = new QImage(width, height, QImage::Format_Indexed8);
-    m_image->setColorTable(Settings::m_loadedPalette);
-
-    int ry = 0;
-    for (int y = 0; y < height; y++) {
-      for (int x = 0; x < width; x++) {
-        if ((unk5 & 0x10) == 0x10) {
-          m_image->setPixel(x, y, data[(x * height) + y]);
-        }
-        else if ((unk5 & 0x20) == 0x20) {
-          if ((y % 2) == 0) {
-            m_image->setPixel(x, y, data[(x * height) + ry]);
-          }
-          else {
-            m_image->setPixel(x, y, data[(height / 2) + (x * height) + ry]);
-          }
-        }
-        else {
-          m_image->setPixel(x, y, data[(y * width) + x]);
-        }
-      }
 
-      if ((y % 2) == 0) {
-        ry++;
-      }
-    }
+    BitmapCodec::decode(data, *m_image, BitmapCodec::layout(unk5));
   }
   catch (QString msg) {
     delete[] data;
@@ -203,15 +197,33 @@ void BitmapResource::write(QDataStream* out) const
 
   unk3 = m_ui->editUnk3->text().toUShort(0, 16);
   unk4 = m_ui->editUnk4->text().toUShort(0, 16);
-  unk5 = m_ui->editUnk5->text().toUShort(0, 16) & 0xCF;
+  unk5 = m_ui->editUnk5->text().toUShort(0, 16);
   unk6 = m_ui->editUnk6->text().toUShort(0, 16);
   *out << unk3 << unk4 << unk5 << unk6;
 
   checkError(out, tr("header"), true);
 
-  if (m_image) {
-    int length = m_image->width() * m_image->height();
-    if (out->writeRawData((char*)m_image->bits(), length) != length) {
+  if (!m_image) {
+    return;
+  }
+
+  // Data is written back in the layout given by the header.
+  BitmapCodec::Layout layout = BitmapCodec::layout(unk5);
+  int width = m_image->width();
+
+  if (layout == BitmapCodec::LAYOUT_ROWS) {
+    for (int y = 0; y < m_image->height(); y++) {
+      if (out->writeRawData((const char*)m_image->constScanLine(y), width) != width) {
+        throw tr("Couldn't write image data.");
+      }
+    }
+  }
+  else {
+    int length = width * m_image->height();
+    QByteArray data(length, Qt::Uninitialized);
+    BitmapCodec::encode(*m_image, (uchar*)data.data(), layout);
+
+    if (out->writeRawData(data.constData(), length) != length) {
       throw tr("Couldn't write image data.");
     }
   }
@@ -223,30 +235,28 @@ void BitmapResource::toggleAlpha(bool alpha)
     return;
   }
 
-  QColor color(m_image->color(ALPHA_INDEX));
-  color.setAlpha(alpha ? 0 : 255);
-  m_image->setColor(ALPHA_INDEX, color.rgba());
+  // Both tables are shared by all bitmaps, no image holds its own copy.
+  m_image->setColorTable(alpha ? transparentPalette() : Settings::m_loadedPalette);
 
-  scale(); // Repaint.
+  m_ui->bitmapView->setImage(m_image); // Repaint.
 }
 
-void BitmapResource::scale()
+void BitmapResource::updatePalette()
 {
-  if (!m_image) {
-    return;
-  }
+  toggleAlpha(m_ui->checkAlpha->isChecked());
+}
 
+void BitmapResource::scale()
+{
   if (m_ui->radioScale1->isChecked()) {
-    m_ui->imageLabel->setPixmap(QPixmap::fromImage(*m_image));
+    m_ui->bitmapView->setZoom(1);
   }
   else if (m_ui->radioScale2->isChecked()) {
-    m_ui->imageLabel->setPixmap(QPixmap::fromImage(m_image->scaled(m_image->width() * 2, m_image->height() * 2)));
+    m_ui->bitmapView->setZoom(2);
   }
   else if (m_ui->radioScale4->isChecked()) {
-    m_ui->imageLabel->setPixmap(QPixmap::fromImage(m_image->scaled(m_image->width() * 4, m_image->height() * 4)));
+    m_ui->bitmapView->setZoom(4);
   }
-
-  m_ui->imageLabel->adjustSize();
 }
 
 void BitmapResource::exportFile()
@@ -259,8 +269,7 @@ void BitmapResource::exportFile()
   fileInfo.setFile(
       fileInfo.absolutePath() +
       QDir::separator() +
-      QString("%1-%2").arg(QString(fileName()).replace('.', '_'), id()) +
-      ".png");
+      imageFileName());
   m_currentFilePath = fileInfo.absoluteFilePath();
 
   QString outFileName = QFileDialog::getSaveFileName(
@@ -274,7 +283,11 @@ void BitmapResource::exportFile()
     Settings().setFilePath(FILE_SETTINGS_PATH, m_currentFilePath = outFileName);
 
     QImageWriter writer(m_currentFilePath);
-    writer.setText("Comment", QString("Stunts bitmap \"%1\" (%2)").arg(id(), fileName()));
+
+    BitmapText text = headerText();
+    for (BitmapText::const_iterator i = text.constBegin(); i != text.constEnd(); ++i) {
+      writer.setText(i.key(), i.value());
+    }
 
     if (!writer.write(*m_image)) {
       QMessageBox::critical(
@@ -301,9 +314,6 @@ void BitmapResource::importFile()
   if (!inFileName.isEmpty()) {
     Settings().setFilePath(FILE_SETTINGS_PATH, m_currentFilePath = inFileName);
 
-    QImage* newImage = new QImage();
-    QImage* oldImage = m_image;
-
     QImageReader reader(m_currentFilePath);
 
     try {
@@ -312,64 +322,341 @@ void BitmapResource::importFile()
         throw tr("Source file exceeds max dimensions.");
       }
 
-      if (!reader.read(newImage)) {
+      QImage newImage;
+      if (!reader.read(&newImage)) {
         throw reader.errorString();
       }
 
-      // Qt will not upsample color space on images with less than 256 colors.
-      // We'll have to increase the color depth to 32 bits before downsampling
-      // in order to avoid palette corruption.
-      if (newImage->colorCount() && newImage->colorCount() < 256) {
-        QImage* tmpImage = newImage;
-        newImage =  new QImage(newImage->convertToFormat(QImage::Format_ARGB32));
-        delete tmpImage;
+      BitmapText text;
+      foreach (const QString& key, newImage.textKeys()) {
+        text.insert(key, newImage.text(key));
       }
 
-      delete oldImage;
-      oldImage = 0;
+      // Transparent pixels get their own index, which is then left out
+      // of the color matching.
+      BitmapQuantizer quantizer(Settings::m_loadedPalette, newImage.hasAlphaChannel() ? ALPHA_INDEX : -1);
+      setImage(quantizer.quantize(newImage, (BitmapQuantizer::Dither)m_ui->comboDither->currentIndex(), ALPHA_INDEX), text);
+    }
+    catch (QString msg) {
+      QMessageBox::critical(
+          this,
+          QCoreApplication::applicationName(),
+          tr("Error importing bitmap resource \"%1\" from image file \"%2\":\n%3").arg(id(), m_currentFilePath, msg));
+    }
+  }
+}
 
-      m_image = new QImage(newImage->convertToFormat(QImage::Format_Indexed8, Settings::m_loadedPalette));
+// Replaces the image after an import. Header fields found in the text chunks
+// override the defaults for new images.
+void BitmapResource::setImage(const QImage& image, const BitmapText& text)
+{
+  delete m_image;
+  m_image = new QImage(image);
+
+  m_ui->editWidth->setText(QString::number(m_image->width()));
+  m_ui->editHeight->setText(QString::number(m_image->height()));
+
+  m_ui->editUnk3->setText(QString("%1").arg(1, 2, 16, QChar('0')));
+  m_ui->editUnk4->setText(QString("%1").arg(2, 2, 16, QChar('0')));
+  m_ui->editUnk5->setText(QString("%1").arg(4, 2, 16, QChar('0')));
+  m_ui->editUnk6->setText(QString("%1").arg(8, 2, 16, QChar('0')));
+
+  QList<QLineEdit*> edits = headerEdits();
+  for (int i = 0; i < edits.size(); i++) {
+    QString key = QString("%1 %2").arg(TEXT_PREFIX, HEADER_KEYS[i]);
+    if (text.contains(key)) {
+      edits[i]->setText(text.value(key));
+    }
+  }
+
+  m_ui->buttonExport->setEnabled(true);
 
-      delete newImage;
-      newImage = 0;
+  toggleAlpha(m_ui->checkAlpha->isChecked()); // Repaint
+  isModified();
+}
 
-      // Quantize alpha channel to 1 bit and set affected transparent pixels
-      // to palette index 255.
-      if (m_image->hasAlphaChannel()) {
-        const QImage alphaChannel = m_image->convertToFormat(QImage::Format_Alpha8);
+QPoint BitmapResource::position() const
+{
+  return QPoint(m_ui->editX->text().toUShort(), m_ui->editY->text().toUShort());
+}
+
+void BitmapResource::replaceImage(const QImage& image)
+{
+  delete m_image;
+  m_image = new QImage(image);
+
+  m_ui->editWidth->setText(QString::number(m_image->width()));
+  m_ui->editHeight->setText(QString::number(m_image->height()));
+
+  m_ui->buttonExport->setEnabled(true);
 
-        for (int y = 0; y < m_image->height(); y++) {
-          for (int x = 0; x < m_image->width(); x++) {
-            if (alphaChannel.pixelIndex(x, y) < 0x80) {
-              m_image->setPixel(x, y, ALPHA_INDEX);
-            }
-          }
-        }
+  toggleAlpha(m_ui->checkAlpha->isChecked()); // Repaint
+  isModified();
+}
+
+// Header fields as text chunks, so that exported images import without loss.
+BitmapText BitmapResource::headerText() const
+{
+  BitmapText text;
+  text.insert("Comment", QString("Stunts bitmap \"%1\" (%2)").arg(id(), fileName()));
+
+  QList<QLineEdit*> edits = headerEdits();
+  for (int i = 0; i < edits.size(); i++) {
+    text.insert(QString("%1 %2").arg(TEXT_PREFIX, HEADER_KEYS[i]), edits[i]->text());
+  }
+
+  return text;
+}
+
+QList<QLineEdit*> BitmapResource::headerEdits() const
+{
+  return QList<QLineEdit*>()
+      << m_ui->editX << m_ui->editY
+      << m_ui->editUnk1 << m_ui->editUnk2 << m_ui->editUnk3 << m_ui->editUnk4 << m_ui->editUnk5 << m_ui->editUnk6;
+}
+
+QString BitmapResource::imageFileName() const
+{
+  return QString("%1-%2.png").arg(QString(fileName()).replace('.', '_'), id());
+}
+
+TaskBatch* BitmapResource::exportBitmaps(const QList<BitmapResource*>& bitmaps, const QString& dirPath, QObject* parent)
+{
+  TaskBatch* batch = new TaskBatch(parent);
+  QDir dir(dirPath);
+
+  foreach (BitmapResource* bitmap, bitmaps) {
+    if (!bitmap->m_image) {
+      continue;
+    }
+
+    batch->start(new BitmapExportTask(
+        *bitmap->m_image,
+        bitmap->headerText(),
+        bitmap->id(),
+        dir.absoluteFilePath(bitmap->imageFileName()),
+        batch->errors(),
+        batch->mutex()));
+  }
+
+  batch->close();
+
+  return batch;
+}
+
+// What the import tasks read and write, kept apart from the resources.
+struct BitmapResource::ImportState
+{
+  ImportState(const QList<BitmapResource*>& bitmaps)
+  : opaque(Settings::m_loadedPalette),
+    transparent(Settings::m_loadedPalette, ALPHA_INDEX),
+    images(bitmaps.size()),
+    texts(bitmaps.size())
+  {
+    foreach (BitmapResource* bitmap, bitmaps) {
+      resources.append(bitmap);
+      ids.append(bitmap->id());
+    }
+  }
+
+  BitmapQuantizer   opaque;
+  BitmapQuantizer   transparent;
+  QVector<QImage>   images;
+  QVector<BitmapText> texts;
+  QList<QPointer<BitmapResource> > resources;
+  QStringList       ids;
+};
+
+// Images are read and quantized on the batch, the resources are only updated
+// on its finished() on the calling thread, before any other receiver hears of
+// it. Bitmaps without a file in the directory are left alone, as are those
+// removed in the meantime.
+TaskBatch* BitmapResource::importBitmaps(const QList<BitmapResource*>& bitmaps, const QString& dirPath, QObject* parent)
+{
+  TaskBatch* batch = new TaskBatch(parent);
+  QDir dir(dirPath);
+
+  // Shared with the tasks until the batch and its connection are gone.
+  QSharedPointer<ImportState> state(new ImportState(bitmaps));
+
+  for (int i = 0; i < bitmaps.size(); i++) {
+    QString filePath = dir.absoluteFilePath(bitmaps[i]->imageFileName());
+    if (!QFile::exists(filePath)) {
+      continue;
+    }
+
+    batch->start(new BitmapImportTask(
+        filePath,
+        QSize(MAX_WIDTH, MAX_HEIGHT),
+        &state->opaque,
+        &state->transparent,
+        ALPHA_INDEX,
+        &state->images[i],
+        &state->texts[i],
+        bitmaps[i]->id(),
+        batch->errors(),
+        batch->mutex()));
+  }
+
+  connect(batch, &TaskBatch::finished, [batch, state]() {
+    for (int i = 0; i < state->images.size(); i++) {
+      if (state->images[i].isNull()) {
+        continue;
       }
 
-      m_ui->editWidth->setText(QString::number(m_image->width()));
-      m_ui->editHeight->setText(QString::number(m_image->height()));
+      if (state->resources[i]) {
+        state->resources[i]->setImage(state->images[i], state->texts[i]);
+      }
+      else {
+        batch->errors()->append(tr("%1: Bitmap was removed.").arg(state->ids[i]));
+      }
+    }
+  });
+
+  batch->close();
+
+  return batch;
+}
+
+// The active palette with the transparent index see-through, rebuilt once
+// per palette change.
+const QVector<QRgb>& BitmapResource::transparentPalette()
+{
+  if (m_opaquePalette != Settings::m_loadedPalette) {
+    m_opaquePalette = Settings::m_loadedPalette;
+    m_transparentPalette = m_opaquePalette;
+
+    QRgb color = m_transparentPalette.value(ALPHA_INDEX);
+    m_transparentPalette.resize(qMax(m_transparentPalette.size(), ALPHA_INDEX + 1));
+    m_transparentPalette[ALPHA_INDEX] = qRgba(qRed(color), qGreen(color), qBlue(color), 0);
+  }
+
+  return m_transparentPalette;
+}
+
+QString BitmapResource::atlasIndexPath(const QString& filePath)
+{
+  QFileInfo fileInfo(filePath);
+  return fileInfo.dir().absoluteFilePath(fileInfo.completeBaseName() + ".json");
+}
+
+// The index lists every bitmap with its rect on the sheet, left out for
+// empty bitmaps, and its header fields. The sheet background is the
+// transparent index.
+void BitmapResource::exportAtlas(const QList<BitmapResource*>& bitmaps, const QString& filePath)
+{
+  QList<QImage> images;
+  foreach (BitmapResource* bitmap, bitmaps) {
+    images.append(bitmap->m_image ? *bitmap->m_image : QImage());
+  }
+
+  QVector<QRect> rects;
+  QImage atlas = BitmapAtlas::pack(images, ALPHA_INDEX, rects);
+  atlas.setColorTable(Settings::m_loadedPalette);
+  if (atlas.colorCount() > ALPHA_INDEX) {
+    QRgb color = atlas.color(ALPHA_INDEX);
+    atlas.setColor(ALPHA_INDEX, qRgba(qRed(color), qGreen(color), qBlue(color), 0));
+  }
 
-      m_ui->editUnk3->setText(QString("%1").arg(1, 2, 16, QChar('0')));
-      m_ui->editUnk4->setText(QString("%1").arg(2, 2, 16, QChar('0')));
-      m_ui->editUnk5->setText(QString("%1").arg(4, 2, 16, QChar('0')));
-      m_ui->editUnk6->setText(QString("%1").arg(8, 2, 16, QChar('0')));
+  QJsonArray entries;
+  for (int i = 0; i < bitmaps.size(); i++) {
+    QJsonObject entry;
+    entry.insert("id", bitmaps[i]->id());
 
-      m_ui->buttonExport->setEnabled(true);
+    if (rects[i].isValid()) {
+      entry.insert("x", rects[i].x());
+      entry.insert("y", rects[i].y());
+      entry.insert("width", rects[i].width());
+      entry.insert("height", rects[i].height());
+    }
 
-      toggleAlpha(m_ui->checkAlpha->isChecked()); // Repaint
-      isModified();
+    QJsonObject header;
+    QList<QLineEdit*> edits = bitmaps[i]->headerEdits();
+    for (int j = 0; j < edits.size(); j++) {
+      header.insert(HEADER_KEYS[j], edits[j]->text());
     }
-    catch (QString msg) {
-      delete newImage;
-      newImage = 0;
+    entry.insert("header", header);
 
-      m_image = oldImage;
+    entries.append(entry);
+  }
 
-      QMessageBox::critical(
-          this,
-          QCoreApplication::applicationName(),
-          tr("Error importing bitmap resource \"%1\" from image file \"%2\":\n%3").arg(id(), m_currentFilePath, msg));
+  QJsonObject index;
+  index.insert("file", fileName());
+  index.insert("image", QFileInfo(filePath).fileName());
+  index.insert("bitmaps", entries);
+
+  QImageWriter writer(filePath);
+  if (!writer.write(atlas)) {
+    throw writer.errorString();
+  }
+
+  QFile file(atlasIndexPath(filePath));
+  if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate) || file.write(QJsonDocument(index).toJson()) < 0) {
+    throw tr("Couldn't write \"%1\": %2").arg(file.fileName(), file.errorString());
+  }
+}
+
+// The whole sheet is matched against the palette once, then cut up along
+// the rects of the index. Bitmaps missing from the index are left alone.
+QStringList BitmapResource::importAtlas(const QList<BitmapResource*>& bitmaps, const QString& filePath, int& imported)
+{
+  imported = 0;
+
+  QFile file(atlasIndexPath(filePath));
+  if (!file.open(QIODevice::ReadOnly)) {
+    throw tr("Couldn't read \"%1\": %2").arg(file.fileName(), file.errorString());
+  }
+
+  QJsonParseError parseError;
+  QJsonDocument index = QJsonDocument::fromJson(file.readAll(), &parseError);
+  if (index.isNull()) {
+    throw tr("Couldn't parse \"%1\": %2").arg(file.fileName(), parseError.errorString());
+  }
+
+  QImageReader reader(filePath);
+  QImage image;
+  if (!reader.read(&image)) {
+    throw reader.errorString();
+  }
+
+  BitmapQuantizer quantizer(Settings::m_loadedPalette, image.hasAlphaChannel() ? ALPHA_INDEX : -1);
+  QImage atlas = quantizer.quantize(image, BitmapQuantizer::DITHER_NONE, ALPHA_INDEX);
+
+  QMap<QString, BitmapResource*> bitmapsById;
+  foreach (BitmapResource* bitmap, bitmaps) {
+    bitmapsById.insert(bitmap->id(), bitmap);
+  }
+
+  QStringList errors;
+  foreach (const QJsonValue& value, index.object().value("bitmaps").toArray()) {
+    QJsonObject entry = value.toObject();
+    QString id = entry.value("id").toString();
+
+    BitmapResource* bitmap = bitmapsById.value(id);
+    if (!bitmap) {
+      errors.append(tr("%1: No such bitmap.").arg(id));
+      continue;
     }
+
+    if (!entry.contains("width")) {
+      continue;
+    }
+
+    QRect rect(entry.value("x").toInt(), entry.value("y").toInt(), entry.value("width").toInt(), entry.value("height").toInt());
+    if (rect.isEmpty() || !atlas.rect().contains(rect)) {
+      errors.append(tr("%1: Rectangle lies outside the atlas.").arg(id));
+      continue;
+    }
+
+    BitmapText text;
+    QJsonObject header = entry.value("header").toObject();
+    foreach (const QString& key, header.keys()) {
+      text.insert(QString("%1 %2").arg(TEXT_PREFIX, key), header.value(key).toString());
+    }
+
+    bitmap->setImage(BitmapAtlas::slice(atlas, rect), text);
+    imported++;
   }
+
+  return errors;
 }
@@ -1,6 +1,10 @@
 #pragma once
 
 #include "app/resource.h"
+#include "bitmapio.h"
+
+class QLineEdit;
+class TaskBatch;
 
 namespace Ui
 {
@@ -20,18 +24,40 @@ public:
   QString              type() const  { return "bitmap"; }
   Resource*            clone() const { return new BitmapResource(*this); }
 
+  const QImage*        image() const { return m_image; }
+  QPoint               position() const;
+  // Keeps the header apart from the size, e.g. for applying a delta.
+  void                 replaceImage(const QImage& image);
+
+  // Files are named like the single export, <file>-<id>.png.
+  // Both finish in the background, errors are on the batch.
+  static TaskBatch*    exportBitmaps(const QList<BitmapResource*>& bitmaps, const QString& dirPath, QObject* parent = 0);
+  static TaskBatch*    importBitmaps(const QList<BitmapResource*>& bitmaps, const QString& dirPath, QObject* parent = 0);
+  // One indexed PNG sheet for all bitmaps plus a JSON index next to it.
+  static void          exportAtlas(const QList<BitmapResource*>& bitmaps, const QString& filePath);
+  static QStringList   importAtlas(const QList<BitmapResource*>& bitmaps, const QString& filePath, int& imported);
+
 protected:
   void                 parse(QDataStream* in);
   void                 write(QDataStream* out) const;
 
 private slots:
   void                 toggleAlpha(bool alpha);
+  void                 updatePalette();
   void                 scale();
   void                 exportFile();
   void                 importFile();
 
 private:
+  struct ImportState;
+
   void                 setup();
+  void                 setImage(const QImage& image, const BitmapText& text);
+  BitmapText           headerText() const;
+  QList<QLineEdit*>    headerEdits() const;
+  QString              imageFileName() const;
+  static QString       atlasIndexPath(const QString& filePath);
+  static const QVector<QRgb>& transparentPalette();
 
   Ui::BitmapResource*   m_ui;
 
@@ -39,8 +65,12 @@ private:
 
   static QString       m_currentFilePath;
   static QString       m_currentFileFilter;
+  static QVector<QRgb> m_opaquePalette;
+  static QVector<QRgb> m_transparentPalette;
 
   static const char    FILE_SETTINGS_PATH[];
+  static const char    TEXT_PREFIX[];
+  static const char* const HEADER_KEYS[];
   static const char    FILE_FILTERS[];
 
   static const int     MAX_WIDTH   = 0xFFFF;
@@ -0,0 +1,111 @@
+#include <QMouseEvent>
+#include <QPainter>
+#include <QScrollBar>
+
+#include "bitmapview.h"
+
+BitmapView::BitmapView(QWidget* parent)
+: QAbstractScrollArea(parent),
+  m_image(0),
+  m_overlay(0),
+  m_zoom(1)
+{
+  setBackgroundRole(QPalette::Dark);
+  viewport()->setBackgroundRole(QPalette::Dark);
+  viewport()->setAutoFillBackground(true);
+}
+
+void BitmapView::setImage(const QImage* image)
+{
+  m_image = image;
+  updateScrollBars();
+  viewport()->update();
+}
+
+void BitmapView::setOverlay(const QImage* overlay)
+{
+  m_overlay = overlay;
+  viewport()->update();
+}
+
+void BitmapView::setZoom(int zoom)
+{
+  zoom = qMax(1, zoom);
+  if (zoom == m_zoom) {
+    return;
+  }
+
+  // Keep the center of the viewport in place.
+  QPointF center((horizontalScrollBar()->value() + viewport()->width() / 2.0) / m_zoom,
+                 (verticalScrollBar()->value() + viewport()->height() / 2.0) / m_zoom);
+
+  m_zoom = zoom;
+  updateScrollBars();
+
+  horizontalScrollBar()->setValue(qRound(center.x() * m_zoom - viewport()->width() / 2.0));
+  verticalScrollBar()->setValue(qRound(center.y() * m_zoom - viewport()->height() / 2.0));
+  viewport()->update();
+}
+
+// Maps the exposed viewport area back to image pixels and draws only those,
+// enlarged by the painter. Indexed images are converted by the paint engine
+// for the drawn part alone.
+void BitmapView::paintEvent(QPaintEvent* event)
+{
+  if (!m_image || m_image->isNull()) {
+    return;
+  }
+
+  QPoint offset(horizontalScrollBar()->value(), verticalScrollBar()->value());
+  QRect exposed = event->rect().translated(offset);
+
+  QRect source(exposed.left() / m_zoom, exposed.top() / m_zoom,
+               exposed.width() / m_zoom + 2, exposed.height() / m_zoom + 2);
+  source &= m_image->rect();
+
+  if (source.isEmpty()) {
+    return;
+  }
+
+  QRect target(source.left() * m_zoom, source.top() * m_zoom, source.width() * m_zoom, source.height() * m_zoom);
+
+  QPainter painter(viewport());
+  painter.setRenderHint(QPainter::SmoothPixmapTransform, false);
+  painter.drawImage(target.translated(-offset), *m_image, source);
+
+  if (m_overlay && m_overlay->size() == m_image->size()) {
+    painter.drawImage(target.translated(-offset), *m_overlay, source);
+  }
+}
+
+void BitmapView::resizeEvent(QResizeEvent* /*event*/)
+{
+  updateScrollBars();
+}
+
+void BitmapView::mousePressEvent(QMouseEvent* event)
+{
+  m_lastMousePosition = event->pos();
+}
+
+void BitmapView::mouseMoveEvent(QMouseEvent* event)
+{
+  QPoint delta = event->pos() - m_lastMousePosition;
+  m_lastMousePosition = event->pos();
+
+  horizontalScrollBar()->setValue(horizontalScrollBar()->value() - delta.x());
+  verticalScrollBar()->setValue(verticalScrollBar()->value() - delta.y());
+}
+
+void BitmapView::updateScrollBars()
+{
+  QSize size = m_image ? m_image->size() * m_zoom : QSize();
+
+  horizontalScrollBar()->setRange(0, qMax(0, size.width() - viewport()->width()));
+  horizontalScrollBar()->setPageStep(viewport()->width());
+  horizontalScrollBar()->setSingleStep(m_zoom * 8);
+
+  verticalScrollBar()->setRange(0, qMax(0, size.height() - viewport()->height()));
+  verticalScrollBar()->setPageStep(viewport()->height());
+  verticalScrollBar()->setSingleStep(m_zoom * 8);
+}
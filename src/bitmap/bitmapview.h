@@ -0,0 +1,38 @@
+#pragma once
+
+#include <QAbstractScrollArea>
+
+class QImage;
+
+// Shows an image at an integer zoom with nearest-neighbour scaling. Only the
+// part of the image inside the viewport is drawn, straight from the image,
+// so zooming or changing its color table only needs a repaint. Drag with
+// the mouse to pan.
+class BitmapView : public QAbstractScrollArea
+{
+  Q_OBJECT
+
+public:
+  BitmapView(QWidget* parent = 0);
+
+  // The image is not copied and must outlive the view or be reset.
+  void              setImage(const QImage* image);
+  // Drawn over the image, e.g. to mark pixels. Same size and lifetime rules.
+  void              setOverlay(const QImage* overlay);
+  void              setZoom(int zoom);
+  int               zoom() const { return m_zoom; }
+
+protected:
+  void              paintEvent(QPaintEvent* event);
+  void              resizeEvent(QResizeEvent* event);
+  void              mousePressEvent(QMouseEvent* event);
+  void              mouseMoveEvent(QMouseEvent* event);
+
+private:
+  void              updateScrollBars();
+
+  const QImage*     m_image;
+  const QImage*     m_overlay;
+  int               m_zoom;
+  QPoint            m_lastMousePosition;
+};
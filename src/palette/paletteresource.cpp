@@ -0,0 +1,121 @@
+#include <QPainter>
+
+#include "app/palettemanager.h"
+#include "paletteresource.h"
+
+#include "ui_paletteresource.h"
+
+// New palettes start as a copy of the active one.
+PaletteResource::PaletteResource(QString id, QWidget* parent, Qt::WindowFlags flags)
+: Resource(id, parent, flags),
+  m_ui(new Ui::PaletteResource),
+  m_palette(Settings::m_loadedPalette)
+{
+  setup();
+}
+
+PaletteResource::PaletteResource(const PaletteResource& res)
+: Resource(res.id(), qobject_cast<QWidget*>(res.parent()), res.windowFlags()),
+  m_ui(new Ui::PaletteResource),
+  m_palette(res.m_palette)
+{
+  setup();
+}
+
+PaletteResource::PaletteResource(QString id, unsigned int length, QDataStream* in, QWidget* parent, Qt::WindowFlags flags)
+: Resource(id, parent, flags),
+  m_ui(new Ui::PaletteResource)
+{
+  parse(in, length);
+
+  setup();
+}
+
+PaletteResource::~PaletteResource()
+{
+  delete m_ui;
+}
+
+void PaletteResource::setup()
+{
+  m_ui->setupUi(this);
+
+  connect(PaletteManager::instance(), SIGNAL(paletteChanged()), this, SLOT(updateActive()));
+
+  updateSwatches();
+  updateActive();
+}
+
+void PaletteResource::parse(QDataStream* in)
+{
+  parse(in, m_palette.size() * 3);
+}
+
+// 6-bit components are scaled to the full 8-bit range.
+void PaletteResource::parse(QDataStream* in, unsigned int length)
+{
+  if (length == 0 || length % 3 || length > 256 * 3) {
+    throw tr("Size of %1 bytes does not hold RGB triplets of up to 256 colors.").arg(length);
+  }
+
+  m_palette.clear();
+
+  for (unsigned int i = 0; i < length / 3; i++) {
+    quint8 red, green, blue;
+    *in >> red >> green >> blue;
+
+    if (red > DAC_MAX || green > DAC_MAX || blue > DAC_MAX) {
+      throw tr("Color %1 exceeds the 6-bit range.").arg(i);
+    }
+
+    m_palette.append(qRgb(red * 255 / DAC_MAX, green * 255 / DAC_MAX, blue * 255 / DAC_MAX));
+  }
+
+  checkError(in, tr("palette colors"));
+}
+
+void PaletteResource::write(QDataStream* out) const
+{
+  foreach (QRgb color, m_palette) {
+    *out << (quint8)((qRed(color) * DAC_MAX + 127) / 255);
+    *out << (quint8)((qGreen(color) * DAC_MAX + 127) / 255);
+    *out << (quint8)((qBlue(color) * DAC_MAX + 127) / 255);
+  }
+
+  checkError(out, tr("palette colors"), true);
+}
+
+void PaletteResource::activate()
+{
+  PaletteManager::instance()->setPalette(m_palette);
+}
+
+void PaletteResource::restoreDefault()
+{
+  PaletteManager::instance()->restoreDefault();
+}
+
+void PaletteResource::updateActive()
+{
+  bool active = (Settings::m_loadedPalette.mid(0, m_palette.size()) == m_palette);
+  m_ui->buttonActivate->setEnabled(!active);
+  m_ui->labelInfo->setText(tr("%n color(s)", 0, m_palette.size()) + (active ? tr(", active") : QString()));
+}
+
+void PaletteResource::updateSwatches()
+{
+  int rows = (m_palette.size() + SWATCH_COLUMNS - 1) / SWATCH_COLUMNS;
+  QPixmap swatches(SWATCH_COLUMNS * SWATCH_SIZE, qMax(1, rows) * SWATCH_SIZE);
+  swatches.fill(Qt::transparent);
+
+  QPainter painter(&swatches);
+  painter.setPen(palette().color(QPalette::Dark));
+  for (int i = 0; i < m_palette.size(); i++) {
+    QRect rect((i % SWATCH_COLUMNS) * SWATCH_SIZE, (i / SWATCH_COLUMNS) * SWATCH_SIZE, SWATCH_SIZE - 1, SWATCH_SIZE - 1);
+    painter.fillRect(rect, QColor(m_palette[i]));
+    painter.drawRect(rect);
+  }
+  painter.end();
+
+  m_ui->labelSwatches->setPixmap(swatches);
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include "app/resource.h"
+#include "app/settings.h"
+
+namespace Ui
+{
+  class PaletteResource;
+}
+
+// VGA palette as stored by the game, RGB triplets of 6-bit DAC values. Any
+// palette of a file can be made the active one for bitmaps and shapes.
+class PaletteResource : public Resource
+{
+  Q_OBJECT
+
+public:
+  PaletteResource(QString id, QWidget* parent = 0, Qt::WindowFlags flags = Qt::WindowFlags());
+  PaletteResource(const PaletteResource& res);
+  PaletteResource(QString id, unsigned int length, QDataStream* in, QWidget* parent = 0, Qt::WindowFlags flags = Qt::WindowFlags());
+  ~PaletteResource();
+
+  QString           type() const  { return "palette"; }
+  Resource*         clone() const { return new PaletteResource(*this); }
+
+  const Palette&    colors() const { return m_palette; }
+
+public slots:
+  void              activate();
+
+protected:
+  void              parse(QDataStream* in);
+  void              write(QDataStream* out) const;
+
+private slots:
+  void              restoreDefault();
+  void              updateActive();
+
+private:
+  void              setup();
+  void              parse(QDataStream* in, unsigned int length);
+  void              updateSwatches();
+
+  Ui::PaletteResource* m_ui;
+
+  Palette           m_palette;
+
+  static const int  SWATCH_SIZE = 16;
+  static const int  SWATCH_COLUMNS = 16;
+  static const int  DAC_MAX = 63;
+};
@@ -0,0 +1,277 @@
+#include <QKeyEvent>
+#include <QPainter>
+#include <QScrollBar>
+
+#include "hexview.h"
+
+HexView::HexView(QWidget* parent)
+: QAbstractScrollArea(parent),
+  m_data(0),
+  m_cursor(0),
+  m_lowNibble(false),
+  m_textColumn(false),
+  m_selectionStart(0),
+  m_selectionLength(0)
+{
+  QFont font("Monospace, Courier");
+  font.setStyleHint(QFont::TypeWriter);
+  setFont(font);
+
+  QFontMetrics metrics(font);
+  m_charWidth = metrics.horizontalAdvance('0');
+  m_lineHeight = metrics.height();
+
+  setFocusPolicy(Qt::StrongFocus);
+  viewport()->setCursor(Qt::IBeamCursor);
+}
+
+void HexView::setData(QByteArray* data)
+{
+  m_data = data;
+  m_cursor = 0;
+  m_lowNibble = false;
+  m_selectionLength = 0;
+
+  updateScrollBars();
+  verticalScrollBar()->setValue(0);
+  viewport()->update();
+}
+
+bool HexView::find(const QByteArray& needle)
+{
+  if (!m_data || needle.isEmpty()) {
+    return false;
+  }
+
+  int position = m_data->indexOf(needle, m_cursor + 1);
+  if (position < 0) {
+    position = m_data->indexOf(needle);
+  }
+
+  if (position < 0) {
+    return false;
+  }
+
+  setCursor(position);
+  m_selectionStart = position;
+  m_selectionLength = needle.size();
+  viewport()->update();
+
+  return true;
+}
+
+// Columns, in characters: offset, hex bytes of three characters each and
+// the bytes as text.
+void HexView::paintEvent(QPaintEvent* /*event*/)
+{
+  if (!m_data) {
+    return;
+  }
+
+  QPainter painter(viewport());
+  painter.setFont(font());
+
+  const uchar* data = (const uchar*)m_data->constData();
+  int size = m_data->size();
+  int hexStart = (OFFSET_CHARS + 2) * m_charWidth - horizontalScrollBar()->value();
+  int textStart = hexStart + (BYTES_PER_ROW * 3 + 1) * m_charWidth;
+
+  QColor offsetColor = palette().color(QPalette::Disabled, QPalette::Text);
+  QColor textColor = palette().color(QPalette::Text);
+  QColor highlightColor = palette().color(QPalette::Highlight);
+  QColor highlightedTextColor = palette().color(QPalette::HighlightedText);
+
+  int row = verticalScrollBar()->value();
+  for (int y = 0; y < viewport()->height() && row * BYTES_PER_ROW < size; y += m_lineHeight, row++) {
+    painter.setPen(offsetColor);
+    painter.drawText(QRect(-horizontalScrollBar()->value(), y, OFFSET_CHARS * m_charWidth, m_lineHeight), Qt::AlignVCenter,
+        QString("%1").arg(row * BYTES_PER_ROW, OFFSET_CHARS, 16, QChar('0')).toUpper());
+
+    for (int column = 0; column < BYTES_PER_ROW; column++) {
+      int position = row * BYTES_PER_ROW + column;
+      if (position >= size) {
+        break;
+      }
+
+      QRect hexRect(hexStart + column * 3 * m_charWidth, y, 2 * m_charWidth, m_lineHeight);
+      QRect textRect(textStart + column * m_charWidth, y, m_charWidth, m_lineHeight);
+
+      bool selected = position >= m_selectionStart && position < m_selectionStart + m_selectionLength;
+      if (selected) {
+        painter.fillRect(hexRect, highlightColor);
+        painter.fillRect(textRect, highlightColor);
+      }
+
+      if (position == m_cursor) {
+        QRect active = m_textColumn ? textRect : QRect(hexRect.left() + (m_lowNibble ? m_charWidth : 0), y, m_charWidth, m_lineHeight);
+        QRect inactive = m_textColumn ? hexRect : textRect;
+
+        painter.fillRect(active, hasFocus() ? highlightColor : offsetColor);
+        painter.setPen(highlightColor);
+        painter.drawRect(inactive.adjusted(0, 0, -1, -1));
+      }
+
+      uchar byte = data[position];
+      QChar character = (byte >= 0x20 && byte < 0x7F) ? QChar(byte) : QChar('.');
+
+      painter.setPen(selected ? highlightedTextColor : textColor);
+      painter.drawText(hexRect, Qt::AlignVCenter, QString("%1").arg(byte, 2, 16, QChar('0')).toUpper());
+      painter.drawText(textRect, Qt::AlignVCenter, character);
+    }
+  }
+}
+
+void HexView::resizeEvent(QResizeEvent* /*event*/)
+{
+  updateScrollBars();
+}
+
+void HexView::keyPressEvent(QKeyEvent* event)
+{
+  if (!m_data || m_data->isEmpty()) {
+    QAbstractScrollArea::keyPressEvent(event);
+    return;
+  }
+
+  bool control = event->modifiers() & Qt::ControlModifier;
+  int page = visibleRows() * BYTES_PER_ROW;
+
+  switch (event->key()) {
+    case Qt::Key_Left:     setCursor(m_cursor - 1); return;
+    case Qt::Key_Right:    setCursor(m_cursor + 1); return;
+    case Qt::Key_Up:       setCursor(m_cursor - BYTES_PER_ROW); return;
+    case Qt::Key_Down:     setCursor(m_cursor + BYTES_PER_ROW); return;
+    case Qt::Key_PageUp:   setCursor(m_cursor - page); return;
+    case Qt::Key_PageDown: setCursor(m_cursor + page); return;
+    case Qt::Key_Home:     setCursor(control ? 0 : m_cursor - m_cursor % BYTES_PER_ROW); return;
+    case Qt::Key_End:      setCursor(control ? m_data->size() - 1 : m_cursor - m_cursor % BYTES_PER_ROW + BYTES_PER_ROW - 1); return;
+    case Qt::Key_Tab:
+    case Qt::Key_Backtab:
+      m_textColumn = !m_textColumn;
+      setCursor(m_cursor);
+      return;
+  }
+
+  QString text = event->text();
+  if (text.size() != 1 || control) {
+    QAbstractScrollArea::keyPressEvent(event);
+    return;
+  }
+
+  uchar* byte = (uchar*)m_data->data() + m_cursor;
+
+  if (m_textColumn) {
+    ushort character = text[0].unicode();
+    if (character < 0x20 || character >= 0x7F) {
+      QAbstractScrollArea::keyPressEvent(event);
+      return;
+    }
+
+    *byte = character;
+    setCursor(m_cursor + 1);
+  }
+  else {
+    bool ok;
+    int nibble = text.toInt(&ok, 16);
+    if (!ok) {
+      QAbstractScrollArea::keyPressEvent(event);
+      return;
+    }
+
+    if (m_lowNibble) {
+      *byte = (*byte & 0xF0) | nibble;
+      setCursor(m_cursor + 1);
+    }
+    else {
+      *byte = (nibble << 4) | (*byte & 0x0F);
+      setCursor(m_cursor, true);
+    }
+  }
+
+  emit dataChanged();
+}
+
+void HexView::mousePressEvent(QMouseEvent* event)
+{
+  bool text;
+  int position = positionAt(event->pos(), &text);
+
+  if (position >= 0) {
+    m_textColumn = text;
+    setCursor(position);
+  }
+}
+
+// Tab switches columns instead of moving the focus.
+bool HexView::focusNextPrevChild(bool /*next*/)
+{
+  return false;
+}
+
+void HexView::updateScrollBars()
+{
+  int rows = m_data ? (m_data->size() + BYTES_PER_ROW - 1) / BYTES_PER_ROW : 0;
+  int width = (OFFSET_CHARS + 2 + BYTES_PER_ROW * 4 + 1) * m_charWidth;
+
+  verticalScrollBar()->setRange(0, qMax(0, rows - visibleRows()));
+  verticalScrollBar()->setPageStep(visibleRows());
+  verticalScrollBar()->setSingleStep(1);
+
+  horizontalScrollBar()->setRange(0, qMax(0, width - viewport()->width()));
+  horizontalScrollBar()->setPageStep(viewport()->width());
+  horizontalScrollBar()->setSingleStep(m_charWidth);
+}
+
+void HexView::setCursor(int position, bool lowNibble)
+{
+  m_cursor = qBound(0, position, m_data ? m_data->size() - 1 : 0);
+  m_lowNibble = lowNibble && !m_textColumn;
+  m_selectionLength = 0;
+
+  ensureCursorVisible();
+  viewport()->update();
+}
+
+void HexView::ensureCursorVisible()
+{
+  int row = m_cursor / BYTES_PER_ROW;
+  int first = verticalScrollBar()->value();
+
+  if (row < first) {
+    verticalScrollBar()->setValue(row);
+  }
+  else if (row >= first + visibleRows()) {
+    verticalScrollBar()->setValue(row - visibleRows() + 1);
+  }
+}
+
+int HexView::positionAt(const QPoint& point, bool* text) const
+{
+  if (!m_data) {
+    return -1;
+  }
+
+  int x = (point.x() + horizontalScrollBar()->value()) / m_charWidth - (OFFSET_CHARS + 2);
+  int row = verticalScrollBar()->value() + point.y() / m_lineHeight;
+
+  int column;
+  if (x >= 0 && x < BYTES_PER_ROW * 3) {
+    column = x / 3;
+    *text = false;
+  }
+  else if (x > BYTES_PER_ROW * 3 && x <= BYTES_PER_ROW * 4) {
+    column = x - BYTES_PER_ROW * 3 - 1;
+    *text = true;
+  }
+  else {
+    return -1;
+  }
+
+  int position = row * BYTES_PER_ROW + column;
+  return position < m_data->size() ? position : -1;
+}
+
+int HexView::visibleRows() const
+{
+  return qMax(1, viewport()->height() / m_lineHeight);
+}
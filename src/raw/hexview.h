@@ -0,0 +1,53 @@
+#pragma once
+
+#include <QAbstractScrollArea>
+
+class QByteArray;
+
+// Hex editor over a byte array of fixed size. Only the rows inside the
+// viewport are painted, so the size of the data does not matter. Typing
+// overwrites, hex digits in the hex column and characters in the text
+// column; Tab switches between the two.
+class HexView : public QAbstractScrollArea
+{
+  Q_OBJECT
+
+public:
+  HexView(QWidget* parent = 0);
+
+  // The data is not copied and must outlive the view or be reset.
+  void              setData(QByteArray* data);
+
+  // Searches from after the cursor and wraps around. Selects the match.
+  bool              find(const QByteArray& needle);
+
+signals:
+  void              dataChanged();
+
+protected:
+  void              paintEvent(QPaintEvent* event);
+  void              resizeEvent(QResizeEvent* event);
+  void              keyPressEvent(QKeyEvent* event);
+  void              mousePressEvent(QMouseEvent* event);
+  bool              focusNextPrevChild(bool next);
+
+private:
+  void              updateScrollBars();
+  void              setCursor(int position, bool lowNibble = false);
+  void              ensureCursorVisible();
+  int               positionAt(const QPoint& point, bool* text) const;
+  int               visibleRows() const;
+
+  QByteArray*       m_data;
+  int               m_cursor;
+  bool              m_lowNibble;
+  bool              m_textColumn;
+  int               m_selectionStart;
+  int               m_selectionLength;
+
+  int               m_charWidth;
+  int               m_lineHeight;
+
+  static const int  BYTES_PER_ROW = 16;
+  static const int  OFFSET_CHARS = 8;
+};
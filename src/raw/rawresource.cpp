@@ -1,6 +1,7 @@
+#include <QApplication>
 #include <QFileDialog>
-#include <QLineEdit>
 #include <QMessageBox>
+#include <QRegExp>
 
 #include "app/settings.h"
 #include "rawresource.h"
@@ -19,30 +20,24 @@ RawResource::RawResource(QString id, QString type, unsigned int length, QWidget*
 : Resource(id, parent, flags),
   m_ui(new Ui::RawResource),
   m_type(type),
-  m_length(length)
+  m_length(length),
+  m_data(length, '\0')
 {
   m_ui->setupUi(this);
 
   setup();
-
-  for (unsigned int i = 0; i < m_length; ++i) {
-     m_lineEdits[i]->setText("00");
-  }
 }
 
 RawResource::RawResource(const RawResource& res)
 : Resource(res.id(), qobject_cast<QWidget*>(res.parent()), res.windowFlags()),
   m_ui(new Ui::RawResource),
   m_type(res.m_type),
-  m_length(res.m_length)
+  m_length(res.m_length),
+  m_data(res.m_data)
 {
   m_ui->setupUi(this);
 
   setup();
-
-  for (unsigned int i = 0; i < m_length; ++i) {
-    m_lineEdits[i]->setText(res.m_lineEdits[i]->text());
-  }
 }
 
 RawResource::RawResource(QString id, QString type, unsigned int length, QDataStream* in, QWidget* parent, Qt::WindowFlags flags)
@@ -65,23 +60,21 @@ RawResource::~RawResource()
 
 void RawResource::parse(QDataStream* in)
 {
-  quint8 val;
+  m_data.resize(m_length);
 
-  for (unsigned int i = 0; i < m_length; ++i) {
-    *in >> val;
-    m_lineEdits[i]->setText(QString("%1").arg(val, 2, 16, QLatin1Char('0')).toUpper());
+  if (in->readRawData(m_data.data(), m_length) != (int)m_length) {
+    throw tr("Couldn't read raw data.");
   }
 
   checkError(in, tr("unknown raw data"));
+
+  m_ui->hexView->setData(&m_data);
 }
 
 void RawResource::write(QDataStream* out) const
 {
-  quint8 val;
-
-  for (unsigned int i = 0; i < m_length; ++i) {
-    val = m_lineEdits[i]->text().toUShort(0, 16);
-    *out << val;
+  if (out->writeRawData(m_data.constData(), m_length) != (int)m_length) {
+    throw tr("Couldn't write raw data.");
   }
 
   checkError(out, tr("unknown raw data"), true);
@@ -89,45 +82,28 @@ void RawResource::write(QDataStream* out) const
 
 void RawResource::setup()
 {
-  const QFont* font = &m_ui->labelCol0->font();
-
-  m_lineEdits = new QLineEdit*[m_length];
-  for (unsigned int i = 0; i < m_length; ++i) {
-    // Row label.
-    if (!(i % 16)) {
-      QLabel* lbl = new QLabel(QString("%1").arg(i / 16, 3, 16, QLatin1Char('0')).toUpper().append('0'), this);
-      lbl->setFont(*font);
-      m_ui->gridLayout->addWidget(lbl, 1 + (i / 16), 0, 1, 1);
-    }
-
-    QLineEdit* le = new QLineEdit(this);
-    le->setAlignment(Qt::AlignCenter);
-    le->setFont(*font);
-    le->setInputMask("HH;");
-    le->setMaximumSize(QSize(25, 0xFFFFFF));
+  m_ui->hexView->setData(&m_data);
 
-    m_ui->gridLayout->addWidget(le, 1 + (i / 16), 1 + (i % 16), 1, 1);
-    m_lineEdits[i] = le;
-
-    connect(le, SIGNAL(textChanged(QString)), this, SLOT(isModified()));
-  }
+  connect(m_ui->hexView, SIGNAL(dataChanged()), this, SLOT(isModified()));
 }
 
-void RawResource::cleanup()
+// Hex pairs, if the text is nothing else, otherwise the text itself.
+void RawResource::find()
 {
-  for (unsigned int i = 0; i < m_length; ++i) {
-    delete m_lineEdits[i];
-
-    // Row label.
-    if (!(i % 16)) {
-      QLayoutItem* lbl = m_ui->gridLayout->itemAtPosition(1 + (i / 16), 0);
-      if (lbl) {
-        delete lbl->widget();
-      }
-    }
+  QString text = m_ui->editFind->text();
+  QString digits = QString(text).remove(' ');
+
+  QByteArray needle;
+  if (!digits.isEmpty() && !(digits.size() % 2) && QRegExp("[0-9A-Fa-f]*").exactMatch(digits)) {
+    needle = QByteArray::fromHex(digits.toLatin1());
+  }
+  else {
+    needle = text.toLatin1();
   }
 
-  delete[] m_lineEdits;
+  if (!m_ui->hexView->find(needle)) {
+    QApplication::beep();
+  }
 }
 
 void RawResource::exportFile()
@@ -204,16 +180,27 @@ void RawResource::importFile()
 
    }
 
-   // Find length and re-setup widget.
-   cleanup();
+   // Take over the length of the file, the old data stays on failure.
+   unsigned int length = m_length;
+   QByteArray data = m_data;
    m_length = file.size();
-   setup();
 
    QDataStream in(&file);
    in.setByteOrder(QDataStream::LittleEndian);
 
-   parse(&in);
+   try {
+     parse(&in);
+   }
+   catch (QString msg) {
+     m_length = length;
+     m_data = data;
+     m_ui->hexView->setData(&m_data);
+
+     QMessageBox::critical(this, QCoreApplication::applicationName(), msg);
+     return;
+   }
 
    file.close();
+   isModified();
  }
 }
@@ -7,8 +7,6 @@ namespace Ui
   class RawResource;
 }
 
-class QLineEdit;
-
 class RawResource : public Resource
 {
   Q_OBJECT
@@ -32,17 +30,16 @@ protected:
 private slots:
   void              exportFile();
   void              importFile();
+  void              find();
 
 private:
   void              setup();
-  void              cleanup();
 
   Ui::RawResource*   m_ui;
 
   QString           m_type;
   unsigned int      m_length;
-  quint8*           m_data;
-  QLineEdit**       m_lineEdits;
+  QByteArray        m_data;
 
   static QString    m_currentFilePath;
 
@@ -0,0 +1,45 @@
+#pragma once
+
+// Unit circle points computed at compile time. Point i lies at the angle
+// 2 * pi * (i + 1) / N, the order the game draws wheels and spheres in.
+template <int N>
+class CircleTable
+{
+public:
+  constexpr CircleTable()
+  : m_cos(),
+    m_sin()
+  {
+    for (int i = 0; i < N; i++) {
+      m_cos[i] = (float)sine(TAU * (i + 1) / N + TAU / 4);
+      m_sin[i] = (float)sine(TAU * (i + 1) / N);
+    }
+  }
+
+  constexpr float   cos(int i) const { return m_cos[i]; }
+  constexpr float   sin(int i) const { return m_sin[i]; }
+
+  static const int  STEPS = N;
+
+private:
+  // Taylor series after reducing to [-pi, pi], exact to float precision.
+  static constexpr double sine(double x)
+  {
+    while (x > TAU / 2) {
+      x -= TAU;
+    }
+
+    double term = x, sum = x;
+    for (int n = 1; n < 12; n++) {
+      term *= -x * x / ((2 * n) * (2 * n + 1));
+      sum += term;
+    }
+
+    return sum;
+  }
+
+  float             m_cos[N];
+  float             m_sin[N];
+
+  static constexpr double TAU = 6.283185307179586476925286766559;
+};
@@ -1,6 +1,8 @@
+#include <QAbstractItemView>
 #include <QBitmap>
 #include <QComboBox>
 
+#include "app/palettemanager.h"
 #include "app/settings.h"
 #include "materialdelegate.h"
 
@@ -14,6 +16,8 @@ MaterialDelegate::MaterialDelegate(QObject *parent)
   if (!m_initialized) {
     setup();
   }
+
+  connect(PaletteManager::instance(), SIGNAL(paletteChanged()), this, SLOT(updatePalette()));
 }
 
 QWidget* MaterialDelegate::createEditor(QWidget* parent, const QStyleOptionViewItem& /*option*/, const QModelIndex& /*index*/) const
@@ -58,12 +62,24 @@ QComboBox* MaterialDelegate::createComboBox(QWidget* parent)
 
   for (unsigned int i = 0; i < NUM_MATERIALS; i++) {
     materialComboBox->insertItem(i, tr("%1").arg(i));
-    materialComboBox->setItemData(i, m_icons[i], Qt::DecorationRole);
+    materialComboBox->setItemData(i, getIcon(i), Qt::DecorationRole);
   }
 
   return materialComboBox;
 }
 
+// The shared icons are rebuilt on their next use, every delegate repaints
+// its own view.
+void MaterialDelegate::updatePalette()
+{
+  m_icons.clear();
+  m_initialized = false;
+
+  if (QAbstractItemView* view = qobject_cast<QAbstractItemView*>(parent())) {
+    view->viewport()->update();
+  }
+}
+
 void MaterialDelegate::setup()
 {
   for (unsigned int i = 0; i < NUM_MATERIALS; i++) {
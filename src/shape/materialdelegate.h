@@ -21,6 +21,9 @@ public:
   static QComboBox*     createComboBox(QWidget* parent);
   static const QPixmap& getIcon(unsigned int index);
 
+private slots:
+  void                  updatePalette();
+
 private:
   static void           setup();
 
@@ -164,6 +164,17 @@ void MaterialsModel::resize(int num)
   }
 }
 
+// Same number of paint jobs only.
+void MaterialsModel::setMaterials(const MaterialsList& materials)
+{
+  if (materials.size() != rowCount() || materials == m_materials) {
+    return;
+  }
+
+  m_materials = materials;
+  emit dataChanged(index(0, 0), index(rowCount() - 1, 0));
+}
+
 void MaterialsModel::setup()
 {
   connect(this, SIGNAL(dataChanged(QModelIndex,QModelIndex)),
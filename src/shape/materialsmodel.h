@@ -27,6 +27,7 @@ public:
   int               columnCount(const QModelIndex& /*parent*/ = QModelIndex()) const { return 1; }
 
   void              resize(int num);
+  void              setMaterials(const MaterialsList& materials);
   MaterialsList*    materialsList()                                                  { return &m_materials; }
 
   static const int  VAL_MIN = 0;
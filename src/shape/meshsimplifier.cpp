@@ -0,0 +1,786 @@
+#include <QHash>
+#include <algorithm>
+#include <limits>
+#include <math.h>
+
+#include "meshsimplifier.h"
+#include "shapemodel.h"
+
+const int    MeshSimplifier::POLYGON_MAX;
+
+const double MeshSimplifier::BOUNDARY_WEIGHT = 100.0;
+const double MeshSimplifier::FLIP_LIMIT      = 0.2;
+const double MeshSimplifier::PLANAR_LIMIT    = 0.999;
+
+MeshSimplifier::MeshSimplifier(const Mesh& mesh)
+: m_numInputVertices(0),
+  m_numInputFaces(0),
+  m_liveVertices(0),
+  m_liveTriangles(0),
+  m_prepared(false),
+  m_oversized(false),
+  m_deviation(0.0)
+{
+  // Weld vertices that end up at the same position on the 16-bit grid.
+  QHash<quint64, int> welded;
+  QVector<int> remap(mesh.positions.size());
+
+  for (int i = 0; i < mesh.positions.size(); i++) {
+    const QVector3D& position = mesh.positions[i];
+    qint16 x = qBound(-32768, qRound(position.x()), 32767);
+    qint16 y = qBound(-32768, qRound(position.y()), 32767);
+    qint16 z = qBound(-32768, qRound(position.z()), 32767);
+    quint64 key = ((quint64)(quint16)x << 32) | ((quint64)(quint16)y << 16) | (quint16)z;
+
+    QHash<quint64, int>::const_iterator it = welded.constFind(key);
+    if (it == welded.constEnd()) {
+      Vec3 v = { (double)x, (double)y, (double)z };
+      remap[i] = m_positions.size();
+      welded.insert(key, remap[i]);
+      m_positions.push_back(v);
+    }
+    else {
+      remap[i] = it.value();
+    }
+  }
+
+  m_refs.assign(m_positions.size(), 0);
+  m_locked.assign(m_positions.size(), false);
+
+  // Faces only merge with faces of the same look.
+  QList<QPair<MaterialsList, int> > groups;
+
+  foreach (MeshFace face, mesh.faces) {
+    bool polygon = (face.type == 0) || (face.type > PRIM_TYPE_LINE && face.type < PRIM_TYPE_SPHERE);
+
+    QPair<MaterialsList, int> look(face.materials, (face.twoSided ? PRIM_FLAG_TWOSIDED : 0) | (face.zBias ? PRIM_FLAG_ZBIAS : 0));
+    int group = groups.indexOf(look);
+    if (group < 0) {
+      group = groups.size();
+      groups.append(look);
+    }
+
+    if (polygon) {
+      // Drop consecutive vertices merged by welding.
+      QVector<int> loop;
+      foreach (int index, face.indices) {
+        int v = remap[index];
+        if (loop.isEmpty() || loop.last() != v) {
+          loop.append(v);
+        }
+      }
+      if (loop.size() > 1 && loop.first() == loop.last()) {
+        loop.removeLast();
+      }
+
+      if (loop.size() < 3) {
+        continue;
+      }
+
+      if (loop.size() > POLYGON_MAX) {
+        m_oversized = true;
+        face.type = 0;
+      }
+      else {
+        face.type = loop.size();
+      }
+      face.indices = loop;
+
+      // Fan triangulation, the merge pass restores polygons afterwards.
+      for (int i = 1; i < loop.size() - 1; i++) {
+        Triangle triangle;
+        triangle.v[0] = loop[0];
+        triangle.v[1] = loop[i];
+        triangle.v[2] = loop[i + 1];
+        triangle.face = m_faces.size();
+        triangle.area = 0.0;
+        triangle.alive = true;
+        m_triangles.push_back(triangle);
+
+        for (int k = 0; k < 3; k++) {
+          m_refs[triangle.v[k]]++;
+        }
+      }
+    }
+    else {
+      for (int i = 0; i < face.indices.size(); i++) {
+        face.indices[i] = remap[face.indices[i]];
+        m_refs[face.indices[i]]++;
+        m_locked[face.indices[i]] = true;
+      }
+
+      m_passThrough.append(m_faces.size());
+    }
+
+    m_faces.append(face);
+    m_groups.push_back(group);
+    m_numInputFaces++;
+  }
+
+  for (size_t i = 0; i < m_refs.size(); i++) {
+    if (m_refs[i]) {
+      m_liveVertices++;
+    }
+  }
+
+  m_liveTriangles = m_triangles.size();
+  m_numInputVertices = m_liveVertices;
+
+  // Kept to measure how far the simplified surface strays from the input.
+  m_original = m_positions;
+  std::vector<bool> onSurface(m_positions.size(), false);
+  for (const Triangle& triangle : m_triangles) {
+    for (int k = 0; k < 3; k++) {
+      onSurface[triangle.v[k]] = true;
+    }
+  }
+  for (size_t i = 0; i < onSurface.size(); i++) {
+    if (onSurface[i]) {
+      m_surface.push_back(i);
+    }
+  }
+}
+
+bool MeshSimplifier::fits(int maxVertices, int maxFaces) const
+{
+  return !m_oversized && m_numInputVertices <= maxVertices && m_numInputFaces <= maxFaces;
+}
+
+bool MeshSimplifier::simplify(int maxVertices, int maxFaces)
+{
+  if (!m_prepared) {
+    prepare();
+  }
+
+  int maxPolygons = maxFaces - m_passThrough.size();
+  int maxTriangles = std::numeric_limits<int>::max();
+
+  if (maxPolygons < 0) {
+    return false;
+  }
+
+  for (;;) {
+    while ((m_liveVertices > maxVertices || m_liveTriangles > maxTriangles) && !m_heap.empty()) {
+      Collapse collapse = m_heap.top();
+      m_heap.pop();
+
+      if (isValid(collapse)) {
+        apply(collapse);
+      }
+    }
+
+    // Ran out of legal collapses.
+    if (m_liveVertices > maxVertices || m_liveTriangles > maxTriangles) {
+      return false;
+    }
+
+    merge();
+
+    if (m_polygons.size() <= maxPolygons) {
+      measure();
+      return true;
+    }
+
+    // Merging could not fold enough triangles into polygons, remove at least
+    // as many triangles as there are polygons in excess and retry.
+    maxTriangles = m_liveTriangles - qMax(1, m_polygons.size() - maxPolygons);
+  }
+}
+
+// Only valid after a successful simplify().
+Mesh MeshSimplifier::result() const
+{
+  Mesh mesh;
+  QVector<int> remap(m_positions.size(), -1);
+  QList<QPair<int, MeshFace> > ordered;
+
+  foreach (const Polygon& polygon, m_polygons) {
+    MeshFace face = m_faces[polygon.face];
+    face.type = polygon.indices.size();
+    face.indices = polygon.indices;
+    face.hasCull = false;
+    ordered.append(qMakePair(polygon.face, face));
+  }
+
+  foreach (int i, m_passThrough) {
+    ordered.append(qMakePair(i, m_faces[i]));
+  }
+
+  // Keep the primitive order of the source, the game draws in that order.
+  std::stable_sort(ordered.begin(), ordered.end(),
+      [](const QPair<int, MeshFace>& lhv, const QPair<int, MeshFace>& rhv) { return lhv.first < rhv.first; });
+
+  for (int i = 0; i < ordered.size(); i++) {
+    MeshFace face = ordered[i].second;
+
+    for (int j = 0; j < face.indices.size(); j++) {
+      int v = face.indices[j];
+
+      if (remap[v] < 0) {
+        remap[v] = mesh.positions.size();
+        mesh.positions.append(QVector3D(
+            qBound(-32768, (int)floor(m_positions[v].x + 0.5), 32767),
+            qBound(-32768, (int)floor(m_positions[v].y + 0.5), 32767),
+            qBound(-32768, (int)floor(m_positions[v].z + 0.5), 32767)));
+      }
+
+      face.indices[j] = remap[v];
+    }
+
+    mesh.faces.append(face);
+  }
+
+  return mesh;
+}
+
+MeshSimplifier::Vec3 MeshSimplifier::sub(const Vec3& lhv, const Vec3& rhv)
+{
+  Vec3 res = { lhv.x - rhv.x, lhv.y - rhv.y, lhv.z - rhv.z };
+  return res;
+}
+
+MeshSimplifier::Vec3 MeshSimplifier::cross(const Vec3& lhv, const Vec3& rhv)
+{
+  Vec3 res = {
+    lhv.y * rhv.z - lhv.z * rhv.y,
+    lhv.z * rhv.x - lhv.x * rhv.z,
+    lhv.x * rhv.y - lhv.y * rhv.x
+  };
+  return res;
+}
+
+double MeshSimplifier::dot(const Vec3& lhv, const Vec3& rhv)
+{
+  return lhv.x * rhv.x + lhv.y * rhv.y + lhv.z * rhv.z;
+}
+
+double MeshSimplifier::evaluate(const Quadric& quadric, const Vec3& v)
+{
+  const double* q = quadric.q;
+  return q[0] * v.x * v.x + 2.0 * q[1] * v.x * v.y + 2.0 * q[2] * v.x * v.z + 2.0 * q[3] * v.x
+       + q[4] * v.y * v.y + 2.0 * q[5] * v.y * v.z + 2.0 * q[6] * v.y
+       + q[7] * v.z * v.z + 2.0 * q[8] * v.z
+       + q[9];
+}
+
+void MeshSimplifier::prepare()
+{
+  Quadric zero;
+  std::fill(zero.q, zero.q + 10, 0.0);
+  zero.weight = 0.0;
+
+  m_quadrics.assign(m_positions.size(), zero);
+  m_stamps.assign(m_positions.size(), 0);
+  m_adjacency.assign(m_positions.size(), std::vector<int>());
+
+  // Area weighted face planes.
+  for (size_t t = 0; t < m_triangles.size(); t++) {
+    Triangle& triangle = m_triangles[t];
+    updateNormal(triangle);
+
+    for (int k = 0; k < 3; k++) {
+      if (triangle.area > 0.0) {
+        addPlane(m_quadrics[triangle.v[k]], triangle.normal, m_positions[triangle.v[0]], triangle.area);
+      }
+      m_adjacency[triangle.v[k]].push_back(t);
+    }
+  }
+
+  // Sort edges so that triangles sharing an edge become neighbours.
+  std::vector<std::pair<quint64, int> > edges;
+  edges.reserve(m_triangles.size() * 3);
+
+  for (size_t t = 0; t < m_triangles.size(); t++) {
+    for (int k = 0; k < 3; k++) {
+      quint64 a = m_triangles[t].v[k], b = m_triangles[t].v[(k + 1) % 3];
+      edges.push_back(std::make_pair((qMin(a, b) << 32) | qMax(a, b), (int)t));
+    }
+  }
+
+  std::sort(edges.begin(), edges.end());
+
+  for (size_t i = 0; i < edges.size(); ) {
+    size_t j = i + 1;
+    while (j < edges.size() && edges[j].first == edges[i].first) {
+      j++;
+    }
+
+    int a = edges[i].first >> 32, b = edges[i].first & 0xFFFFFFFF;
+
+    // Keep open borders and material seams in place by penalizing movement
+    // away from a plane perpendicular to the adjacent faces.
+    bool constrained = (j - i != 2) ||
+        m_groups[m_triangles[edges[i].second].face] != m_groups[m_triangles[edges[i + 1].second].face];
+
+    if (constrained) {
+      Vec3 edge = sub(m_positions[b], m_positions[a]);
+      double weight = BOUNDARY_WEIGHT * dot(edge, edge);
+
+      for (size_t k = i; k < j; k++) {
+        Vec3 normal = cross(edge, m_triangles[edges[k].second].normal);
+        double length = sqrt(dot(normal, normal));
+
+        if (length > 0.0) {
+          normal.x /= length; normal.y /= length; normal.z /= length;
+          addPlane(m_quadrics[a], normal, m_positions[a], weight);
+          addPlane(m_quadrics[b], normal, m_positions[a], weight);
+        }
+      }
+    }
+
+    pushCollapse(a, b);
+    i = j;
+  }
+
+  m_prepared = true;
+}
+
+void MeshSimplifier::addPlane(Quadric& quadric, const Vec3& normal, const Vec3& point, double weight)
+{
+  double a = normal.x, b = normal.y, c = normal.z, d = -dot(normal, point);
+  double* q = quadric.q;
+
+  q[0] += weight * a * a; q[1] += weight * a * b; q[2] += weight * a * c; q[3] += weight * a * d;
+  q[4] += weight * b * b; q[5] += weight * b * c; q[6] += weight * b * d;
+  q[7] += weight * c * c; q[8] += weight * c * d;
+  q[9] += weight * d * d;
+
+  quadric.weight += weight;
+}
+
+void MeshSimplifier::pushCollapse(int v1, int v2)
+{
+  if (m_locked[v1] && m_locked[v2]) {
+    return;
+  }
+
+  int keep = v1, drop = v2;
+  if (m_locked[drop]) {
+    std::swap(keep, drop);
+  }
+
+  Quadric quadric;
+  for (int i = 0; i < 10; i++) {
+    quadric.q[i] = m_quadrics[keep].q[i] + m_quadrics[drop].q[i];
+  }
+  quadric.weight = m_quadrics[keep].weight + m_quadrics[drop].weight;
+
+  const Vec3& p1 = m_positions[keep];
+  const Vec3& p2 = m_positions[drop];
+  Vec3 mid = { (p1.x + p2.x) / 2.0, (p1.y + p2.y) / 2.0, (p1.z + p2.z) / 2.0 };
+
+  Vec3 target = p1;
+  double cost = evaluate(quadric, p1);
+
+  if (!m_locked[keep]) {
+    double c2 = evaluate(quadric, p2), c3 = evaluate(quadric, mid);
+    if (c2 < cost) { target = p2; cost = c2; }
+    if (c3 < cost) { target = mid; cost = c3; }
+
+    // Optimal position minimizing the quadric, unless the system is
+    // ill-conditioned or the solution is far from the edge.
+    const double* q = quadric.q;
+    double a11 = q[0], a12 = q[1], a13 = q[2], a22 = q[4], a23 = q[5], a33 = q[7];
+    double b1 = -q[3], b2 = -q[6], b3 = -q[8];
+    double det = a11 * (a22 * a33 - a23 * a23) - a12 * (a12 * a33 - a23 * a13) + a13 * (a12 * a23 - a22 * a13);
+    double trace = a11 + a22 + a33;
+
+    if (fabs(det) > 1e-6 * trace * trace * trace) {
+      Vec3 optimal = {
+        (b1 * (a22 * a33 - a23 * a23) - a12 * (b2 * a33 - a23 * b3) + a13 * (b2 * a23 - a22 * b3)) / det,
+        (a11 * (b2 * a33 - a23 * b3) - b1 * (a12 * a33 - a23 * a13) + a13 * (a12 * b3 - b2 * a13)) / det,
+        (a11 * (a22 * b3 - b2 * a23) - a12 * (a12 * b3 - b2 * a13) + b1 * (a12 * a23 - a22 * a13)) / det
+      };
+
+      Vec3 edge = sub(p2, p1), offset = sub(optimal, mid);
+      if (dot(offset, offset) <= dot(edge, edge)) {
+        double c4 = evaluate(quadric, optimal);
+        if (c4 < cost) { target = optimal; cost = c4; }
+      }
+    }
+  }
+
+  cost = qMax(0.0, cost);
+
+  Collapse collapse;
+  collapse.cost = cost;
+  collapse.keep = keep;
+  collapse.drop = drop;
+  collapse.keepStamp = m_stamps[keep];
+  collapse.dropStamp = m_stamps[drop];
+  collapse.target = target;
+
+  m_heap.push(collapse);
+}
+
+bool MeshSimplifier::isValid(const Collapse& collapse) const
+{
+  if (m_stamps[collapse.keep] != collapse.keepStamp || m_stamps[collapse.drop] != collapse.dropStamp ||
+      !m_refs[collapse.keep] || !m_refs[collapse.drop]) {
+    return false;
+  }
+
+  // Reject collapses that would flip or degenerate surviving triangles.
+  for (int pass = 0; pass < 2; pass++) {
+    for (int t : m_adjacency[pass ? collapse.drop : collapse.keep]) {
+      const Triangle& triangle = m_triangles[t];
+
+      if (!triangle.alive || triangle.area <= 0.0) {
+        continue;
+      }
+
+      Vec3 p[3];
+      int moved = 0;
+      for (int k = 0; k < 3; k++) {
+        if (triangle.v[k] == collapse.keep || triangle.v[k] == collapse.drop) {
+          p[k] = collapse.target;
+          moved++;
+        }
+        else {
+          p[k] = m_positions[triangle.v[k]];
+        }
+      }
+
+      // Triangles on the collapsed edge are removed.
+      if (moved > 1) {
+        continue;
+      }
+
+      Vec3 normal = cross(sub(p[1], p[0]), sub(p[2], p[0]));
+      double length = sqrt(dot(normal, normal));
+
+      if (length <= 0.0 || dot(normal, triangle.normal) / length < FLIP_LIMIT) {
+        return false;
+      }
+    }
+  }
+
+  return true;
+}
+
+void MeshSimplifier::apply(const Collapse& collapse)
+{
+  int keep = collapse.keep, drop = collapse.drop;
+
+  m_positions[keep] = collapse.target;
+  for (int i = 0; i < 10; i++) {
+    m_quadrics[keep].q[i] += m_quadrics[drop].q[i];
+  }
+  m_quadrics[keep].weight += m_quadrics[drop].weight;
+  m_stamps[keep]++;
+  m_stamps[drop]++;
+
+  std::vector<int>& dropAdjacency = m_adjacency[drop];
+  std::vector<int>& keepAdjacency = m_adjacency[keep];
+
+  for (int t : dropAdjacency) {
+    Triangle& triangle = m_triangles[t];
+
+    if (!triangle.alive) {
+      continue;
+    }
+
+    if (triangle.v[0] == keep || triangle.v[1] == keep || triangle.v[2] == keep) {
+      kill(t);
+    }
+    else {
+      for (int k = 0; k < 3; k++) {
+        if (triangle.v[k] == drop) {
+          triangle.v[k] = keep;
+        }
+      }
+
+      if (m_refs[keep]++ == 0) {
+        m_liveVertices++;
+      }
+      release(drop);
+
+      keepAdjacency.push_back(t);
+    }
+  }
+
+  std::vector<int>().swap(dropAdjacency);
+
+  // Refresh the surviving fan and requeue its edges.
+  std::vector<int> neighbours;
+  size_t live = 0;
+
+  for (size_t i = 0; i < keepAdjacency.size(); i++) {
+    Triangle& triangle = m_triangles[keepAdjacency[i]];
+
+    if (!triangle.alive) {
+      continue;
+    }
+
+    keepAdjacency[live++] = keepAdjacency[i];
+    updateNormal(triangle);
+
+    for (int k = 0; k < 3; k++) {
+      if (triangle.v[k] != keep) {
+        neighbours.push_back(triangle.v[k]);
+      }
+    }
+  }
+
+  keepAdjacency.resize(live);
+
+  std::sort(neighbours.begin(), neighbours.end());
+  neighbours.erase(std::unique(neighbours.begin(), neighbours.end()), neighbours.end());
+
+  for (int neighbour : neighbours) {
+    pushCollapse(keep, neighbour);
+  }
+}
+
+void MeshSimplifier::kill(int triangle)
+{
+  m_triangles[triangle].alive = false;
+  m_liveTriangles--;
+
+  for (int k = 0; k < 3; k++) {
+    release(m_triangles[triangle].v[k]);
+  }
+}
+
+void MeshSimplifier::release(int vertex)
+{
+  if (--m_refs[vertex] == 0) {
+    m_liveVertices--;
+  }
+}
+
+void MeshSimplifier::updateNormal(Triangle& triangle)
+{
+  const Vec3& p0 = m_positions[triangle.v[0]];
+  Vec3 normal = cross(sub(m_positions[triangle.v[1]], p0), sub(m_positions[triangle.v[2]], p0));
+  double length = sqrt(dot(normal, normal));
+
+  triangle.area = length / 2.0;
+
+  if (length > 0.0) {
+    triangle.normal.x = normal.x / length;
+    triangle.normal.y = normal.y / length;
+    triangle.normal.z = normal.z / length;
+  }
+  else {
+    triangle.normal.x = triangle.normal.y = triangle.normal.z = 0.0;
+  }
+}
+
+void MeshSimplifier::merge()
+{
+  m_polygons.clear();
+
+  std::vector<int> alive;
+  for (size_t t = 0; t < m_triangles.size(); t++) {
+    if (m_triangles[t].alive) {
+      alive.push_back(t);
+    }
+  }
+
+  // Neighbour across each directed edge, for edges shared by exactly two
+  // consistently wound triangles.
+  std::vector<std::pair<quint64, int> > edges;
+  edges.reserve(alive.size() * 3);
+
+  for (int t : alive) {
+    for (int k = 0; k < 3; k++) {
+      quint64 a = m_triangles[t].v[k], b = m_triangles[t].v[(k + 1) % 3];
+      edges.push_back(std::make_pair((qMin(a, b) << 32) | qMax(a, b), t * 3 + k));
+    }
+  }
+
+  std::sort(edges.begin(), edges.end());
+
+  std::vector<int> neighbour(m_triangles.size() * 3, -1);
+
+  for (size_t i = 0; i < edges.size(); ) {
+    size_t j = i + 1;
+    while (j < edges.size() && edges[j].first == edges[i].first) {
+      j++;
+    }
+
+    if (j - i == 2) {
+      int e0 = edges[i].second, e1 = edges[i + 1].second;
+      const Triangle& t0 = m_triangles[e0 / 3];
+      const Triangle& t1 = m_triangles[e1 / 3];
+
+      if (t0.v[e0 % 3] == t1.v[(e1 % 3 + 1) % 3]) {
+        neighbour[e0] = e1 / 3;
+        neighbour[e1] = e0 / 3;
+      }
+    }
+
+    i = j;
+  }
+
+  // Grow polygons greedily from the largest triangles.
+  std::sort(alive.begin(), alive.end(),
+      [this](int lhv, int rhv) { return m_triangles[lhv].area > m_triangles[rhv].area; });
+
+  std::vector<bool> used(m_triangles.size(), false);
+
+  for (int seed : alive) {
+    if (used[seed]) {
+      continue;
+    }
+
+    const Triangle& first = m_triangles[seed];
+    used[seed] = true;
+
+    Polygon polygon;
+    polygon.indices << first.v[0] << first.v[1] << first.v[2];
+    polygon.face = first.face;
+
+    std::vector<int> members(1, seed);
+
+    for (size_t m = 0; m < members.size() && polygon.indices.size() < POLYGON_MAX; m++) {
+      for (int k = 0; k < 3 && polygon.indices.size() < POLYGON_MAX; k++) {
+        int other = neighbour[members[m] * 3 + k];
+
+        if (other < 0 || used[other]) {
+          continue;
+        }
+
+        const Triangle& member = m_triangles[members[m]];
+        const Triangle& candidate = m_triangles[other];
+
+        if (m_groups[candidate.face] != m_groups[first.face] ||
+            dot(candidate.normal, first.normal) < PLANAR_LIMIT) {
+          continue;
+        }
+
+        // The shared edge must still be on the polygon outline.
+        int a = member.v[k], b = member.v[(k + 1) % 3];
+        int i = polygon.indices.indexOf(a);
+
+        if (i < 0 || polygon.indices[(i + 1) % polygon.indices.size()] != b) {
+          continue;
+        }
+
+        int c = candidate.v[0];
+        for (int n = 1; n < 3; n++) {
+          if (c == a || c == b) {
+            c = candidate.v[n];
+          }
+        }
+
+        if (polygon.indices.contains(c)) {
+          continue;
+        }
+
+        QVector<int> loop = polygon.indices;
+        loop.insert(i + 1, c);
+
+        if (!isConvex(loop, first.normal)) {
+          continue;
+        }
+
+        polygon.indices = loop;
+        polygon.face = qMin(polygon.face, candidate.face);
+        used[other] = true;
+        members.push_back(other);
+      }
+    }
+
+    m_polygons.append(polygon);
+  }
+}
+
+bool MeshSimplifier::isConvex(const QVector<int>& loop, const Vec3& normal) const
+{
+  int n = loop.size();
+
+  for (int i = 0; i < n; i++) {
+    Vec3 e1 = sub(m_positions[loop[(i + 1) % n]], m_positions[loop[i]]);
+    Vec3 e2 = sub(m_positions[loop[(i + 2) % n]], m_positions[loop[(i + 1) % n]]);
+
+    if (dot(cross(e1, e2), normal) < -1e-6 * sqrt(dot(e1, e1) * dot(e2, e2))) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+// Largest distance of an input vertex to the simplified triangles. A vertex
+// closer than the largest so far cannot change the result, so most stop at
+// the first triangle near them.
+void MeshSimplifier::measure()
+{
+  std::vector<Vec3> corners;
+  for (const Triangle& triangle : m_triangles) {
+    if (triangle.alive) {
+      for (int k = 0; k < 3; k++) {
+        corners.push_back(m_positions[triangle.v[k]]);
+      }
+    }
+  }
+
+  double maxDistance = 0.0;
+
+  for (int v : m_surface) {
+    const Vec3& p = m_original[v];
+    double nearest = std::numeric_limits<double>::max();
+
+    for (size_t i = 0; i < corners.size(); i += 3) {
+      nearest = qMin(nearest, distanceSquared(p, corners[i], corners[i + 1], corners[i + 2]));
+      if (nearest <= maxDistance) {
+        break;
+      }
+    }
+
+    if (nearest != std::numeric_limits<double>::max()) {
+      maxDistance = qMax(maxDistance, nearest);
+    }
+  }
+
+  m_deviation = sqrt(maxDistance);
+}
+
+// Squared distance of a point to the closest point of a triangle, found by
+// the Voronoi region of the triangle it lies in.
+double MeshSimplifier::distanceSquared(const Vec3& p, const Vec3& a, const Vec3& b, const Vec3& c)
+{
+  Vec3 ab = sub(b, a), ac = sub(c, a), ap = sub(p, a);
+  double d1 = dot(ab, ap), d2 = dot(ac, ap);
+  if (d1 <= 0.0 && d2 <= 0.0) {
+    return dot(ap, ap);
+  }
+
+  Vec3 bp = sub(p, b);
+  double d3 = dot(ab, bp), d4 = dot(ac, bp);
+  if (d3 >= 0.0 && d4 <= d3) {
+    return dot(bp, bp);
+  }
+
+  Vec3 cp = sub(p, c);
+  double d5 = dot(ab, cp), d6 = dot(ac, cp);
+  if (d6 >= 0.0 && d5 <= d6) {
+    return dot(cp, cp);
+  }
+
+  double s, t;
+  double vc = d1 * d4 - d3 * d2, vb = d5 * d2 - d1 * d6, va = d3 * d6 - d5 * d4;
+
+  if (vc <= 0.0 && d1 >= 0.0 && d3 <= 0.0) {
+    s = d1 / (d1 - d3); t = 0.0;
+  }
+  else if (vb <= 0.0 && d2 >= 0.0 && d6 <= 0.0) {
+    s = 0.0; t = d2 / (d2 - d6);
+  }
+  else if (va <= 0.0 && d4 - d3 >= 0.0 && d5 - d6 >= 0.0) {
+    t = (d4 - d3) / ((d4 - d3) + (d5 - d6)); s = 1.0 - t;
+  }
+  else {
+    double denominator = va + vb + vc;
+    if (denominator <= 0.0) {
+      return dot(ap, ap); // Degenerate.
+    }
+    s = vb / denominator; t = vc / denominator;
+  }
+
+  Vec3 closest = { a.x + ab.x * s + ac.x * t, a.y + ab.y * s + ac.y * t, a.z + ab.z * s + ac.z * t };
+  Vec3 offset = sub(p, closest);
+  return dot(offset, offset);
+}
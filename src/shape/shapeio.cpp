@@ -0,0 +1,1366 @@
+#include <QFile>
+#include <QFileInfo>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QMutexLocker>
+#include <QRegExp>
+#include <QtEndian>
+#include <algorithm>
+#include <limits.h>
+#include <math.h>
+#include <string.h>
+
+#include "app/settings.h"
+#include "shapeio.h"
+#include "materialsmodel.h"
+#include "meshsimplifier.h"
+#include "shapemodel.h"
+#include "shaperenderer.h"
+#include "verticesmodel.h"
+
+const quint32 ShapeIO::GLB_MAGIC;
+const quint32 ShapeIO::GLB_VERSION;
+const quint32 ShapeIO::GLB_CHUNK_JSON;
+const quint32 ShapeIO::GLB_CHUNK_BIN;
+
+const int     ShapeIO::OBJ_NUMBER_MAX;
+
+const char    ShapeIO::GLB_EXTRAS[]    = "stunts";
+const char    ShapeIO::GLB_VARIANTS[]  = "KHR_materials_variants";
+const char    ShapeIO::MATERIAL_NAME[] = "Stunts%1";
+
+static inline void putFloat(char* dst, float value)
+{
+  quint32 bits;
+  memcpy(&bits, &value, sizeof(bits));
+  qToLittleEndian(bits, dst);
+}
+
+static inline float getFloat(const char* src)
+{
+  quint32 bits = qFromLittleEndian<quint32>(src);
+  float value;
+  memcpy(&value, &bits, sizeof(value));
+  return value;
+}
+
+static float toLinear(int component)
+{
+  double c = component / 255.0;
+  return c <= 0.04045 ? c / 12.92 : pow((c + 0.055) / 1.055, 2.4);
+}
+
+// Writes a single paint-job, or all of them if paintJob is negative.
+QByteArray ShapeIO::writeObj(const Mesh& mesh, int paintJob, const QString& title, const QString& mtlLib)
+{
+  QByteArray header = QString("# %1 - %2\n# %3\n# %4\n\nmtllib %5\n\n")
+    .arg(Settings::APP_NAME, Settings::APP_DESC, Settings::ORG_URL, title, mtlLib)
+    .toUtf8();
+
+  // Upper bound, trimmed after formatting.
+  int numPaintJobs = 1;
+  int faceSize = 0;
+  foreach (const MeshFace& face, mesh.faces) {
+    numPaintJobs = qMax(numPaintJobs, face.materials.size());
+    faceSize += 32 + face.indices.size() * OBJ_NUMBER_MAX;
+  }
+
+  int size = header.size() + mesh.positions.size() * (2 + 3 * OBJ_NUMBER_MAX) + 1 +
+             (paintJob < 0 ? numPaintJobs : 1) * (faceSize + 32);
+
+  QByteArray out(size, Qt::Uninitialized);
+  char* dst = out.data();
+
+  memcpy(dst, header.constData(), header.size());
+  dst += header.size();
+
+  foreach (const QVector3D& position, mesh.positions) {
+    *dst++ = 'v';
+    dst = putNumber(dst, qRound64(position.x() * 10.0), 10, 1);
+    dst = putNumber(dst, qRound64(position.y() * 10.0), 10, 1);
+    dst = putNumber(dst, qRound64(position.z() * 10.0), 10, 1);
+    *dst++ = '\n';
+  }
+
+  *dst++ = '\n';
+
+  // All paint-jobs share the vertex table, each one as a separate object.
+  int first = paintJob, last = paintJob;
+  if (paintJob < 0) {
+    first = 0;
+    last = 0;
+    foreach (const MeshFace& face, mesh.faces) {
+      last = qMax(last, face.materials.size() - 1);
+    }
+  }
+
+  for (int job = first; job <= last; job++) {
+    if (paintJob < 0) {
+      memcpy(dst, "o paint-job-", 12);
+      dst = putNumber(dst + 12, job + 1, 0);
+      *dst++ = '\n';
+    }
+
+    int prevMat = -1;
+    foreach (const MeshFace& face, mesh.faces) {
+      int curMat = face.materials.value(job);
+      if (curMat != prevMat) {
+        prevMat = curMat;
+        memcpy(dst, "usemtl Stunts", 13);
+        dst += 13;
+        *dst++ = '0' + curMat / 100;
+        *dst++ = '0' + curMat / 10 % 10;
+        *dst++ = '0' + curMat % 10;
+        *dst++ = '\n';
+      }
+
+      switch (face.type) {
+        case PRIM_TYPE_PARTICLE:
+          *dst++ = 'p';
+          break;
+
+        case PRIM_TYPE_LINE:
+        case PRIM_TYPE_SPHERE:
+          *dst++ = 'l';
+          break;
+
+        default:
+          *dst++ = 'f';
+      }
+
+      foreach (int index, face.indices) {
+        dst = putNumber(dst, index + 1, 4);
+      }
+      *dst++ = '\n';
+    }
+  }
+
+  out.resize(dst - out.constData());
+  return out;
+}
+
+static inline bool isBlank(char c)
+{
+  return c == ' ' || c == '\t' || c == '\r' || c == '\v' || c == '\f';
+}
+
+// Number as in [+-]?\d*\.?\d*, returns 0 unless it ends at a blank.
+static const char* readObjNumber(const char* src, const char* end, double& value)
+{
+  bool negative = src < end && *src == '-';
+  if (src < end && (*src == '+' || *src == '-')) {
+    src++;
+  }
+
+  value = 0.0;
+  for (; src < end && *src >= '0' && *src <= '9'; src++) {
+    value = value * 10.0 + (*src - '0');
+  }
+
+  if (src < end && *src == '.') {
+    double fraction = 0.0, scale = 1.0;
+    for (src++; src < end && *src >= '0' && *src <= '9'; src++) {
+      fraction = fraction * 10.0 + (*src - '0');
+      scale *= 10.0;
+    }
+    value += fraction / scale;
+  }
+
+  if (negative) {
+    value = -value;
+  }
+
+  return (src == end || isBlank(*src)) ? src : 0;
+}
+
+// Vertex reference as in -?\d+(/-?\d*){0,2}, only the position is kept.
+static const char* readObjIndex(const char* src, const char* end, int& index)
+{
+  bool negative = src < end && *src == '-';
+  if (negative) {
+    src++;
+  }
+
+  const char* digits = src;
+  qint64 value = 0;
+  for (; src < end && *src >= '0' && *src <= '9'; src++) {
+    value = qMin(value * 10 + (*src - '0'), (qint64)INT_MAX);
+  }
+
+  if (src == digits) {
+    return 0;
+  }
+
+  for (int i = 0; i < 2 && src < end && *src == '/'; i++) {
+    if (++src < end && *src == '-') {
+      src++;
+    }
+    while (src < end && *src >= '0' && *src <= '9') {
+      src++;
+    }
+  }
+
+  index = negative ? -value : value;
+  return (src == end || isBlank(*src)) ? src : 0;
+}
+
+// Reads positions, polygons, lines and points. The material is taken from
+// the last three digits of the material name, like the export writes it.
+// Statements that are unknown or malformed are skipped.
+Mesh ShapeIO::readObj(const QByteArray& data)
+{
+  Mesh mesh;
+  quint8 material = 0;
+
+  const char* src = data.constData();
+  const char* end = src + data.size();
+  int lineNum = 0;
+
+  try {
+    while (src < end) {
+      const char* lineEnd = (const char*)memchr(src, '\n', end - src);
+      const char* next = lineEnd ? lineEnd + 1 : end;
+      if (!lineEnd) {
+        lineEnd = end;
+      }
+
+      const char* line = src;
+      src = next;
+      lineNum++;
+
+      while (lineEnd > line && isBlank(lineEnd[-1])) {
+        lineEnd--;
+      }
+
+      if (line == lineEnd) {
+        continue;
+      }
+
+      if (lineEnd - line >= 6 && !memcmp(line, "usemtl", 6)) {
+        const char* digit = qMax(line + 6, lineEnd - 3);
+        while (digit < lineEnd && isBlank(*digit)) {
+          digit++;
+        }
+
+        int value = 0;
+        for (; digit < lineEnd && *digit >= '0' && *digit <= '9'; digit++) {
+          value = value * 10 + (*digit - '0');
+        }
+        material = digit == lineEnd ? value : 0;
+        continue;
+      }
+
+      const char* args = line + 1;
+      if (*line == 'f' && args < lineEnd && *args == 'o') {
+        args++;
+      }
+
+      // Other statements, e.g. vt, vn or o.
+      if (args < lineEnd && !isBlank(*args)) {
+        continue;
+      }
+
+      if (*line == 'v') {
+        double values[4];
+        int count = 0;
+
+        while (args && args < lineEnd && count < 4) {
+          while (args < lineEnd && isBlank(*args)) {
+            args++;
+          }
+          args = readObjNumber(args, lineEnd, values[count++]);
+        }
+
+        if (args == lineEnd && count >= 3) {
+          mesh.positions.append(QVector3D(values[0], values[1], values[2]));
+        }
+      }
+      else if (*line == 'f' || *line == 'l' || *line == 'p') {
+        QVector<int> indices;
+
+        while (args && args < lineEnd) {
+          while (args < lineEnd && isBlank(*args)) {
+            args++;
+          }
+
+          int index;
+          args = readObjIndex(args, lineEnd, index);
+          if (args) {
+            indices.append(index);
+          }
+        }
+
+        if (args != lineEnd || indices.isEmpty()) {
+          continue;
+        }
+
+        if (mesh.positions.isEmpty()) {
+          throw tr("Found primitive before any vertices.");
+        }
+
+        MeshFace face;
+        face.materials.append(material);
+        face.twoSided = false;
+        face.zBias = false;
+        face.hasCull = false;
+
+        foreach (int index, indices) {
+          if (index < 0) {
+            index = mesh.positions.size() + index + 1;
+          }
+
+          if (index < 1 || index > mesh.positions.size()) {
+            throw tr("Vertex index %1 out of bounds (1 - %2).").arg(index).arg(mesh.positions.size());
+          }
+          face.indices.append(index - 1);
+        }
+
+        int numVertices = face.indices.size();
+
+        if (numVertices <= MeshSimplifier::POLYGON_MAX) {
+          if (*line == 'l' && numVertices == 6) {
+            face.type = PRIM_TYPE_WHEEL;
+          }
+          else {
+            face.type = numVertices;
+          }
+          mesh.faces.append(face);
+        }
+        else if (*line == 'f') {
+          // Oversized polygon, split up by the simplifier.
+          face.type = 0;
+          mesh.faces.append(face);
+        }
+        else if (*line == 'l') {
+          MeshFace segment = face;
+          segment.type = PRIM_TYPE_LINE;
+          for (int i = 0; i < numVertices - 1; i++) {
+            segment.indices = face.indices.mid(i, 2);
+            mesh.faces.append(segment);
+          }
+        }
+        else {
+          MeshFace particle = face;
+          particle.type = PRIM_TYPE_PARTICLE;
+          foreach (int index, face.indices) {
+            particle.indices = QVector<int>(1, index);
+            mesh.faces.append(particle);
+          }
+        }
+      }
+    }
+  }
+  catch (QString msg) {
+    throw tr("Parsing error at line %1: %2").arg(lineNum).arg(msg);
+  }
+
+  return mesh;
+}
+
+// Writes value / 10^decimals right-aligned in a field of the given width.
+char* ShapeIO::putNumber(char* dst, qint64 value, int width, int decimals)
+{
+  char buffer[OBJ_NUMBER_MAX];
+  char* end = buffer + sizeof(buffer);
+  char* src = end;
+
+  bool negative = value < 0;
+  quint64 magnitude = negative ? -(quint64)value : value;
+
+  for (int i = 0; i < decimals; i++) {
+    *--src = '0' + magnitude % 10;
+    magnitude /= 10;
+  }
+  if (decimals) {
+    *--src = '.';
+  }
+
+  do {
+    *--src = '0' + magnitude % 10;
+    magnitude /= 10;
+  } while (magnitude);
+
+  if (negative) {
+    *--src = '-';
+  }
+
+  for (int length = end - src; length < width; length++) {
+    *dst++ = ' ';
+  }
+
+  memcpy(dst, src, end - src);
+  return dst + (end - src);
+}
+
+// Wheels are tessellated like in the editor, into positions of their own,
+// the control points only go to the extras.
+QByteArray ShapeIO::writeGlb(const Mesh& mesh, const QString& name)
+{
+  // Faces sharing paint-jobs, drawing mode and positions end up in one glTF
+  // primitive.
+  typedef struct {
+    MaterialsList    materials;
+    int              mode;
+    bool             wheel;
+    QVector<quint32> indices;
+  } Batch;
+
+  QList<Batch> batches;
+  QList<int> usedMaterials;
+  int numPaintJobs = 1;
+
+  auto batchFor = [&](int mode, const MaterialsList& materials, bool wheel) -> QVector<quint32>& {
+    int b = 0;
+    while (b < batches.size() && (batches[b].mode != mode || batches[b].materials != materials || batches[b].wheel != wheel)) {
+      b++;
+    }
+    if (b == batches.size()) {
+      Batch batch;
+      batch.materials = materials;
+      batch.mode = mode;
+      batch.wheel = wheel;
+      batches.append(batch);
+    }
+    return batches[b].indices;
+  };
+
+  // Internal coordinates while tessellating.
+  QVector<QVector3D> wheelPositions;
+
+  QJsonArray extrasPrimitives;
+
+  foreach (const MeshFace& face, mesh.faces) {
+    if (face.indices.isEmpty()) {
+      continue;
+    }
+
+    int mode;
+    if (face.type == PRIM_TYPE_PARTICLE) {
+      mode = MODE_POINTS;
+    }
+    else if (face.type == PRIM_TYPE_LINE || face.type == PRIM_TYPE_SPHERE) {
+      mode = MODE_LINES;
+    }
+    else {
+      mode = MODE_TRIANGLES;
+    }
+
+    if (face.type == PRIM_TYPE_WHEEL && face.indices.size() == 6) {
+      VerticesFList v;
+      foreach (int index, face.indices) {
+        const QVector3D& position = mesh.positions[index];
+        VertexF vertex = { position.x(), position.y() * VerticesModel::Y_RATIO, -position.z() };
+        v.append(vertex);
+      }
+
+      // Tread, tyre sides and rims take the next materials, like drawn.
+      QVector<quint32> parts[3];
+      ShapeRenderer::wheel(v, ShapeRenderer::CIRCLE_STEPS, wheelPositions, parts);
+
+      for (int i = 0; i < 3; i++) {
+        MaterialsList materials;
+        foreach (quint8 material, face.materials) {
+          materials.append(qMin(material + i, (int)MaterialsModel::VAL_MAX));
+        }
+
+        batchFor(MODE_TRIANGLES, materials, true) += parts[i];
+      }
+    }
+    else {
+      QVector<quint32>& indices = batchFor(mode, face.materials, false);
+      if (mode == MODE_POINTS) {
+        indices << face.indices[0];
+      }
+      else if (mode == MODE_LINES) {
+        indices << face.indices[0] << face.indices[face.indices.size() > 1 ? 1 : 0];
+      }
+      else {
+        for (int i = 1; i < face.indices.size() - 1; i++) {
+          indices << face.indices[0] << face.indices[i] << face.indices[i + 1];
+        }
+      }
+    }
+
+    QJsonObject primitive;
+    QJsonArray materials, vertices;
+    foreach (quint8 material, face.materials) {
+      materials.append(material);
+    }
+    foreach (int index, face.indices) {
+      vertices.append(index);
+    }
+    primitive["type"] = face.type;
+    primitive["twoSided"] = face.twoSided;
+    primitive["zBias"] = face.zBias;
+    if (face.hasCull) {
+      primitive["cull1"] = (double)face.cull1;
+      primitive["cull2"] = (double)face.cull2;
+    }
+    primitive["materials"] = materials;
+    primitive["vertices"] = vertices;
+    extrasPrimitives.append(primitive);
+  }
+
+  foreach (const Batch& batch, batches) {
+    numPaintJobs = qMax(numPaintJobs, batch.materials.size());
+    foreach (quint8 material, batch.materials) {
+      if (!usedMaterials.contains(material)) {
+        usedMaterials.append(material);
+      }
+    }
+  }
+
+  std::sort(usedMaterials.begin(), usedMaterials.end());
+
+  for (int i = 0; i < wheelPositions.size(); i++) {
+    wheelPositions[i] = QVector3D(wheelPositions[i].x(), wheelPositions[i].y() / VerticesModel::Y_RATIO, -wheelPositions[i].z());
+  }
+
+  // Binary chunk, positions and wheel positions first and then one index
+  // block per batch.
+  int binSize = (mesh.positions.size() + wheelPositions.size()) * 3 * sizeof(float);
+  foreach (const Batch& batch, batches) {
+    binSize += batch.indices.size() * sizeof(quint32);
+  }
+
+  QByteArray bin(binSize, Qt::Uninitialized);
+  char* dst = bin.data();
+
+  QJsonArray bufferViews, accessors, primitives;
+
+  auto putPositions = [&](const QVector<QVector3D>& positions) {
+    int offset = dst - bin.data();
+
+    QVector3D min, max;
+    for (int i = 0; i < positions.size(); i++) {
+      const QVector3D& position = positions[i];
+      putFloat(dst, position.x());
+      putFloat(dst + 4, position.y());
+      putFloat(dst + 8, position.z());
+      dst += 12;
+
+      if (i == 0) {
+        min = max = position;
+      }
+      else {
+        min = QVector3D(qMin(min.x(), position.x()), qMin(min.y(), position.y()), qMin(min.z(), position.z()));
+        max = QVector3D(qMax(max.x(), position.x()), qMax(max.y(), position.y()), qMax(max.z(), position.z()));
+      }
+    }
+
+    QJsonObject positionView;
+    positionView["buffer"] = 0;
+    positionView["byteOffset"] = offset;
+    positionView["byteLength"] = (int)(dst - bin.data()) - offset;
+    positionView["target"] = 34962;
+    bufferViews.append(positionView);
+
+    QJsonObject positionAccessor;
+    positionAccessor["bufferView"] = bufferViews.size() - 1;
+    positionAccessor["componentType"] = COMPONENT_FLOAT;
+    positionAccessor["count"] = positions.size();
+    positionAccessor["type"] = QString("VEC3");
+    positionAccessor["min"] = QJsonArray({ min.x(), min.y(), min.z() });
+    positionAccessor["max"] = QJsonArray({ max.x(), max.y(), max.z() });
+    accessors.append(positionAccessor);
+  };
+
+  putPositions(mesh.positions);
+
+  int wheelAccessor = -1;
+  if (!wheelPositions.isEmpty()) {
+    putPositions(wheelPositions);
+    wheelAccessor = accessors.size() - 1;
+  }
+
+  foreach (const Batch& batch, batches) {
+    int offset = dst - bin.data();
+    foreach (quint32 index, batch.indices) {
+      qToLittleEndian(index, dst);
+      dst += 4;
+    }
+
+    QJsonObject view;
+    view["buffer"] = 0;
+    view["byteOffset"] = offset;
+    view["byteLength"] = batch.indices.size() * 4;
+    view["target"] = 34963;
+    bufferViews.append(view);
+
+    QJsonObject accessor;
+    accessor["bufferView"] = bufferViews.size() - 1;
+    accessor["componentType"] = COMPONENT_UINT;
+    accessor["count"] = batch.indices.size();
+    accessor["type"] = QString("SCALAR");
+    accessors.append(accessor);
+
+    QJsonObject attributes;
+    attributes["POSITION"] = batch.wheel ? wheelAccessor : 0;
+
+    QJsonObject primitive;
+    primitive["attributes"] = attributes;
+    primitive["indices"] = accessors.size() - 1;
+    primitive["mode"] = batch.mode;
+    primitive["material"] = usedMaterials.indexOf(batch.materials.value(0));
+
+    // One mapping per distinct material, listing the paint-jobs using it.
+    if (numPaintJobs > 1) {
+      QJsonArray mappings;
+      QList<int> mapped;
+      for (int i = 0; i < batch.materials.size(); i++) {
+        if (mapped.contains(batch.materials[i])) {
+          continue;
+        }
+        mapped.append(batch.materials[i]);
+
+        QJsonArray variants;
+        for (int j = i; j < batch.materials.size(); j++) {
+          if (batch.materials[j] == batch.materials[i]) {
+            variants.append(j);
+          }
+        }
+
+        QJsonObject mapping;
+        mapping["material"] = usedMaterials.indexOf(batch.materials[i]);
+        mapping["variants"] = variants;
+        mappings.append(mapping);
+      }
+
+      QJsonObject variantsExtension;
+      variantsExtension["mappings"] = mappings;
+      QJsonObject extensions;
+      extensions[GLB_VARIANTS] = variantsExtension;
+      primitive["extensions"] = extensions;
+    }
+
+    primitives.append(primitive);
+  }
+
+  QJsonArray materials;
+  foreach (int material, usedMaterials) {
+    QColor color(Qt::gray);
+    if (material < Settings::m_loadedMaterials.size() &&
+        Settings::m_loadedMaterials[material].color < Settings::m_loadedPalette.size()) {
+      color = QColor(Settings::m_loadedPalette[Settings::m_loadedMaterials[material].color]);
+    }
+
+    QJsonObject pbr;
+    pbr["baseColorFactor"] = QJsonArray({ toLinear(color.red()), toLinear(color.green()), toLinear(color.blue()), 1.0 });
+    pbr["metallicFactor"] = 0.0;
+    pbr["roughnessFactor"] = 1.0;
+
+    QJsonObject object;
+    object["name"] = QString(MATERIAL_NAME).arg(material, 3, 10, QChar('0'));
+    object["pbrMetallicRoughness"] = pbr;
+    materials.append(object);
+  }
+
+  QJsonObject extras, stunts;
+  stunts["positions"] = 0;
+  stunts["primitives"] = extrasPrimitives;
+  extras[GLB_EXTRAS] = stunts;
+
+  QJsonObject meshObject;
+  meshObject["name"] = name;
+  meshObject["primitives"] = primitives;
+  meshObject["extras"] = extras;
+
+  QJsonObject node;
+  node["name"] = name;
+  node["mesh"] = 0;
+
+  QJsonObject scene;
+  scene["nodes"] = QJsonArray({ 0 });
+
+  QJsonObject asset;
+  asset["version"] = QString("2.0");
+  asset["generator"] = QString("%1 %2").arg(Settings::APP_NAME, Settings::APP_VER);
+
+  QJsonObject buffer;
+  buffer["byteLength"] = bin.size();
+
+  QJsonObject root;
+  root["asset"] = asset;
+  root["scene"] = 0;
+  root["scenes"] = QJsonArray({ scene });
+  root["nodes"] = QJsonArray({ node });
+  root["meshes"] = QJsonArray({ meshObject });
+  root["materials"] = materials;
+  root["accessors"] = accessors;
+  root["bufferViews"] = bufferViews;
+  root["buffers"] = QJsonArray({ buffer });
+
+  if (numPaintJobs > 1) {
+    QJsonArray variants;
+    for (int i = 0; i < numPaintJobs; i++) {
+      QJsonObject variant;
+      variant["name"] = tr("Paint-job %1").arg(i + 1);
+      variants.append(variant);
+    }
+
+    QJsonObject variantsExtension;
+    variantsExtension["variants"] = variants;
+    QJsonObject extensions;
+    extensions[GLB_VARIANTS] = variantsExtension;
+    root["extensions"] = extensions;
+    root["extensionsUsed"] = QJsonArray({ QString(GLB_VARIANTS) });
+  }
+
+  QByteArray json = QJsonDocument(root).toJson(QJsonDocument::Compact);
+  while (json.size() % 4) {
+    json.append(' ');
+  }
+
+  // Header and both chunks, indices are already 4-byte aligned.
+  QByteArray out(12 + 8 + json.size() + 8 + bin.size(), Qt::Uninitialized);
+  dst = out.data();
+
+  qToLittleEndian(GLB_MAGIC, dst);
+  qToLittleEndian(GLB_VERSION, dst + 4);
+  qToLittleEndian((quint32)out.size(), dst + 8);
+  dst += 12;
+
+  qToLittleEndian((quint32)json.size(), dst);
+  qToLittleEndian(GLB_CHUNK_JSON, dst + 4);
+  memcpy(dst + 8, json.constData(), json.size());
+  dst += 8 + json.size();
+
+  qToLittleEndian((quint32)bin.size(), dst);
+  qToLittleEndian(GLB_CHUNK_BIN, dst + 4);
+  memcpy(dst + 8, bin.constData(), bin.size());
+
+  return out;
+}
+
+Mesh ShapeIO::readGlb(const QByteArray& data)
+{
+  const char* src = data.constData();
+
+  if (data.size() < 12 || qFromLittleEndian<quint32>(src) != GLB_MAGIC) {
+    throw tr("Not a binary glTF file.");
+  }
+
+  if (qFromLittleEndian<quint32>(src + 4) != GLB_VERSION) {
+    throw tr("Unsupported glTF version %1.").arg(qFromLittleEndian<quint32>(src + 4));
+  }
+
+  quint32 length = qMin((quint32)data.size(), qFromLittleEndian<quint32>(src + 8));
+
+  QByteArray jsonChunk, bin;
+  for (quint32 offset = 12; offset + 8 <= length; ) {
+    quint32 chunkLength = qFromLittleEndian<quint32>(src + offset);
+    quint32 chunkType = qFromLittleEndian<quint32>(src + offset + 4);
+
+    if (chunkLength > length - offset - 8) {
+      throw tr("Truncated chunk at offset %1.").arg(offset);
+    }
+
+    if (chunkType == GLB_CHUNK_JSON && jsonChunk.isNull()) {
+      jsonChunk = QByteArray::fromRawData(src + offset + 8, chunkLength);
+    }
+    else if (chunkType == GLB_CHUNK_BIN && bin.isNull()) {
+      bin = QByteArray::fromRawData(src + offset + 8, chunkLength);
+    }
+
+    offset += 8 + chunkLength;
+  }
+
+  QJsonParseError error;
+  QJsonDocument document = QJsonDocument::fromJson(jsonChunk, &error);
+  if (document.isNull()) {
+    throw tr("Invalid JSON chunk: %1.").arg(error.errorString());
+  }
+
+  QJsonObject json = document.object();
+  QJsonArray meshes = json["meshes"].toArray();
+
+  if (meshes.isEmpty()) {
+    throw tr("No meshes found in file.");
+  }
+
+  Mesh mesh;
+
+  // Files written by us carry the original primitives.
+  QJsonObject stunts = meshes[0].toObject()["extras"].toObject()[GLB_EXTRAS].toObject();
+  if (!stunts.isEmpty()) {
+    mesh.positions = readPositions(json, bin, stunts["positions"].toInt());
+    int count = mesh.positions.size();
+
+    QJsonArray primitives = stunts["primitives"].toArray();
+    for (int i = 0; i < primitives.size(); i++) {
+      QJsonObject primitive = primitives[i].toObject();
+
+      MeshFace face;
+      face.type = primitive["type"].toInt();
+      face.twoSided = primitive["twoSided"].toBool();
+      face.zBias = primitive["zBias"].toBool();
+      face.hasCull = primitive.contains("cull1") && primitive.contains("cull2");
+      face.cull1 = (quint32)primitive["cull1"].toDouble();
+      face.cull2 = (quint32)primitive["cull2"].toDouble();
+
+      foreach (const QJsonValue& material, primitive["materials"].toArray()) {
+        face.materials.append(qBound(0, material.toInt(), 255));
+      }
+      if (face.materials.isEmpty()) {
+        face.materials.append(0);
+      }
+
+      foreach (const QJsonValue& vertex, primitive["vertices"].toArray()) {
+        int index = vertex.toInt(-1);
+        if (index < 0 || index >= count) {
+          throw tr("Vertex index %1 out of bounds (0 - %2).").arg(index).arg(count - 1);
+        }
+        face.indices.append(index);
+      }
+
+      int verticesNeeded;
+      if (!VerticesModel::verticesNeeded(face.type, verticesNeeded) || face.indices.size() != verticesNeeded) {
+        throw tr("Unknown type (%1) for primitive %2.").arg(face.type).arg(i);
+      }
+
+      mesh.faces.append(face);
+    }
+
+    return mesh;
+  }
+
+  // Generic glTF, paint-jobs come from material variants.
+  QRegExp materialName(QString(MATERIAL_NAME).arg("(\\d+)"));
+  QJsonArray gltfMaterials = json["materials"].toArray();
+  int numVariants = json["extensions"].toObject()[GLB_VARIANTS].toObject()["variants"].toArray().size();
+
+  foreach (const QJsonValue& meshValue, meshes) {
+    foreach (const QJsonValue& primitiveValue, meshValue.toObject()["primitives"].toArray()) {
+      QJsonObject primitive = primitiveValue.toObject();
+
+      int base = mesh.positions.size();
+      mesh.positions += readPositions(json, bin, primitive["attributes"].toObject()["POSITION"].toInt(-1));
+      int count = mesh.positions.size() - base;
+
+      QVector<int> indices;
+      if (primitive.contains("indices")) {
+        indices = readIndices(json, bin, primitive["indices"].toInt());
+      }
+      else {
+        indices.resize(count);
+        for (int i = 0; i < count; i++) {
+          indices[i] = i;
+        }
+      }
+
+      foreach (int index, indices) {
+        if (index >= count) {
+          throw tr("Vertex index %1 out of bounds (0 - %2).").arg(index).arg(count - 1);
+        }
+      }
+
+      auto materialOf = [&](int gltfMaterial) -> quint8 {
+        if (gltfMaterial < 0 || gltfMaterial >= gltfMaterials.size()) {
+          return 0;
+        }
+        if (materialName.exactMatch(gltfMaterials.at(gltfMaterial).toObject()["name"].toString())) {
+          return qBound(0, materialName.cap(1).toInt(), 255);
+        }
+        return 0;
+      };
+
+      MeshFace face;
+      face.materials = MaterialsList();
+      face.materials.append(primitive.contains("material") ? materialOf(primitive["material"].toInt()) : 0);
+      for (int i = 1; i < numVariants; i++) {
+        face.materials.append(face.materials[0]);
+      }
+
+      foreach (const QJsonValue& mapping, primitive["extensions"].toObject()[GLB_VARIANTS].toObject()["mappings"].toArray()) {
+        quint8 material = materialOf(mapping.toObject()["material"].toInt());
+        foreach (const QJsonValue& variant, mapping.toObject()["variants"].toArray()) {
+          if (variant.toInt() >= 0 && variant.toInt() < face.materials.size()) {
+            face.materials[variant.toInt()] = material;
+          }
+        }
+      }
+
+      face.twoSided = false;
+      face.zBias = false;
+      face.hasCull = false;
+
+      auto addFace = [&](int type, std::initializer_list<int> vertices) {
+        face.type = type;
+        face.indices.clear();
+        for (int vertex : vertices) {
+          face.indices.append(base + indices[vertex]);
+        }
+        mesh.faces.append(face);
+      };
+
+      int n = indices.size();
+      switch (primitive["mode"].toInt(MODE_TRIANGLES)) {
+        case MODE_POINTS:
+          for (int i = 0; i < n; i++) addFace(PRIM_TYPE_PARTICLE, { i });
+          break;
+
+        case MODE_LINES:
+          for (int i = 0; i + 1 < n; i += 2) addFace(PRIM_TYPE_LINE, { i, i + 1 });
+          break;
+
+        case MODE_LINE_LOOP:
+          if (n > 2) addFace(PRIM_TYPE_LINE, { n - 1, 0 });
+          // Fall through.
+        case MODE_LINE_STRIP:
+          for (int i = 0; i + 1 < n; i++) addFace(PRIM_TYPE_LINE, { i, i + 1 });
+          break;
+
+        case MODE_TRIANGLES:
+          for (int i = 0; i + 2 < n; i += 3) addFace(3, { i, i + 1, i + 2 });
+          break;
+
+        case MODE_TRI_STRIP:
+          for (int i = 0; i + 2 < n; i++) {
+            if (i & 1) addFace(3, { i + 1, i, i + 2 });
+            else addFace(3, { i, i + 1, i + 2 });
+          }
+          break;
+
+        case MODE_TRI_FAN:
+          for (int i = 1; i + 1 < n; i++) addFace(3, { 0, i, i + 1 });
+          break;
+
+        default:
+          throw tr("Unsupported primitive mode %1.").arg(primitive["mode"].toInt());
+      }
+    }
+  }
+
+  return mesh;
+}
+
+const char* ShapeIO::accessorData(const QJsonObject& json, const QByteArray& bin, int accessor, int& count, int& stride, int& componentType)
+{
+  QJsonArray accessors = json["accessors"].toArray();
+  if (accessor < 0 || accessor >= accessors.size()) {
+    throw tr("Missing accessor %1.").arg(accessor);
+  }
+
+  QJsonObject accessorObject = accessors[accessor].toObject();
+  QJsonArray bufferViews = json["bufferViews"].toArray();
+  int view = accessorObject["bufferView"].toInt(-1);
+  if (view < 0 || view >= bufferViews.size()) {
+    throw tr("Missing buffer view for accessor %1.").arg(accessor);
+  }
+
+  QJsonObject viewObject = bufferViews[view].toObject();
+  if (viewObject["buffer"].toInt() != 0 || json["buffers"].toArray()[0].toObject().contains("uri")) {
+    throw tr("External buffers are not supported.");
+  }
+
+  componentType = accessorObject["componentType"].toInt();
+  count = accessorObject["count"].toInt();
+
+  int componentSize = componentType == COMPONENT_UBYTE ? 1 : componentType == COMPONENT_USHORT ? 2 : 4;
+  QString type = accessorObject["type"].toString();
+  int components = type == "VEC2" ? 2 : type == "VEC3" ? 3 : type == "VEC4" ? 4 : 1;
+  int elementSize = componentSize * components;
+
+  stride = viewObject["byteStride"].toInt(elementSize);
+
+  qint64 viewOffset = viewObject["byteOffset"].toInt();
+  qint64 viewLength = viewObject["byteLength"].toInt();
+  qint64 offset = accessorObject["byteOffset"].toInt();
+
+  if (count < 0 || viewOffset + viewLength > bin.size() ||
+      (count && offset + (qint64)stride * (count - 1) + elementSize > viewLength)) {
+    throw tr("Accessor %1 exceeds buffer bounds.").arg(accessor);
+  }
+
+  return bin.constData() + viewOffset + offset;
+}
+
+// Only float vectors of three are read, anything else would be read past the
+// end of its elements.
+QVector<QVector3D> ShapeIO::readPositions(const QJsonObject& json, const QByteArray& bin, int accessor)
+{
+  int count, stride, componentType;
+  const char* src = accessorData(json, bin, accessor, count, stride, componentType);
+
+  if (componentType != COMPONENT_FLOAT || json["accessors"].toArray()[accessor].toObject()["type"].toString() != "VEC3") {
+    throw tr("Vertex positions must be float VEC3.");
+  }
+
+  QVector<QVector3D> positions(count);
+  for (int i = 0; i < count; i++, src += stride) {
+    positions[i] = QVector3D(getFloat(src), getFloat(src + 4), getFloat(src + 8));
+  }
+
+  return positions;
+}
+
+QVector<int> ShapeIO::readIndices(const QJsonObject& json, const QByteArray& bin, int accessor)
+{
+  int count, stride, componentType;
+  const char* src = accessorData(json, bin, accessor, count, stride, componentType);
+
+  QVector<int> indices(count);
+  for (int i = 0; i < count; i++, src += stride) {
+    switch (componentType) {
+      case COMPONENT_UBYTE:
+        indices[i] = (quint8)*src;
+        break;
+
+      case COMPONENT_USHORT:
+        indices[i] = qFromLittleEndian<quint16>(src);
+        break;
+
+      case COMPONENT_UINT:
+        indices[i] = qMin(qFromLittleEndian<quint32>(src), (quint32)INT_MAX);
+        break;
+
+      default:
+        throw tr("Invalid index component type %1.").arg(componentType);
+    }
+  }
+
+  return indices;
+}
+
+// The cull words are a property of every face, so they are only written if
+// all faces have them. The header is filled in one pass, so markers in the
+// name are left alone.
+QByteArray ShapeIO::writePly(const Mesh& mesh, const QString& name)
+{
+  bool hasCull = !mesh.faces.isEmpty();
+  foreach (const MeshFace& face, mesh.faces) {
+    hasCull = hasCull && face.hasCull;
+  }
+
+  QByteArray header = QString(
+      "ply\n"
+      "format binary_little_endian 1.0\n"
+      "comment %1 %2\n"
+      "comment %3\n"
+      "element vertex %4\n"
+      "property float x\n"
+      "property float y\n"
+      "property float z\n"
+      "element face %5\n"
+      "property list uchar int vertex_indices\n"
+      "property uchar stunts_type\n"
+      "property uchar stunts_flags\n"
+      "%6"
+      "property list uchar uchar stunts_materials\n"
+      "end_header\n")
+    .arg(Settings::APP_NAME, Settings::APP_VER, name,
+        QString::number(mesh.positions.size()),
+        QString::number(mesh.faces.size()),
+        hasCull ? "property uint stunts_cull1\nproperty uint stunts_cull2\n" : "")
+    .toLatin1();
+
+  int size = header.size() + mesh.positions.size() * 12;
+  foreach (const MeshFace& face, mesh.faces) {
+    size += 1 + face.indices.size() * 4 + 1 + 1 + (hasCull ? 8 : 0) + 1 + face.materials.size();
+  }
+
+  QByteArray out(size, Qt::Uninitialized);
+  char* dst = out.data();
+
+  memcpy(dst, header.constData(), header.size());
+  dst += header.size();
+
+  foreach (const QVector3D& position, mesh.positions) {
+    putFloat(dst, position.x());
+    putFloat(dst + 4, position.y());
+    putFloat(dst + 8, position.z());
+    dst += 12;
+  }
+
+  foreach (const MeshFace& face, mesh.faces) {
+    *dst++ = (char)face.indices.size();
+    foreach (int index, face.indices) {
+      qToLittleEndian((qint32)index, dst);
+      dst += 4;
+    }
+
+    *dst++ = (char)face.type;
+    *dst++ = (char)((face.twoSided ? PRIM_FLAG_TWOSIDED : 0) | (face.zBias ? PRIM_FLAG_ZBIAS : 0));
+    if (hasCull) {
+      qToLittleEndian(face.cull1, dst);
+      qToLittleEndian(face.cull2, dst + 4);
+      dst += 8;
+    }
+
+    *dst++ = (char)face.materials.size();
+    foreach (quint8 material, face.materials) {
+      *dst++ = (char)material;
+    }
+  }
+
+  return out;
+}
+
+Mesh ShapeIO::readPly(const QByteArray& data)
+{
+  if (!data.startsWith("ply\n") && !data.startsWith("ply\r\n")) {
+    throw tr("Not a PLY file.");
+  }
+
+  int headerEnd = data.indexOf("end_header");
+  if (headerEnd < 0 || (headerEnd = data.indexOf('\n', headerEnd)) < 0) {
+    throw tr("Missing end of PLY header.");
+  }
+
+  QList<PlyElement> elements;
+
+  foreach (const QByteArray& line, data.left(headerEnd).split('\n')) {
+    QList<QByteArray> tokens = line.simplified().split(' ');
+
+    if (tokens[0] == "format") {
+      if (tokens.value(1) != "binary_little_endian") {
+        throw tr("Unsupported PLY format \"%1\", only binary_little_endian is supported.").arg(QString(tokens.value(1)));
+      }
+    }
+    else if (tokens[0] == "element" && tokens.size() == 3) {
+      PlyElement element;
+      element.name = tokens[1];
+      element.count = tokens[2].toInt();
+      elements.append(element);
+    }
+    else if (tokens[0] == "property" && !elements.isEmpty()) {
+      PlyProperty property;
+      if (tokens.value(1) == "list" && tokens.size() == 5) {
+        property.countType = plyType(tokens[2]);
+        property.type = plyType(tokens[3]);
+        property.name = tokens[4];
+      }
+      else if (tokens.size() == 3) {
+        property.countType = PLY_NONE;
+        property.type = plyType(tokens[1]);
+        property.name = tokens[2];
+      }
+      else {
+        throw tr("Invalid PLY property \"%1\".").arg(QString(line));
+      }
+
+      if (property.type == PLY_NONE || (tokens.value(1) == "list" && property.countType == PLY_NONE)) {
+        throw tr("Unknown type in PLY property \"%1\".").arg(QString(line));
+      }
+
+      elements.last().properties.append(property);
+    }
+  }
+
+  Mesh mesh;
+  const char* src = data.constData() + headerEnd + 1;
+  const char* end = data.constData() + data.size();
+
+  foreach (const PlyElement& element, elements) {
+    bool isVertex = element.name == "vertex";
+    bool isFace = element.name == "face";
+
+    // Our own vertex layout is read straight from the buffer.
+    bool packed = isVertex && element.properties.size() == 3;
+    for (int i = 0; packed && i < 3; i++) {
+      packed = element.properties[i].countType == PLY_NONE && element.properties[i].type == PLY_FLOAT32 &&
+               element.properties[i].name == QByteArray(1, "xyz"[i]);
+    }
+
+    if (packed) {
+      if (end - src < (qint64)element.count * 12) {
+        throw tr("Unexpected end of file in element \"%1\".").arg(QString(element.name));
+      }
+
+      mesh.positions.resize(element.count);
+      for (int i = 0; i < element.count; i++, src += 12) {
+        mesh.positions[i] = QVector3D(getFloat(src), getFloat(src + 4), getFloat(src + 8));
+      }
+      continue;
+    }
+
+    for (int i = 0; i < element.count; i++) {
+      QVector3D position;
+      MeshFace face;
+      bool hasType = false;
+
+      face.twoSided = false;
+      face.zBias = false;
+      face.hasCull = false;
+      face.cull1 = face.cull2 = 0;
+
+      foreach (const PlyProperty& property, element.properties) {
+        int count = 1;
+
+        if (property.countType != PLY_NONE) {
+          if (end - src < plyTypeSize(property.countType)) {
+            throw tr("Unexpected end of file in element \"%1\".").arg(QString(element.name));
+          }
+          count = (int)plyValue(src, property.countType);
+          src += plyTypeSize(property.countType);
+        }
+
+        int size = plyTypeSize(property.type);
+        if (count < 0 || end - src < (qint64)count * size) {
+          throw tr("Unexpected end of file in element \"%1\".").arg(QString(element.name));
+        }
+
+        if (isVertex && property.countType == PLY_NONE) {
+          if (property.name == "x") position.setX(plyValue(src, property.type));
+          else if (property.name == "y") position.setY(plyValue(src, property.type));
+          else if (property.name == "z") position.setZ(plyValue(src, property.type));
+        }
+        else if (isFace) {
+          if (property.name == "vertex_indices" || property.name == "vertex_index") {
+            for (int j = 0; j < count; j++) {
+              face.indices.append((int)plyValue(src + j * size, property.type));
+            }
+          }
+          else if (property.name == "stunts_materials") {
+            for (int j = 0; j < count; j++) {
+              face.materials.append((quint8)plyValue(src + j * size, property.type));
+            }
+          }
+          else if (property.name == "stunts_type") {
+            face.type = (quint8)plyValue(src, property.type);
+            hasType = true;
+          }
+          else if (property.name == "stunts_flags") {
+            quint8 flags = (quint8)plyValue(src, property.type);
+            face.twoSided = flags & PRIM_FLAG_TWOSIDED;
+            face.zBias = flags & PRIM_FLAG_ZBIAS;
+          }
+          else if (property.name == "stunts_cull1") {
+            face.cull1 = (quint32)plyValue(src, property.type);
+            face.hasCull = true;
+          }
+          else if (property.name == "stunts_cull2") {
+            face.cull2 = (quint32)plyValue(src, property.type);
+          }
+        }
+
+        src += count * size;
+      }
+
+      if (isVertex) {
+        mesh.positions.append(position);
+      }
+      else if (isFace && !face.indices.isEmpty()) {
+        if (hasType) {
+          int verticesNeeded;
+          if (!VerticesModel::verticesNeeded(face.type, verticesNeeded) || face.indices.size() != verticesNeeded) {
+            throw tr("Unknown type (%1) for primitive %2.").arg(face.type).arg(i);
+          }
+        }
+        else {
+          face.type = face.indices.size() > 10 ? 0 : face.indices.size();
+        }
+
+        if (face.materials.isEmpty()) {
+          face.materials.append(0);
+        }
+
+        mesh.faces.append(face);
+      }
+    }
+  }
+
+  foreach (const MeshFace& face, mesh.faces) {
+    foreach (int index, face.indices) {
+      if (index < 0 || index >= mesh.positions.size()) {
+        throw tr("Vertex index %1 out of bounds (0 - %2).").arg(index).arg(mesh.positions.size() - 1);
+      }
+    }
+  }
+
+  return mesh;
+}
+
+ShapeIO::PlyType ShapeIO::plyType(const QByteArray& name)
+{
+  if (name == "char" || name == "int8") return PLY_INT8;
+  if (name == "uchar" || name == "uint8") return PLY_UINT8;
+  if (name == "short" || name == "int16") return PLY_INT16;
+  if (name == "ushort" || name == "uint16") return PLY_UINT16;
+  if (name == "int" || name == "int32") return PLY_INT32;
+  if (name == "uint" || name == "uint32") return PLY_UINT32;
+  if (name == "float" || name == "float32") return PLY_FLOAT32;
+  if (name == "double" || name == "float64") return PLY_FLOAT64;
+  return PLY_NONE;
+}
+
+int ShapeIO::plyTypeSize(int type)
+{
+  switch (type) {
+    case PLY_INT8:
+    case PLY_UINT8:
+      return 1;
+
+    case PLY_INT16:
+    case PLY_UINT16:
+      return 2;
+
+    case PLY_FLOAT64:
+      return 8;
+
+    default:
+      return 4;
+  }
+}
+
+double ShapeIO::plyValue(const char* data, int type)
+{
+  switch (type) {
+    case PLY_INT8:    return (qint8)*data;
+    case PLY_UINT8:   return (quint8)*data;
+    case PLY_INT16:   return qFromLittleEndian<qint16>(data);
+    case PLY_UINT16:  return qFromLittleEndian<quint16>(data);
+    case PLY_INT32:   return qFromLittleEndian<qint32>(data);
+    case PLY_UINT32:  return qFromLittleEndian<quint32>(data);
+    case PLY_FLOAT32: return getFloat(data);
+    case PLY_FLOAT64: {
+      quint64 bits = qFromLittleEndian<quint64>(data);
+      double value;
+      memcpy(&value, &bits, sizeof(value));
+      return value;
+    }
+    default:          return 0.0;
+  }
+}
+
+ShapeExportTask::ShapeExportTask(const Mesh& mesh, const QString& name, const QString& title, const QString& filePath, const QString& mtlLib, QStringList* errors, QMutex* mutex)
+: m_mesh(mesh),
+  m_name(name),
+  m_title(title),
+  m_filePath(filePath),
+  m_mtlLib(mtlLib),
+  m_errors(errors),
+  m_mutex(mutex)
+{
+}
+
+void ShapeExportTask::run()
+{
+  QString suffix = QFileInfo(m_filePath).suffix().toLower();
+
+  try {
+    QByteArray data;
+    if (suffix == "glb") {
+      data = ShapeIO::writeGlb(m_mesh, m_name);
+    }
+    else if (suffix == "ply") {
+      data = ShapeIO::writePly(m_mesh, m_name);
+    }
+    else {
+      data = ShapeIO::writeObj(m_mesh, -1, m_title, m_mtlLib);
+    }
+
+    QFile file(m_filePath);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+      throw ShapeIO::tr("Couldn't open file for writing.");
+    }
+
+    if (file.write(data) != data.size()) {
+      throw ShapeIO::tr("Couldn't write to file.");
+    }
+  }
+  catch (QString msg) {
+    QMutexLocker locker(m_mutex);
+    m_errors->append(QString("%1: %2").arg(m_name, msg));
+  }
+}
@@ -0,0 +1,96 @@
+#pragma once
+
+#include <QByteArray>
+#include <QCoreApplication>
+#include <QJsonObject>
+#include <QRunnable>
+#include <QStringList>
+
+#include "types.h"
+
+class QMutex;
+
+// Binary interchange formats for shapes. Meshes are written with the raw
+// Stunts coordinates, like the OBJ export. Primitive types, flags, culling
+// data and all paint-jobs are stored alongside the geometry so that files
+// written here import without loss.
+class ShapeIO
+{
+  Q_DECLARE_TR_FUNCTIONS(ShapeIO)
+
+public:
+  static QByteArray writeObj(const Mesh& mesh, int paintJob, const QString& title, const QString& mtlLib);
+  static Mesh       readObj(const QByteArray& data);
+
+  static QByteArray writeGlb(const Mesh& mesh, const QString& name);
+  static Mesh       readGlb(const QByteArray& data);
+
+  static QByteArray writePly(const Mesh& mesh, const QString& name);
+  static Mesh       readPly(const QByteArray& data);
+
+private:
+  enum PlyType { PLY_NONE, PLY_INT8, PLY_UINT8, PLY_INT16, PLY_UINT16, PLY_INT32, PLY_UINT32, PLY_FLOAT32, PLY_FLOAT64 };
+
+  typedef struct {
+    QByteArray name;
+    int        type;
+    int        countType;
+  } PlyProperty;
+
+  typedef struct {
+    QByteArray          name;
+    int                 count;
+    QList<PlyProperty>  properties;
+  } PlyElement;
+
+  static char*        putNumber(char* dst, qint64 value, int width, int decimals = 0);
+  static const char*  accessorData(const QJsonObject& json, const QByteArray& bin, int accessor, int& count, int& stride, int& componentType);
+  static QVector<QVector3D> readPositions(const QJsonObject& json, const QByteArray& bin, int accessor);
+  static QVector<int> readIndices(const QJsonObject& json, const QByteArray& bin, int accessor);
+  static PlyType      plyType(const QByteArray& name);
+  static int          plyTypeSize(int type);
+  static double       plyValue(const char* data, int type);
+
+  static const quint32 GLB_MAGIC      = 0x46546C67;
+  static const quint32 GLB_VERSION    = 2;
+  static const quint32 GLB_CHUNK_JSON = 0x4E4F534A;
+  static const quint32 GLB_CHUNK_BIN  = 0x004E4942;
+
+  static const int    MODE_POINTS       = 0;
+  static const int    MODE_LINES        = 1;
+  static const int    MODE_LINE_LOOP    = 2;
+  static const int    MODE_LINE_STRIP   = 3;
+  static const int    MODE_TRIANGLES    = 4;
+  static const int    MODE_TRI_STRIP    = 5;
+  static const int    MODE_TRI_FAN      = 6;
+
+  static const int    COMPONENT_UBYTE   = 5121;
+  static const int    COMPONENT_USHORT  = 5123;
+  static const int    COMPONENT_UINT    = 5125;
+  static const int    COMPONENT_FLOAT   = 5126;
+
+  static const int    OBJ_NUMBER_MAX    = 24;
+
+  static const char   GLB_EXTRAS[];
+  static const char   GLB_VARIANTS[];
+  static const char   MATERIAL_NAME[];
+};
+
+// Serializes and writes one mesh with all paint-jobs, the file format is
+// picked from the suffix. Errors are collected in the shared list.
+class ShapeExportTask : public QRunnable
+{
+public:
+  ShapeExportTask(const Mesh& mesh, const QString& name, const QString& title, const QString& filePath, const QString& mtlLib, QStringList* errors, QMutex* mutex);
+
+  void              run();
+
+private:
+  Mesh              m_mesh;
+  QString           m_name;
+  QString           m_title;
+  QString           m_filePath;
+  QString           m_mtlLib;
+  QStringList*      m_errors;
+  QMutex*           m_mutex;
+};
@@ -619,6 +619,36 @@ void ShapeModel::replaceMaterials(quint8 paintJob, quint8 curMaterial, quint8 ne
   }
 }
 
+QList<MaterialsList> ShapeModel::materials() const
+{
+  QList<MaterialsList> materials;
+  foreach (const Primitive& primitive, m_primitives) {
+    materials.append(*primitive.materialsModel->materialsList());
+  }
+
+  return materials;
+}
+
+// Fails without changes if the primitives or paint jobs do not match.
+bool ShapeModel::setMaterials(const QList<MaterialsList>& materials)
+{
+  if (materials.size() != m_primitives.size()) {
+    return false;
+  }
+
+  for (int i = 0; i < m_primitives.size(); i++) {
+    if (materials[i].size() != m_primitives[i].materialsModel->rowCount()) {
+      return false;
+    }
+  }
+
+  for (int i = 0; i < m_primitives.size(); i++) {
+    m_primitives[i].materialsModel->setMaterials(materials[i]);
+  }
+
+  return true;
+}
+
 void ShapeModel::movePaintJobs(QItemSelectionModel* selectionModel, int direction)
 {
   // Using persistent indices since row removal/insertion will invalidate current selection.
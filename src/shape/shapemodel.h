@@ -69,6 +69,9 @@ public:
   bool              setNumPaintJobs(int& num);
   int               numPaintJobs() const                                             { return m_numPaintJobs; }
   void              replaceMaterials(quint8 paintJob, quint8 curMaterial, quint8 newMaterial);
+  // One list per primitive.
+  QList<MaterialsList> materials() const;
+  bool              setMaterials(const QList<MaterialsList>& materials);
   void              movePaintJobs(QItemSelectionModel* selectionModel, int direction);
 
   static const QStringList& TYPES();
@@ -0,0 +1,133 @@
+#include <QElapsedTimer>
+#include <QOffscreenSurface>
+#include <QOpenGLContext>
+#include <QOpenGLFramebufferObject>
+#include <QOpenGLFunctions>
+
+#include "shapeoffscreen.h"
+#include "shaperenderer.h"
+
+ShapeOffscreen::ShapeOffscreen(const QSize& size)
+: m_size(size),
+  m_surface(new QOffscreenSurface()),
+  m_context(new QOpenGLContext()),
+  m_framebuffer(0),
+  m_renderer(0)
+{
+  m_surface->setFormat(ShapeRenderer::format());
+  m_surface->create();
+
+  m_context->setFormat(ShapeRenderer::format());
+
+  if (!m_context->create() || !m_context->makeCurrent(m_surface)) {
+    m_log = tr("Could not create an OpenGL context.");
+    return;
+  }
+
+  m_framebuffer = new QOpenGLFramebufferObject(m_size, QOpenGLFramebufferObject::Depth);
+  m_renderer = new ShapeRenderer();
+
+  if (!m_renderer->initialize()) {
+    m_log = m_renderer->log();
+  }
+
+  m_context->doneCurrent();
+}
+
+ShapeOffscreen::~ShapeOffscreen()
+{
+  if (m_context->makeCurrent(m_surface)) {
+    if (m_renderer) {
+      m_renderer->destroy();
+    }
+    delete m_framebuffer;
+    m_context->doneCurrent();
+  }
+
+  delete m_renderer;
+  delete m_context;
+  delete m_surface;
+}
+
+bool ShapeOffscreen::isValid() const
+{
+  return m_renderer && m_renderer->isInitialized();
+}
+
+// The context is never current between calls, so only the thread affinity of
+// it and the renderer needs to follow.
+void ShapeOffscreen::moveToThread(QThread* thread)
+{
+  m_context->moveToThread(thread);
+  if (m_renderer) {
+    m_renderer->moveToThread(thread);
+  }
+}
+
+QImage ShapeOffscreen::render(ShapeModel* model, int paintJob, float angle)
+{
+  if (!begin(model)) {
+    return QImage();
+  }
+
+  QMatrix4x4 translation, rotation;
+  ShapeRenderer::frame(model, translation, rotation);
+  rotation.rotate(angle, 0.0f, 1.0f, 0.0f);
+
+  m_renderer->render(ShapeRenderer::projection(m_size), translation * rotation, paintJob);
+
+  QImage image = m_framebuffer->toImage();
+  end();
+
+  return image;
+}
+
+// Average milliseconds per frame over one turn of the shape. The first frame
+// uploads the geometry and is not counted.
+double ShapeOffscreen::benchmark(ShapeModel* model, int frames)
+{
+  if (frames <= 0 || !begin(model)) {
+    return 0.0;
+  }
+
+  QMatrix4x4 projection = ShapeRenderer::projection(m_size);
+  QMatrix4x4 translation, rotation;
+  ShapeRenderer::frame(model, translation, rotation);
+
+  m_renderer->render(projection, translation * rotation, 0);
+  m_context->functions()->glFinish();
+
+  QElapsedTimer timer;
+  timer.start();
+
+  for (int i = 0; i < frames; i++) {
+    rotation.rotate(360.0f / frames, 0.0f, 1.0f, 0.0f);
+    m_renderer->render(projection, translation * rotation, 0);
+    m_context->functions()->glFinish();
+  }
+
+  double elapsed = timer.nsecsElapsed() / 1000000.0;
+  end();
+
+  return elapsed / frames;
+}
+
+bool ShapeOffscreen::begin(ShapeModel* model)
+{
+  if (!isValid() || !m_context->makeCurrent(m_surface)) {
+    return false;
+  }
+
+  m_framebuffer->bind();
+  m_context->functions()->glViewport(0, 0, m_size.width(), m_size.height());
+  m_renderer->setModel(model);
+
+  return true;
+}
+
+void ShapeOffscreen::end()
+{
+  m_renderer->setModel(0);
+  m_framebuffer->release();
+  m_context->doneCurrent();
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <QCoreApplication>
+#include <QImage>
+#include <QSize>
+
+class QOffscreenSurface;
+class QOpenGLContext;
+class QOpenGLFramebufferObject;
+class QThread;
+class ShapeModel;
+class ShapeRenderer;
+
+// Renders shapes into a framebuffer object on an offscreen surface. Needs no
+// window or GPU, Mesa llvmpipe with the offscreen platform plugin is enough.
+// Must be created and destroyed on the GUI thread. In between it can be
+// handed to a worker thread with moveToThread(), and back again from there.
+class ShapeOffscreen
+{
+  Q_DECLARE_TR_FUNCTIONS(ShapeOffscreen)
+
+public:
+  ShapeOffscreen(const QSize& size);
+  ~ShapeOffscreen();
+
+  bool              isValid() const;
+  QString           log() const        { return m_log; }
+  void              moveToThread(QThread* thread);
+
+  QImage            render(ShapeModel* model, int paintJob = 0, float angle = 0.0f);
+  double            benchmark(ShapeModel* model, int frames);
+
+private:
+  bool              begin(ShapeModel* model);
+  void              end();
+
+  QSize             m_size;
+  QOffscreenSurface* m_surface;
+  QOpenGLContext*   m_context;
+  QOpenGLFramebufferObject* m_framebuffer;
+  ShapeRenderer*    m_renderer;
+  QString           m_log;
+};
@@ -0,0 +1,424 @@
+#include <QVarLengthArray>
+
+#include <math.h>
+#include <string.h>
+
+#include "app/settings.h"
+#include "materialsmodel.h"
+#include "shapemodel.h"
+#include "shaperasterizer.h"
+#include "shaperenderer.h"
+#include "verticesmodel.h"
+
+const float ShapeRasterizer::NEAR_PLANE = 0.1f;
+const float ShapeRasterizer::STEEP_ANGLE = 45.0f;
+const double ShapeRasterizer::PI = 3.14159265358979323846;
+
+ShapeRasterizer::ShapeRasterizer()
+: m_image(WIDTH, HEIGHT, QImage::Format_Indexed8),
+  m_color(0),
+  m_colorWord(0),
+  m_pattern(0)
+{
+  m_cullView.steep = false;
+  m_cullView.mask = 0;
+
+  // Byte masks for eight stipple bits at a time, leftmost pixel first in
+  // memory whatever the byte order.
+  for (int i = 0; i < 256; i++) {
+    quint8 bytes[8];
+    for (int j = 0; j < 8; j++) {
+      bytes[j] = (i & (0x80 >> j)) ? 0xFF : 0x00;
+    }
+    memcpy(&m_stippleMasks[i], bytes, sizeof(bytes));
+  }
+}
+
+// The game's 4:3 view on the 320x200 screen.
+QMatrix4x4 ShapeRasterizer::projection()
+{
+  return ShapeRenderer::projection(QSize(4, 3));
+}
+
+QImage ShapeRasterizer::render(ShapeModel* model, const QMatrix4x4& projection, const QMatrix4x4& modelView, int paintJob)
+{
+  QVector<QRgb> colors = Settings::m_loadedPalette;
+  colors.resize(256);
+  m_image.setColorTable(colors);
+
+  // Clear to the palette entry closest to white, like the GL view.
+  int background = 0;
+  for (int i = 0, best = -1; i < colors.size(); i++) {
+    int value = qRed(colors[i]) + qGreen(colors[i]) + qBlue(colors[i]);
+    if (value > best) {
+      best = value;
+      background = i;
+    }
+  }
+  m_image.fill(background);
+
+  if (!model || model->primitivesList()->isEmpty()) {
+    return m_image;
+  }
+
+  m_projection = projection;
+
+  m_cullView = cullView(modelView);
+
+  for (int pass = 0; pass < 2; pass++) {
+    foreach (const Primitive& primitive, *model->primitivesList()) {
+      if (primitive.zBias != (pass == 1) || !isVisible(primitive, m_cullView)) {
+        continue;
+      }
+
+      const VerticesFList& v = *primitive.verticesModel->verticesFList();
+
+      int verticesNeeded;
+      if (!VerticesModel::verticesNeeded(primitive.type, verticesNeeded) || v.size() < verticesNeeded) {
+        continue;
+      }
+
+      int material = primitive.materialsModel->materialsList()->value(paintJob);
+
+      QVarLengthArray<QVector3D, 16> eye;
+      foreach (const VertexF& vertex, v) {
+        eye.append(modelView.map(vertex.toQ()));
+      }
+
+      if (primitive.type == PRIM_TYPE_PARTICLE) {
+        setMaterial(material, false);
+        drawPoint(eye[0]);
+      }
+      else if (primitive.type == PRIM_TYPE_LINE) {
+        setMaterial(material, false);
+        drawLine(eye[0], eye[1]);
+      }
+      else if (primitive.type > PRIM_TYPE_LINE && primitive.type < PRIM_TYPE_SPHERE) { // Polygon
+        setMaterial(material, true);
+        drawPolygon(eye.constData(), eye.size(), false);
+      }
+      else if (primitive.type == PRIM_TYPE_SPHERE) {
+        setMaterial(material, true);
+        drawEllipse(eye[0], (v[1].toQ() - v[0].toQ()).length() * ShapeRenderer::SPHERE_RADIUS_RATIO);
+      }
+      else if (primitive.type == PRIM_TYPE_WHEEL) {
+        QVector<QVector3D> positions;
+        QVector<quint32> parts[3];
+        ShapeRenderer::wheel(v, CIRCLE_STEPS, positions, parts);
+
+        for (int i = 0; i < positions.size(); i++) {
+          positions[i] = modelView.map(positions[i]);
+        }
+
+        // Without a depth buffer the wheel relies on back-face culling.
+        for (int i = 0; i < 3; i++) {
+          setMaterial(qMin(material + i, (int)MaterialsModel::VAL_MAX), true);
+
+          for (int j = 0; j + 2 < parts[i].size(); j += 3) {
+            QVector3D triangle[3] = { positions[parts[i][j]], positions[parts[i][j + 1]], positions[parts[i][j + 2]] };
+            drawPolygon(triangle, 3, true);
+          }
+        }
+      }
+    }
+  }
+
+  return m_image;
+}
+
+// The camera heading around the shape origin picks the sector bit of the
+// half above or below it, the elevation picks the word.
+ShapeRasterizer::CullView ShapeRasterizer::cullView(const QMatrix4x4& modelView)
+{
+  // Camera position in the game's coordinates.
+  QVector3D camera = modelView.inverted().map(QVector3D());
+  float x = camera.x();
+  float y = camera.y() / VerticesModel::Y_RATIO;
+  float z = -camera.z();
+
+  int sector = ((int)(((PI + atan2(x, z)) / (2.0 * PI)) * CULL_SECTORS + 0.5) + CULL_SECTOR_OFFSET) % CULL_SECTORS;
+  bool above = y >= 0.0f;
+
+  CullView view;
+  view.steep = fabs(atan2(y, sqrt(x * x + z * z))) * (180.0 / PI) >= STEEP_ANGLE;
+  view.mask = above ?
+      PRIM_CULL_POS_FLAG | (1u << (sector + PRIM_CULL_POS_SHIFT)) :
+      PRIM_CULL_NEG_FLAG | (1u << (sector + PRIM_CULL_NEG_SHIFT));
+
+  return view;
+}
+
+bool ShapeRasterizer::isVisible(const Primitive& primitive, const CullView& view)
+{
+  return view.steep ? (primitive.cull2 & view.mask) != 0 : (primitive.cull1 & view.mask) == view.mask;
+}
+
+// Tests words stored contiguously, one byte out per primitive. The loops have
+// no branches so the compiler can vectorise them.
+void ShapeRasterizer::cullVisible(const quint32* cull1, const quint32* cull2, int count, const CullView& view, quint8* visible)
+{
+  const quint32 mask = view.mask;
+
+  if (view.steep) {
+    for (int i = 0; i < count; i++) {
+      visible[i] = (cull2[i] & mask) != 0;
+    }
+  }
+  else {
+    for (int i = 0; i < count; i++) {
+      visible[i] = (cull1[i] & mask) == mask;
+    }
+  }
+}
+
+// Stipple only applies to filled primitives, like in the GL view.
+void ShapeRasterizer::setMaterial(int material, bool filled)
+{
+  Material properties = Settings::m_loadedMaterials.value(material);
+
+  m_color = (quint8)properties.color;
+  m_colorWord = m_color * Q_UINT64_C(0x0101010101010101);
+  m_pattern = (filled && properties.pattern > 0 && properties.pattern <= 6) ? ShapeRenderer::PATTERNS[properties.pattern - 1] : 0;
+}
+
+bool ShapeRasterizer::project(const QVector3D& eye, Point& point) const
+{
+  QVector4D clip = m_projection * QVector4D(eye, 1.0f);
+  if (clip.w() <= 0.0f) {
+    return false;
+  }
+
+  point.x = (clip.x() / clip.w() + 1.0f) * (WIDTH / 2.0f);
+  point.y = (1.0f - clip.y() / clip.w()) * (HEIGHT / 2.0f);
+
+  return true;
+}
+
+void ShapeRasterizer::drawPoint(const QVector3D& eye)
+{
+  Point point;
+  if (eye.z() <= -NEAR_PLANE && project(eye, point)) {
+    plot((int)floor(point.x), (int)floor(point.y));
+  }
+}
+
+void ShapeRasterizer::drawLine(QVector3D a, QVector3D b)
+{
+  bool aIn = a.z() <= -NEAR_PLANE;
+  bool bIn = b.z() <= -NEAR_PLANE;
+
+  if (!aIn && !bIn) {
+    return;
+  }
+  else if (!aIn) {
+    a += (b - a) * ((-NEAR_PLANE - a.z()) / (b.z() - a.z()));
+  }
+  else if (!bIn) {
+    b += (a - b) * ((-NEAR_PLANE - b.z()) / (a.z() - b.z()));
+  }
+
+  Point p0, p1;
+  if (!project(a, p0) || !project(b, p1)) {
+    return;
+  }
+
+  // Liang-Barsky clip to the screen, then step one pixel at a time.
+  float dx = p1.x - p0.x, dy = p1.y - p0.y;
+  float t0 = 0.0f, t1 = 1.0f;
+
+  auto clip = [&t0, &t1](float p, float q) -> bool {
+    if (p == 0.0f) {
+      return q >= 0.0f;
+    }
+
+    float r = q / p;
+    if (p < 0.0f) {
+      if (r > t1) {
+        return false;
+      }
+      t0 = qMax(t0, r);
+    }
+    else {
+      if (r < t0) {
+        return false;
+      }
+      t1 = qMin(t1, r);
+    }
+
+    return true;
+  };
+
+  if (!clip(-dx, p0.x) || !clip(dx, WIDTH - p0.x) || !clip(-dy, p0.y) || !clip(dy, HEIGHT - p0.y)) {
+    return;
+  }
+
+  float x = p0.x + dx * t0, y = p0.y + dy * t0;
+  dx *= t1 - t0;
+  dy *= t1 - t0;
+
+  int steps = qMax(1, (int)ceil(qMax(fabs(dx), fabs(dy))));
+  for (int i = 0; i <= steps; i++) {
+    plot((int)floor(x + dx * i / steps), (int)floor(y + dy * i / steps));
+  }
+}
+
+// Convex polygon, clipped to the near plane and filled with the pixel centre
+// rule. Each edge widens the span of the rows it crosses.
+void ShapeRasterizer::drawPolygon(const QVector3D* eye, int count, bool cullBack)
+{
+  QVarLengthArray<Point, 16> points;
+
+  for (int i = 0; i < count; i++) {
+    const QVector3D& current = eye[i];
+    const QVector3D& next = eye[(i + 1) % count];
+    bool currentIn = current.z() <= -NEAR_PLANE;
+    bool nextIn = next.z() <= -NEAR_PLANE;
+
+    Point point;
+    if (currentIn && project(current, point)) {
+      points.append(point);
+    }
+
+    if (currentIn != nextIn) {
+      float t = (-NEAR_PLANE - current.z()) / (next.z() - current.z());
+      if (project(current + (next - current) * t, point)) {
+        points.append(point);
+      }
+    }
+  }
+
+  if (points.size() < 3) {
+    return;
+  }
+
+  // Counter-clockwise front faces as in GL, clockwise with y pointing down.
+  if (cullBack) {
+    float area = 0.0f;
+    for (int i = 0; i < points.size(); i++) {
+      const Point& p0 = points[i];
+      const Point& p1 = points[(i + 1) % points.size()];
+      area += p0.x * p1.y - p1.x * p0.y;
+    }
+
+    if (area >= 0.0f) {
+      return;
+    }
+  }
+
+  float minY = points[0].y, maxY = points[0].y;
+  for (int i = 1; i < points.size(); i++) {
+    minY = qMin(minY, points[i].y);
+    maxY = qMax(maxY, points[i].y);
+  }
+
+  int top = qMax(0, (int)ceil(qMax(-1.0f, minY) - 0.5f));
+  int bottom = qMin(HEIGHT - 1, (int)ceil(qMin(HEIGHT + 1.0f, maxY) - 0.5f) - 1);
+
+  for (int y = top; y <= bottom; y++) {
+    m_left[y] = INFINITY;
+    m_right[y] = -INFINITY;
+  }
+
+  for (int i = 0; i < points.size(); i++) {
+    Point a = points[i];
+    Point b = points[(i + 1) % points.size()];
+
+    if (a.y == b.y) {
+      continue;
+    }
+    else if (a.y > b.y) {
+      qSwap(a, b);
+    }
+
+    int first = qMax(top, (int)ceil(qMax(-1.0f, a.y) - 0.5f));
+    int last = qMin(bottom, (int)ceil(qMin(HEIGHT + 1.0f, b.y) - 0.5f) - 1);
+    float slope = (b.x - a.x) / (b.y - a.y);
+
+    for (int y = first; y <= last; y++) {
+      float x = a.x + (y + 0.5f - a.y) * slope;
+      m_left[y] = qMin(m_left[y], x);
+      m_right[y] = qMax(m_right[y], x);
+    }
+  }
+
+  for (int y = top; y <= bottom; y++) {
+    fillSpan(y, m_left[y], m_right[y]);
+  }
+}
+
+// Spheres face the camera, so they are ellipses on the non-square pixels.
+void ShapeRasterizer::drawEllipse(const QVector3D& center, float radius)
+{
+  Point point;
+  if (center.z() > -NEAR_PLANE || !project(center, point)) {
+    return;
+  }
+
+  float rx = radius * m_projection(0, 0) / -center.z() * (WIDTH / 2.0f);
+  float ry = radius * m_projection(1, 1) / -center.z() * (HEIGHT / 2.0f);
+
+  if (ry <= 0.0f) {
+    return;
+  }
+
+  int first = qMax(0, (int)ceil(qMax(-1.0f, point.y - ry) - 0.5f));
+  int last = qMin(HEIGHT - 1, (int)ceil(qMin(HEIGHT + 1.0f, point.y + ry) - 0.5f) - 1);
+
+  for (int y = first; y <= last; y++) {
+    float dy = (y + 0.5f - point.y) / ry;
+    if (dy > -1.0f && dy < 1.0f) {
+      float half = rx * sqrt(1.0f - dy * dy);
+      fillSpan(y, point.x - half, point.x + half);
+    }
+  }
+}
+
+// Solid spans are a memset. Stippled spans blend eight pixels per 64-bit word
+// with the mask of the matching pattern byte, the pattern repeats every 32
+// pixels so aligned words never straddle two pattern bytes.
+void ShapeRasterizer::fillSpan(int y, float left, float right)
+{
+  int x0 = qMax(0, (int)ceil(qMax(-1.0f, left) - 0.5f));
+  int x1 = qMin(WIDTH - 1, (int)ceil(qMin(WIDTH + 1.0f, right) - 0.5f) - 1);
+
+  if (x0 > x1) {
+    return;
+  }
+
+  quint8* row = m_image.scanLine(y);
+
+  if (!m_pattern) {
+    memset(row + x0, m_color, x1 - x0 + 1);
+    return;
+  }
+
+  const quint8* pattern = m_pattern + (y & 31) * 4;
+  int x = x0;
+
+  for (; x <= x1 && (x & 7); x++) {
+    if (pattern[(x & 31) >> 3] & (0x80 >> (x & 7))) {
+      row[x] = m_color;
+    }
+  }
+
+  for (; x + 7 <= x1; x += 8) {
+    quint64 mask = m_stippleMasks[pattern[(x & 31) >> 3]];
+    quint64 pixels;
+    memcpy(&pixels, row + x, sizeof(pixels));
+    pixels = (pixels & ~mask) | (m_colorWord & mask);
+    memcpy(row + x, &pixels, sizeof(pixels));
+  }
+
+  for (; x <= x1; x++) {
+    if (pattern[(x & 31) >> 3] & (0x80 >> (x & 7))) {
+      row[x] = m_color;
+    }
+  }
+}
+
+void ShapeRasterizer::plot(int x, int y)
+{
+  if (x >= 0 && x < WIDTH && y >= 0 && y < HEIGHT) {
+    m_image.scanLine(y)[x] = m_color;
+  }
+}
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <QImage>
+#include <QMatrix4x4>
+#include <QVector>
+
+#include "types.h"
+
+class ShapeModel;
+
+// Draws shapes on the CPU the way the game does, into a 320x200 image indexed
+// by the loaded VGA palette. There is no depth buffer: primitives are painted
+// in model order, z-biased ones last, and hidden by the cull words instead.
+// Needs no GL context, so it can run headless and on any thread.
+//
+// The cull words are read as computeCull() writes them. The camera heading
+// around the shape origin picks one of 15 sectors. Word 1 applies while the
+// camera is less than 45 degrees above or below the origin, word 2 otherwise,
+// and the sign of the elevation picks the + or - half. In word 1 the half's
+// flag must be set and its sector bit too. In word 2 the flag alone makes the
+// primitive visible from every heading, else the sector bit decides.
+class ShapeRasterizer
+{
+public:
+  ShapeRasterizer();
+
+  // The bits a cull word is tested with from one camera position. Word 1
+  // needs all of them set, word 2 any of them.
+  typedef struct {
+    bool            steep;
+    quint32         mask;
+  } CullView;
+
+  QImage            render(ShapeModel* model, const QMatrix4x4& projection, const QMatrix4x4& modelView, int paintJob = 0);
+
+  static QMatrix4x4 projection();
+  static CullView   cullView(const QMatrix4x4& modelView);
+  static bool       isVisible(const Primitive& primitive, const CullView& view);
+  static void       cullVisible(const quint32* cull1, const quint32* cull2, int count, const CullView& view, quint8* visible);
+
+  static const int  WIDTH = 320;
+  static const int  HEIGHT = 200;
+
+private:
+  typedef struct {
+    float           x, y;
+  } Point;
+
+  void              setMaterial(int material, bool filled);
+  bool              project(const QVector3D& eye, Point& point) const;
+
+  void              drawPoint(const QVector3D& eye);
+  void              drawLine(QVector3D a, QVector3D b);
+  void              drawPolygon(const QVector3D* eye, int count, bool cullBack);
+  void              drawEllipse(const QVector3D& center, float radius);
+  void              fillSpan(int y, float left, float right);
+  void              plot(int x, int y);
+
+  QImage            m_image;
+  QMatrix4x4        m_projection;
+  CullView          m_cullView;
+  quint8            m_color;
+  quint64           m_colorWord;
+  const quint8*     m_pattern;
+  float             m_left[HEIGHT];
+  float             m_right[HEIGHT];
+  quint64           m_stippleMasks[256];
+
+  static const int  CIRCLE_STEPS = 16;
+  static const float NEAR_PLANE;
+  static const float STEEP_ANGLE;
+  static const double PI;
+  static const int  CULL_SECTORS = 15;
+  static const int  CULL_SECTOR_OFFSET = 3;
+};
@@ -0,0 +1,1062 @@
+#include <algorithm>
+#include <QMap>
+#include <QOpenGLFramebufferObject>
+#include <QOpenGLShaderProgram>
+#include <QSet>
+#include <QSurfaceFormat>
+#include <QVector3D>
+#define _USE_MATH_DEFINES
+#include <math.h>
+#include <stddef.h>
+#include <string.h>
+
+#include "app/settings.h"
+#include "circletable.h"
+#include "materialsmodel.h"
+#include "shapemodel.h"
+#include "shaperenderer.h"
+#include "verticesmodel.h"
+
+// Convert primitive index to a 24-bit RGB id used for picking, 0 is background.
+#define CODE2COLOR(i) QColor(((i) + 1) >> 16 & 0xFF, ((i) + 1) >> 8 & 0xFF, ((i) + 1) & 0xFF)
+#define COLOR2CODE(c) (((c)[0] << 16 | (c)[1] << 8 | (c)[2]) - 1)
+
+const quint8 ShapeRenderer::PATTERNS[6][0x80] = {
+  { // Transparent
+    0x00
+  },
+  { // Grate
+    0xCF, 0xCF, 0xCF, 0xCF, 0xCF, 0xCF, 0xCF, 0xCF, 0xFC, 0xFC, 0xFC, 0xFC, 0xFC, 0xFC, 0xFC, 0xFC,
+    0xCF, 0xCF, 0xCF, 0xCF, 0xCF, 0xCF, 0xCF, 0xCF, 0xFC, 0xFC, 0xFC, 0xFC, 0xFC, 0xFC, 0xFC, 0xFC,
+    0xCF, 0xCF, 0xCF, 0xCF, 0xCF, 0xCF, 0xCF, 0xCF, 0xFC, 0xFC, 0xFC, 0xFC, 0xFC, 0xFC, 0xFC, 0xFC,
+    0xCF, 0xCF, 0xCF, 0xCF, 0xCF, 0xCF, 0xCF, 0xCF, 0xFC, 0xFC, 0xFC, 0xFC, 0xFC, 0xFC, 0xFC, 0xFC,
+    0xCF, 0xCF, 0xCF, 0xCF, 0xCF, 0xCF, 0xCF, 0xCF, 0xFC, 0xFC, 0xFC, 0xFC, 0xFC, 0xFC, 0xFC, 0xFC,
+    0xCF, 0xCF, 0xCF, 0xCF, 0xCF, 0xCF, 0xCF, 0xCF, 0xFC, 0xFC, 0xFC, 0xFC, 0xFC, 0xFC, 0xFC, 0xFC,
+    0xCF, 0xCF, 0xCF, 0xCF, 0xCF, 0xCF, 0xCF, 0xCF, 0xFC, 0xFC, 0xFC, 0xFC, 0xFC, 0xFC, 0xFC, 0xFC,
+    0xCF, 0xCF, 0xCF, 0xCF, 0xCF, 0xCF, 0xCF, 0xCF, 0xFC, 0xFC, 0xFC, 0xFC, 0xFC, 0xFC, 0xFC, 0xFC
+  },
+  { // Grille
+    0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0x0F, 0x0F, 0x0F, 0x0F, 0x0F, 0x0F, 0x0F, 0x0F,
+    0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0x0F, 0x0F, 0x0F, 0x0F, 0x0F, 0x0F, 0x0F, 0x0F,
+    0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0x0F, 0x0F, 0x0F, 0x0F, 0x0F, 0x0F, 0x0F, 0x0F,
+    0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0x0F, 0x0F, 0x0F, 0x0F, 0x0F, 0x0F, 0x0F, 0x0F,
+    0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0x0F, 0x0F, 0x0F, 0x0F, 0x0F, 0x0F, 0x0F, 0x0F,
+    0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0x0F, 0x0F, 0x0F, 0x0F, 0x0F, 0x0F, 0x0F, 0x0F,
+    0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0x0F, 0x0F, 0x0F, 0x0F, 0x0F, 0x0F, 0x0F, 0x0F,
+    0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0x0F, 0x0F, 0x0F, 0x0F, 0x0F, 0x0F, 0x0F, 0x0F
+  },
+  { // Inverse grille
+    0x0F, 0x0F, 0x0F, 0x0F, 0x0F, 0x0F, 0x0F, 0x0F, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0,
+    0x0F, 0x0F, 0x0F, 0x0F, 0x0F, 0x0F, 0x0F, 0x0F, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0,
+    0x0F, 0x0F, 0x0F, 0x0F, 0x0F, 0x0F, 0x0F, 0x0F, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0,
+    0x0F, 0x0F, 0x0F, 0x0F, 0x0F, 0x0F, 0x0F, 0x0F, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0,
+    0x0F, 0x0F, 0x0F, 0x0F, 0x0F, 0x0F, 0x0F, 0x0F, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0,
+    0x0F, 0x0F, 0x0F, 0x0F, 0x0F, 0x0F, 0x0F, 0x0F, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0,
+    0x0F, 0x0F, 0x0F, 0x0F, 0x0F, 0x0F, 0x0F, 0x0F, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0,
+    0x0F, 0x0F, 0x0F, 0x0F, 0x0F, 0x0F, 0x0F, 0x0F, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0
+  },
+  { // Glass
+    0xF3, 0x3C, 0xF3, 0x3C, 0xF3, 0x3C, 0xF3, 0x3C, 0x3C, 0xCF, 0x3C, 0xCF, 0x3C, 0xCF, 0x3C, 0xCF,
+    0xF3, 0x3C, 0xF3, 0x3C, 0xF3, 0x3C, 0xF3, 0x3C, 0x3C, 0xCF, 0x3C, 0xCF, 0x3C, 0xCF, 0x3C, 0xCF,
+    0xF3, 0x3C, 0xF3, 0x3C, 0xF3, 0x3C, 0xF3, 0x3C, 0x3C, 0xCF, 0x3C, 0xCF, 0x3C, 0xCF, 0x3C, 0xCF,
+    0xF3, 0x3C, 0xF3, 0x3C, 0xF3, 0x3C, 0xF3, 0x3C, 0x3C, 0xCF, 0x3C, 0xCF, 0x3C, 0xCF, 0x3C, 0xCF,
+    0xF3, 0x3C, 0xF3, 0x3C, 0xF3, 0x3C, 0xF3, 0x3C, 0x3C, 0xCF, 0x3C, 0xCF, 0x3C, 0xCF, 0x3C, 0xCF,
+    0xF3, 0x3C, 0xF3, 0x3C, 0xF3, 0x3C, 0xF3, 0x3C, 0x3C, 0xCF, 0x3C, 0xCF, 0x3C, 0xCF, 0x3C, 0xCF,
+    0xF3, 0x3C, 0xF3, 0x3C, 0xF3, 0x3C, 0xF3, 0x3C, 0x3C, 0xCF, 0x3C, 0xCF, 0x3C, 0xCF, 0x3C, 0xCF,
+    0xF3, 0x3C, 0xF3, 0x3C, 0xF3, 0x3C, 0xF3, 0x3C, 0x3C, 0xCF, 0x3C, 0xCF, 0x3C, 0xCF, 0x3C, 0xCF
+  },
+  { // Inverse glass
+    0x0C, 0xC3, 0x0C, 0xC3, 0x0C, 0xC3, 0x0C, 0xC3, 0xC3, 0x30, 0xC3, 0x30, 0xC3, 0x30, 0xC3, 0x30,
+    0x0C, 0xC3, 0x0C, 0xC3, 0x0C, 0xC3, 0x0C, 0xC3, 0xC3, 0x30, 0xC3, 0x30, 0xC3, 0x30, 0xC3, 0x30,
+    0x0C, 0xC3, 0x0C, 0xC3, 0x0C, 0xC3, 0x0C, 0xC3, 0xC3, 0x30, 0xC3, 0x30, 0xC3, 0x30, 0xC3, 0x30,
+    0x0C, 0xC3, 0x0C, 0xC3, 0x0C, 0xC3, 0x0C, 0xC3, 0xC3, 0x30, 0xC3, 0x30, 0xC3, 0x30, 0xC3, 0x30,
+    0x0C, 0xC3, 0x0C, 0xC3, 0x0C, 0xC3, 0x0C, 0xC3, 0xC3, 0x30, 0xC3, 0x30, 0xC3, 0x30, 0xC3, 0x30,
+    0x0C, 0xC3, 0x0C, 0xC3, 0x0C, 0xC3, 0x0C, 0xC3, 0xC3, 0x30, 0xC3, 0x30, 0xC3, 0x30, 0xC3, 0x30,
+    0x0C, 0xC3, 0x0C, 0xC3, 0x0C, 0xC3, 0x0C, 0xC3, 0xC3, 0x30, 0xC3, 0x30, 0xC3, 0x30, 0xC3, 0x30,
+    0x0C, 0xC3, 0x0C, 0xC3, 0x0C, 0xC3, 0x0C, 0xC3, 0xC3, 0x30, 0xC3, 0x30, 0xC3, 0x30, 0xC3, 0x30
+  }
+};
+
+const int   ShapeRenderer::CIRCLE_STEPS;
+const int   ShapeRenderer::MAX_CIRCLE_STEPS;
+const float ShapeRenderer::WHEEL_TYRE_RATIO = 3.0f / 5.0f;
+const float ShapeRenderer::SPHERE_RADIUS_RATIO = 2.0f / 3.0f;
+const float ShapeRenderer::ZBIAS_DEPTH = 0.025f;
+
+static constexpr CircleTable<ShapeRenderer::MAX_CIRCLE_STEPS> CIRCLE;
+
+const char* const ShapeRenderer::UNIFORM_NAMES[UNIFORM_COUNT] = {
+  "u_projection", "u_modelView", "u_color", "u_vertexColor", "u_pattern", "u_patterns", "u_shading"
+};
+
+const char ShapeRenderer::VERTEX_SHADER[] =
+  "#version 330 core\n"
+  "layout(location = 0) in vec3 a_position;\n"
+  "layout(location = 1) in vec2 a_offset;\n"
+  "layout(location = 2) in vec4 a_color;\n"
+  "layout(location = 3) in vec3 a_instance;\n"
+  "uniform mat4 u_projection;\n"
+  "uniform mat4 u_modelView;\n"
+  "out vec3 v_position;\n"
+  "flat out vec4 v_color;\n"
+  "void main()\n"
+  "{\n"
+  // Instances are offset in model space, billboard offsets are added in eye
+  // space to face the camera.
+  "  vec4 position = u_modelView * vec4(a_position + a_instance, 1.0);\n"
+  "  position.xy += a_offset;\n"
+  "  v_position = position.xyz;\n"
+  "  v_color = a_color;\n"
+  "  gl_Position = u_projection * position;\n"
+  "}\n";
+
+const char ShapeRenderer::FRAGMENT_SHADER[] =
+  "#version 330 core\n"
+  "uniform vec4 u_color;\n"
+  "uniform bool u_vertexColor;\n"
+  "uniform int u_pattern;\n"
+  "uniform uint u_patterns[6 * 32];\n"
+  "uniform bool u_shading;\n"
+  "in vec3 v_position;\n"
+  "flat in vec4 v_color;\n"
+  "out vec4 f_color;\n"
+  "void main()\n"
+  "{\n"
+  // 32x32 window aligned stipple, rows bottom up and MSB first like glPolygonStipple.
+  "  if (u_pattern > 0) {\n"
+  "    uvec2 p = uvec2(gl_FragCoord.xy) & 31u;\n"
+  "    if ((u_patterns[(u_pattern - 1) * 32 + int(p.y)] & (0x80000000u >> p.x)) == 0u) {\n"
+  "      discard;\n"
+  "    }\n"
+  "  }\n"
+  "  f_color = u_vertexColor ? v_color : u_color;\n"
+  // Face normal from screen space derivatives, constant across each triangle.
+  "  if (u_shading) {\n"
+  "    vec3 normal = normalize(cross(dFdx(v_position), dFdy(v_position)));\n"
+  "    f_color.rgb *= 0.6 + 0.4 * abs(normal.z);\n"
+  "  }\n"
+  "}\n";
+
+ShapeRenderer::ShapeRenderer(QObject* parent)
+: QObject(parent),
+  m_model(0),
+  m_program(0),
+  m_ownsProgram(false),
+  m_pickBuffer(0),
+  m_pickPaintJob(0),
+  m_pickValid(false),
+  m_vertexBuffer(QOpenGLBuffer::VertexBuffer),
+  m_indexBuffer(QOpenGLBuffer::IndexBuffer),
+  m_instanceBuffer(QOpenGLBuffer::VertexBuffer),
+  m_overlayBuffer(QOpenGLBuffer::VertexBuffer),
+  m_wireframe(false),
+  m_shading(false),
+  m_circleSteps(CIRCLE_STEPS),
+  m_dirty(true),
+  m_dirtyAll(true)
+{
+  m_stats.drawCalls = 0;
+  m_stats.primitives = 0;
+  m_instanceBuffer.setUsagePattern(QOpenGLBuffer::StreamDraw);
+  m_overlayBuffer.setUsagePattern(QOpenGLBuffer::StreamDraw);
+}
+
+ShapeRenderer::~ShapeRenderer()
+{
+  // GL resources must be released through destroy() while the context is current.
+  if (m_ownsProgram) {
+    delete m_program;
+  }
+  delete m_pickBuffer;
+}
+
+void ShapeRenderer::setModel(ShapeModel* model)
+{
+  if (m_model) {
+    disconnect(m_model, 0, this, 0);
+  }
+
+  m_model = model;
+  invalidateAll();
+
+  if (m_model) {
+    connect(m_model, SIGNAL(dataChanged(QModelIndex, QModelIndex)), this, SLOT(invalidateRows(QModelIndex, QModelIndex)));
+    connect(m_model, SIGNAL(rowsInserted(QModelIndex, int, int)), this, SLOT(invalidateAll()));
+    connect(m_model, SIGNAL(rowsRemoved(QModelIndex, int, int)), this, SLOT(invalidateAll()));
+    connect(m_model, SIGNAL(rowsMoved(QModelIndex, int, int, QModelIndex, int)), this, SLOT(invalidateAll()));
+    connect(m_model, SIGNAL(layoutChanged()), this, SLOT(invalidateAll()));
+    connect(m_model, SIGNAL(modelReset()), this, SLOT(invalidateAll()));
+  }
+}
+
+void ShapeRenderer::setWireframe(bool enable)
+{
+  if (m_wireframe != enable) {
+    m_wireframe = enable;
+    invalidateAll();
+  }
+}
+
+void ShapeRenderer::setShading(bool enable)
+{
+  m_shading = enable;
+}
+
+// Power of two divisor of MAX_CIRCLE_STEPS, so points come straight from the
+// table.
+void ShapeRenderer::setCircleSteps(int steps)
+{
+  int circleSteps = MAX_CIRCLE_STEPS;
+  while (circleSteps > 4 && circleSteps / 2 >= steps) {
+    circleSteps /= 2;
+  }
+
+  if (m_circleSteps != circleSteps) {
+    m_circleSteps = circleSteps;
+    invalidateAll();
+  }
+}
+
+// Rebuilds the material colors on the next render, for when the palette or
+// the materials change.
+void ShapeRenderer::invalidateMaterials()
+{
+  m_materials.clear();
+}
+
+// Vertex edits reach the shape model without a row, those are tracked per
+// vertices model instead. Rows are given for type changes.
+void ShapeRenderer::invalidateRows(const QModelIndex& topLeft, const QModelIndex& bottomRight)
+{
+  if (topLeft.isValid() && bottomRight.isValid()) {
+    for (int i = topLeft.row(); i <= bottomRight.row() && i < m_cache.size(); i++) {
+      m_cache[i].dirty = true;
+    }
+    m_dirty = true;
+  }
+}
+
+void ShapeRenderer::invalidateVertices()
+{
+  QObject* verticesModel = sender();
+
+  for (int i = 0; i < m_cache.size(); i++) {
+    if (m_cache[i].verticesModel == verticesModel) {
+      m_cache[i].dirty = true;
+    }
+  }
+  m_dirty = true;
+}
+
+void ShapeRenderer::invalidateAll()
+{
+  m_dirty = true;
+  m_dirtyAll = true;
+}
+
+// Renderers drawing into the same context can share the shader program of
+// an initialized one, which must then be destroyed last.
+bool ShapeRenderer::initialize(ShapeRenderer* shared)
+{
+  if (m_program) {
+    return true;
+  }
+
+  if (!initializeOpenGLFunctions()) {
+    m_log = tr("OpenGL 3.3 core profile is not available.");
+    return false;
+  }
+
+  if (shared && shared->m_program) {
+    m_program = shared->m_program;
+    m_ownsProgram = false;
+    memcpy(m_uniforms, shared->m_uniforms, sizeof(m_uniforms));
+  }
+  else if (!createProgram()) {
+    return false;
+  }
+
+  m_vertexArray.create();
+  m_vertexArray.bind();
+  m_vertexBuffer.create();
+  m_vertexBuffer.bind();
+  glEnableVertexAttribArray(0);
+  glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(RenderVertex), reinterpret_cast<const GLvoid*>(offsetof(RenderVertex, x)));
+  glEnableVertexAttribArray(1);
+  glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(RenderVertex), reinterpret_cast<const GLvoid*>(offsetof(RenderVertex, dx)));
+  m_indexBuffer.create();
+  m_indexBuffer.bind();
+
+  // Instance offsets, only enabled for instanced draws. Otherwise the
+  // attribute reads the constant zero set in begin().
+  m_instanceBuffer.create();
+  m_instanceBuffer.bind();
+  glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(QVector3D), 0);
+  glVertexAttribDivisor(3, 1);
+  m_instanceBuffer.release();
+
+  m_vertexArray.release();
+  m_vertexBuffer.release();
+
+  m_overlayArray.create();
+  m_overlayArray.bind();
+  m_overlayBuffer.create();
+  m_overlayBuffer.bind();
+  glEnableVertexAttribArray(0);
+  glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(OverlayVertex), reinterpret_cast<const GLvoid*>(offsetof(OverlayVertex, x)));
+  glEnableVertexAttribArray(2);
+  glVertexAttribPointer(2, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(OverlayVertex), reinterpret_cast<const GLvoid*>(offsetof(OverlayVertex, r)));
+  m_overlayArray.release();
+  m_overlayBuffer.release();
+
+  invalidateAll();
+
+  return true;
+}
+
+bool ShapeRenderer::createProgram()
+{
+  QOpenGLShaderProgram* program = new QOpenGLShaderProgram();
+  if (!program->addShaderFromSourceCode(QOpenGLShader::Vertex, VERTEX_SHADER) ||
+      !program->addShaderFromSourceCode(QOpenGLShader::Fragment, FRAGMENT_SHADER) ||
+      !program->link()) {
+    m_log = program->log();
+    delete program;
+    return false;
+  }
+
+  m_program = program;
+
+  for (int i = 0; i < UNIFORM_COUNT; i++) {
+    m_uniforms[i] = m_program->uniformLocation(UNIFORM_NAMES[i]);
+  }
+
+  // Stipple rows as 32-bit words, leftmost pixel in the most significant bit.
+  GLuint patterns[6 * 32];
+  for (int i = 0; i < 6 * 32; i++) {
+    const quint8* row = PATTERNS[i / 32] + (i % 32) * 4;
+    patterns[i] = (row[0] << 24) | (row[1] << 16) | (row[2] << 8) | row[3];
+  }
+
+  m_program->bind();
+  m_program->setUniformValueArray(m_uniforms[UNIFORM_PATTERNS], patterns, 6 * 32);
+  m_program->release();
+  m_ownsProgram = true;
+
+  return true;
+}
+
+void ShapeRenderer::destroy()
+{
+  m_vertexArray.destroy();
+  m_overlayArray.destroy();
+  m_vertexBuffer.destroy();
+  m_indexBuffer.destroy();
+  m_instanceBuffer.destroy();
+  m_overlayBuffer.destroy();
+
+  if (m_ownsProgram) {
+    delete m_program;
+  }
+  m_program = 0;
+  m_ownsProgram = false;
+
+  delete m_pickBuffer;
+  m_pickBuffer = 0;
+  m_pickIds.clear();
+
+  invalidateAll();
+}
+
+void ShapeRenderer::render(const QMatrix4x4& projection, const QMatrix4x4& modelView, int paintJob, const QBitArray& selected, const QVector<quint8>& visible)
+{
+  if (!m_program) {
+    return;
+  }
+
+  m_stats.drawCalls = 0;
+  m_stats.primitives = 0;
+
+  clear(Qt::white);
+  begin(projection, modelView);
+  m_vertexArray.bind();
+
+  if (sync()) {
+    if (!visible.isEmpty()) {
+      // Primitives hidden by culling break the batches, draw one by one.
+      for (int row = 0; row < m_cache.size(); row++) {
+        if (row >= visible.size() || visible[row]) {
+          drawPrimitive(row, paintJob, false);
+        }
+      }
+    }
+    // Everything in a few batched calls.
+    else if (paintJob >= 0 && paintJob < m_batches.size()) {
+      foreach (const Batch& batch, m_batches[paintJob]) {
+        setFlags(batch.twoSided, batch.zBias);
+        setMaterial(batch.material, batch.mode, false);
+        drawRange(batch.mode, batch.offset, batch.count);
+      }
+    }
+
+    // Selected primitives are drawn again on top, depth test is GL_LEQUAL.
+    int rows = qMin(selected.size(), m_cache.size());
+    for (int row = 0; row < rows; row++) {
+      if (selected.testBit(row) && (row >= visible.size() || visible[row])) {
+        drawPrimitive(row, paintJob, true);
+      }
+    }
+
+    setFlags(false, false);
+  }
+
+  m_vertexArray.release();
+  m_program->release();
+}
+
+// Draws the paint-job once per offset with instanced calls, into the current
+// framebuffer without clearing it. Counters are reset like in render().
+void ShapeRenderer::renderInstances(const QMatrix4x4& projection, const QMatrix4x4& modelView, int paintJob, const QVector<QVector3D>& offsets)
+{
+  if (!m_program || offsets.isEmpty()) {
+    return;
+  }
+
+  m_stats.drawCalls = 0;
+  m_stats.primitives = 0;
+
+  begin(projection, modelView);
+  m_vertexArray.bind();
+
+  if (sync() && paintJob >= 0 && paintJob < m_batches.size()) {
+    m_instanceBuffer.bind();
+    m_instanceBuffer.allocate(offsets.constData(), offsets.size() * sizeof(QVector3D));
+    glEnableVertexAttribArray(3);
+
+    foreach (const Batch& batch, m_batches[paintJob]) {
+      setFlags(batch.twoSided, batch.zBias);
+      setMaterial(batch.material, batch.mode, false);
+      glDrawElementsInstanced(batch.mode, batch.count, GL_UNSIGNED_INT, reinterpret_cast<const GLvoid*>(batch.offset * sizeof(quint32)), offsets.size());
+      countDraw(batch.mode, batch.count * offsets.size());
+    }
+
+    glDisableVertexAttribArray(3);
+    m_instanceBuffer.release();
+    setFlags(false, false);
+  }
+
+  m_vertexArray.release();
+  m_program->release();
+}
+
+void ShapeRenderer::drawOverlay(int mode, const QVector<OverlayVertex>& vertices, bool onTop)
+{
+  if (!m_program || vertices.isEmpty()) {
+    return;
+  }
+
+  // Matrices are still set from the last render().
+  m_program->bind();
+  m_program->setUniformValue(m_uniforms[UNIFORM_VERTEX_COLOR], (GLint)true);
+  m_program->setUniformValue(m_uniforms[UNIFORM_PATTERN], (GLint)0);
+  m_program->setUniformValue(m_uniforms[UNIFORM_SHADING], (GLint)false);
+
+  if (onTop) {
+    glDepthRange(0.0f, 1.0f);
+  }
+
+  m_overlayArray.bind();
+  m_overlayBuffer.bind();
+  m_overlayBuffer.allocate(vertices.constData(), vertices.size() * sizeof(OverlayVertex));
+  glDrawArrays(mode, 0, vertices.size());
+  countDraw(mode, vertices.size());
+  m_overlayBuffer.release();
+  m_overlayArray.release();
+
+  if (onTop) {
+    glDepthRange(ZBIAS_DEPTH, 1.0f);
+  }
+
+  m_program->release();
+}
+
+int ShapeRenderer::pick(const QMatrix4x4& projection, const QMatrix4x4& modelView, int paintJob, const QSize& size, const QPoint& pixel, const QVector<quint8>& visible)
+{
+  if (!updatePickBuffer(projection, modelView, paintJob, size, visible) ||
+      pixel.x() < 0 || pixel.y() < 0 || pixel.x() >= size.width() || pixel.y() >= size.height()) {
+    return -1;
+  }
+
+  return COLOR2CODE(m_pickIds.constData() + (pixel.y() * size.width() + pixel.x()) * 4);
+}
+
+QList<int> ShapeRenderer::pick(const QMatrix4x4& projection, const QMatrix4x4& modelView, int paintJob, const QSize& size, const QRect& rect, const QVector<quint8>& visible)
+{
+  QSet<int> rows;
+
+  if (updatePickBuffer(projection, modelView, paintJob, size, visible)) {
+    QRect area = rect.normalized() & QRect(QPoint(0, 0), size);
+
+    for (int y = area.top(); y <= area.bottom(); y++) {
+      const quint8* color = m_pickIds.constData() + (y * size.width() + area.left()) * 4;
+
+      for (int x = area.left(); x <= area.right(); x++, color += 4) {
+        rows.insert(COLOR2CODE(color));
+      }
+    }
+  }
+
+  rows.remove(-1);
+
+  QList<int> list = rows.toList();
+  std::sort(list.begin(), list.end());
+
+  return list;
+}
+
+// Draws primitive ids into an offscreen buffer and keeps a copy in memory.
+// Only done again when geometry, materials, camera, size or the visible rows
+// have changed, so picking does not touch the visible frame.
+bool ShapeRenderer::updatePickBuffer(const QMatrix4x4& projection, const QMatrix4x4& modelView, int paintJob, const QSize& size, const QVector<quint8>& visible)
+{
+  if (!m_program || size.isEmpty()) {
+    return false;
+  }
+
+  m_vertexArray.bind();
+  bool hasData = sync();
+  m_vertexArray.release();
+
+  if (m_pickValid && m_pickBuffer && m_pickBuffer->size() == size &&
+      m_pickPaintJob == paintJob && m_pickProjection == projection && m_pickModelView == modelView && m_pickVisible == visible) {
+    return true;
+  }
+
+  if (!m_pickBuffer || m_pickBuffer->size() != size) {
+    delete m_pickBuffer;
+    m_pickBuffer = new QOpenGLFramebufferObject(size, QOpenGLFramebufferObject::Depth);
+  }
+
+  GLint viewport[4];
+  glGetIntegerv(GL_VIEWPORT, viewport);
+
+  m_pickBuffer->bind();
+  glViewport(0, 0, size.width(), size.height());
+
+  clear(Qt::black);
+  begin(projection, modelView);
+  m_vertexArray.bind();
+
+  if (hasData) {
+    for (int i = 0; i < m_cache.size(); i++) {
+      if (i < visible.size() && !visible[i]) {
+        continue;
+      }
+
+      const Cache& cache = m_cache[i];
+      setFlags(cache.twoSided, cache.zBias);
+
+      foreach (const Part& part, cache.parts) {
+        setMaterial(qMin(cache.materials.value(paintJob) + part.materialOffset, (int)MaterialsModel::VAL_MAX), part.mode, false, i);
+        drawRange(part.mode, part.offset, part.count);
+      }
+    }
+
+    setFlags(false, false);
+  }
+
+  m_vertexArray.release();
+  m_program->release();
+
+  m_pickIds.resize(size.width() * size.height() * 4);
+  glReadPixels(0, 0, size.width(), size.height(), GL_RGBA, GL_UNSIGNED_BYTE, m_pickIds.data());
+
+  m_pickBuffer->release();
+  glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+
+  m_pickProjection = projection;
+  m_pickModelView = modelView;
+  m_pickPaintJob = paintJob;
+  m_pickVisible = visible;
+  m_pickValid = true;
+
+  return true;
+}
+
+QSurfaceFormat ShapeRenderer::format()
+{
+  QSurfaceFormat format;
+  format.setVersion(3, 3);
+  format.setProfile(QSurfaceFormat::CoreProfile);
+  format.setDepthBufferSize(24);
+
+  return format;
+}
+
+QMatrix4x4 ShapeRenderer::projection(const QSize& size)
+{
+  QMatrix4x4 projection;
+  projection.perspective(45.0f, (float)size.width() / (float)qMax(1, size.height()), 0.1f, 5000.0f);
+
+  return projection;
+}
+
+void ShapeRenderer::frame(ShapeModel* model, QMatrix4x4& translation, QMatrix4x4& rotation)
+{
+  translation.setToIdentity();
+  rotation.setToIdentity();
+
+  if (model) {
+    Vertex* bound = model->boundBox();
+    translation.translate(
+        0.0f,
+        -((bound[4].y + bound[0].y) / 2) * VerticesModel::Y_RATIO,
+        0.0f);
+    translation.translate(
+        0.0f,
+        0.0f,
+        -(VerticesModel::toInternal(bound[5]).toQ() - VerticesModel::toInternal(bound[2]).toQ()).length());
+    rotation.rotate(10.0f, 1.0f, 0.0f, 0.0f);
+  }
+}
+
+void ShapeRenderer::clear(const QColor& color)
+{
+  glClearColor(color.redF(), color.greenF(), color.blueF(), 1.0f);
+  glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+}
+
+void ShapeRenderer::begin(const QMatrix4x4& projection, const QMatrix4x4& modelView)
+{
+  // A QPainter on the same context may have left blending on.
+  glDisable(GL_BLEND);
+  glEnable(GL_DEPTH_TEST);
+  glDepthFunc(GL_LEQUAL);
+  glDepthRange(ZBIAS_DEPTH, 1.0f);
+  glEnable(GL_CULL_FACE);
+  glVertexAttrib3f(3, 0.0f, 0.0f, 0.0f);
+
+  if (m_materials.isEmpty()) {
+    buildMaterials();
+  }
+
+  m_program->bind();
+  m_program->setUniformValue(m_uniforms[UNIFORM_PROJECTION], projection);
+  m_program->setUniformValue(m_uniforms[UNIFORM_MODEL_VIEW], modelView);
+  m_program->setUniformValue(m_uniforms[UNIFORM_VERTEX_COLOR], (GLint)false);
+}
+
+void ShapeRenderer::setFlags(bool twoSided, bool zBias)
+{
+  if (twoSided) {
+    glDisable(GL_CULL_FACE);
+  }
+  else {
+    glEnable(GL_CULL_FACE);
+  }
+
+  glDepthRange(zBias ? 0.0f : ZBIAS_DEPTH, 1.0f);
+}
+
+void ShapeRenderer::setMaterial(int material, int mode, bool selected, int pickRow)
+{
+  const MaterialColors& colors = m_materials[material];
+
+  // Stipple only applies to polygons, like the fixed-function pipeline.
+  bool polygon = mode == GL_TRIANGLES;
+
+  if (pickRow >= 0) {
+    m_program->setUniformValue(m_uniforms[UNIFORM_COLOR], CODE2COLOR(pickRow));
+  }
+  else {
+    m_program->setUniformValue(m_uniforms[UNIFORM_COLOR], selected ? colors.selectedColor : colors.color);
+  }
+
+  m_program->setUniformValue(m_uniforms[UNIFORM_PATTERN], polygon ? colors.pattern : 0);
+  m_program->setUniformValue(m_uniforms[UNIFORM_SHADING], (GLint)(m_shading && polygon && pickRow < 0));
+}
+
+// Resolves every material through the palette once, instead of per draw.
+void ShapeRenderer::buildMaterials()
+{
+  m_materials.resize(Settings::m_loadedMaterials.size());
+
+  for (int i = 0; i < m_materials.size(); i++) {
+    const Material& properties = Settings::m_loadedMaterials[i];
+    QColor color(Settings::m_loadedPalette[properties.color]);
+    QColor selectedColor(qMin(0xFF, color.red() + 0x7F), qMax(0, color.green() - 0x7F), qMax(0, color.blue() - 0x7F));
+
+    m_materials[i].color = QVector4D(color.redF(), color.greenF(), color.blueF(), 1.0f);
+    m_materials[i].selectedColor = QVector4D(selectedColor.redF(), selectedColor.greenF(), selectedColor.blueF(), 1.0f);
+    m_materials[i].pattern = (properties.pattern > 0 && properties.pattern <= 6) ? properties.pattern : 0;
+  }
+}
+
+void ShapeRenderer::drawPrimitive(int row, int paintJob, bool selected)
+{
+  const Cache& cache = m_cache[row];
+  setFlags(cache.twoSided, cache.zBias);
+
+  foreach (const Part& part, cache.parts) {
+    setMaterial(qMin(cache.materials.value(paintJob) + part.materialOffset, (int)MaterialsModel::VAL_MAX), part.mode, selected);
+    drawRange(part.mode, part.offset, part.count);
+  }
+}
+
+void ShapeRenderer::drawRange(int mode, int offset, int count)
+{
+  glDrawElements(mode, count, GL_UNSIGNED_INT, reinterpret_cast<const GLvoid*>(offset * sizeof(quint32)));
+  countDraw(mode, count);
+}
+
+void ShapeRenderer::countDraw(int mode, int vertices)
+{
+  m_stats.drawCalls++;
+
+  if (mode == GL_TRIANGLES) {
+    m_stats.primitives += vertices / 3;
+  }
+  else if (mode == GL_LINES) {
+    m_stats.primitives += vertices / 2;
+  }
+  else {
+    m_stats.primitives += vertices;
+  }
+}
+
+bool ShapeRenderer::sync()
+{
+  if (!m_model || m_model->primitivesList()->isEmpty()) {
+    return false;
+  }
+
+  const PrimitivesList* primitives = m_model->primitivesList();
+
+  if (m_cache.size() != primitives->size()) {
+    m_cache.resize(primitives->size());
+    m_dirtyAll = true;
+  }
+
+  if (m_dirtyAll) {
+    for (int i = 0; i < primitives->size(); i++) {
+      VerticesModel* verticesModel = primitives->at(i).verticesModel;
+      Cache& cache = m_cache[i];
+
+      // Models may have moved to another row, old connections are kept.
+      if (cache.verticesModel != verticesModel) {
+        cache.verticesModel = verticesModel;
+        connect(verticesModel, SIGNAL(dataChanged(QModelIndex, QModelIndex)), this, SLOT(invalidateVertices()), Qt::UniqueConnection);
+        connect(verticesModel, SIGNAL(rowsInserted(QModelIndex, int, int)), this, SLOT(invalidateVertices()), Qt::UniqueConnection);
+        connect(verticesModel, SIGNAL(rowsRemoved(QModelIndex, int, int)), this, SLOT(invalidateVertices()), Qt::UniqueConnection);
+        connect(verticesModel, SIGNAL(modelReset()), this, SLOT(invalidateVertices()), Qt::UniqueConnection);
+      }
+    }
+  }
+
+  bool layout = m_dirtyAll;
+  bool indices = m_dirtyAll || m_batches.size() != m_model->numPaintJobs();
+  QList<int> changed;
+
+  for (int i = 0; i < primitives->size(); i++) {
+    const Primitive& primitive = primitives->at(i);
+    Cache& cache = m_cache[i];
+
+    if (m_dirtyAll || cache.dirty) {
+      int oldSize = cache.positions.size();
+
+      cache.type = primitive.type;
+      cache.source = *primitive.verticesModel->verticesFList();
+      cache.dirty = false;
+      tessellate(cache);
+
+      layout |= cache.positions.size() != oldSize;
+      indices = true;
+      changed.append(i);
+    }
+
+    // Paint-jobs are edited in place without model signals, compare on every
+    // frame. It is cheap next to drawing.
+    if (m_dirtyAll ||
+        cache.twoSided != primitive.twoSided ||
+        cache.zBias != primitive.zBias ||
+        cache.materials != *primitive.materialsModel->materialsList()) {
+      cache.twoSided = primitive.twoSided;
+      cache.zBias = primitive.zBias;
+      cache.materials = *primitive.materialsModel->materialsList();
+      indices = true;
+    }
+  }
+
+  m_dirty = false;
+  m_dirtyAll = false;
+
+  if (layout || indices || !changed.isEmpty()) {
+    m_pickValid = false;
+  }
+
+  if (layout) {
+    QVector<RenderVertex> positions;
+    for (int i = 0; i < m_cache.size(); i++) {
+      m_cache[i].vertexOffset = positions.size();
+      positions += m_cache[i].positions;
+    }
+
+    m_vertexBuffer.bind();
+    m_vertexBuffer.allocate(positions.constData(), positions.size() * sizeof(RenderVertex));
+    m_vertexBuffer.release();
+  }
+  else if (!changed.isEmpty()) {
+    m_vertexBuffer.bind();
+    foreach (int i, changed) {
+      const Cache& cache = m_cache[i];
+      m_vertexBuffer.write(cache.vertexOffset * sizeof(RenderVertex), cache.positions.constData(), cache.positions.size() * sizeof(RenderVertex));
+    }
+    m_vertexBuffer.release();
+  }
+
+  if (indices) {
+    buildIndices();
+  }
+
+  return true;
+}
+
+void ShapeRenderer::buildIndices()
+{
+  QVector<quint32> indices;
+
+  // Model order, one range per part.
+  for (int i = 0; i < m_cache.size(); i++) {
+    Cache& cache = m_cache[i];
+    cache.parts.clear();
+
+    foreach (const LocalPart& localPart, cache.localParts) {
+      Part part;
+      part.mode = localPart.mode;
+      part.offset = indices.size();
+      part.count = localPart.indices.size();
+      part.materialOffset = localPart.materialOffset;
+      cache.parts.append(part);
+
+      foreach (quint32 index, localPart.indices) {
+        indices.append(cache.vertexOffset + index);
+      }
+    }
+  }
+
+  // Batches per paint-job, sorted by flags, mode and material.
+  m_batches.resize(m_model->numPaintJobs());
+
+  for (int paintJob = 0; paintJob < m_batches.size(); paintJob++) {
+    QMap<quint32, QVector<quint32> > buckets;
+
+    foreach (const Cache& cache, m_cache) {
+      for (int j = 0; j < cache.parts.size(); j++) {
+        const Part& part = cache.parts[j];
+        quint32 material = qMin(cache.materials.value(paintJob) + part.materialOffset, (int)MaterialsModel::VAL_MAX);
+        quint32 key = (cache.zBias << 12) | (cache.twoSided << 11) | (part.mode << 8) | material;
+
+        QVector<quint32>& bucket = buckets[key];
+        for (int k = 0; k < part.count; k++) {
+          bucket.append(indices[part.offset + k]);
+        }
+      }
+    }
+
+    QVector<Batch>& batches = m_batches[paintJob];
+    batches.clear();
+
+    for (QMap<quint32, QVector<quint32> >::const_iterator it = buckets.constBegin(); it != buckets.constEnd(); ++it) {
+      Batch batch;
+      batch.zBias = it.key() & (1 << 12);
+      batch.twoSided = it.key() & (1 << 11);
+      batch.mode = (it.key() >> 8) & 0x7;
+      batch.material = it.key() & 0xFF;
+      batch.offset = indices.size();
+      batch.count = it.value().size();
+      batches.append(batch);
+
+      indices += it.value();
+    }
+  }
+
+  // Bound with the vertex array, which holds the index buffer binding.
+  m_indexBuffer.bind();
+  m_indexBuffer.allocate(indices.constData(), indices.size() * sizeof(quint32));
+}
+
+void ShapeRenderer::tessellate(Cache& cache) const
+{
+  cache.positions.clear();
+  cache.localParts.clear();
+
+  const VerticesFList& v = cache.source;
+
+  int verticesNeeded;
+  if (!VerticesModel::verticesNeeded(cache.type, verticesNeeded) || v.size() < verticesNeeded) {
+    return;
+  }
+
+  auto add = [&cache](const QVector3D& p, float dx, float dy) -> quint32 {
+    RenderVertex vertex = { p.x(), p.y(), p.z(), dx, dy };
+    cache.positions.append(vertex);
+    return cache.positions.size() - 1;
+  };
+
+  LocalPart part;
+  part.materialOffset = 0;
+
+  int stride = MAX_CIRCLE_STEPS / m_circleSteps;
+
+  if (cache.type == PRIM_TYPE_PARTICLE) {
+    part.mode = GL_POINTS;
+    part.indices << add(v[0].toQ(), 0.0f, 0.0f);
+  }
+  else if (cache.type == PRIM_TYPE_LINE) {
+    part.mode = GL_LINES;
+    part.indices << add(v[0].toQ(), 0.0f, 0.0f) << add(v[1].toQ(), 0.0f, 0.0f);
+  }
+  else if (cache.type > PRIM_TYPE_LINE && cache.type < PRIM_TYPE_SPHERE) { // Polygon
+    int n = v.size();
+
+    foreach (const VertexF& vertex, v) {
+      add(vertex.toQ(), 0.0f, 0.0f);
+    }
+
+    if (m_wireframe) {
+      part.mode = GL_LINES;
+      for (int i = 0; i < n; i++) {
+        part.indices << i << (i + 1) % n;
+      }
+    }
+    else {
+      // Reverse order, like the game.
+      part.mode = GL_TRIANGLES;
+      for (int i = 1; i < n - 1; i++) {
+        part.indices << n - 1 << n - 1 - i << n - 2 - i;
+      }
+    }
+  }
+  else if (m_wireframe) { // Sphere and wheel control points
+    foreach (const VertexF& vertex, v) {
+      add(vertex.toQ(), 0.0f, 0.0f);
+    }
+
+    part.mode = GL_LINES;
+    for (int i = 0; i < v.size() - 1; i++) {
+      part.indices << i << i + 1;
+    }
+  }
+  else if (cache.type == PRIM_TYPE_SPHERE) {
+    QVector3D center = v[0].toQ();
+    float radius = (v[1].toQ() - center).length() * SPHERE_RADIUS_RATIO;
+
+    for (int i = 0; i < m_circleSteps; i++) {
+      add(center, CIRCLE.cos((i + 1) * stride - 1) * radius, CIRCLE.sin((i + 1) * stride - 1) * radius);
+    }
+
+    part.mode = GL_TRIANGLES;
+    for (int i = 1; i < m_circleSteps - 1; i++) {
+      part.indices << 0 << i << i + 1;
+    }
+  }
+  else if (cache.type == PRIM_TYPE_WHEEL) {
+    QVector<QVector3D> positions;
+    QVector<quint32> indices[3];
+    wheel(v, m_circleSteps, positions, indices);
+
+    foreach (const QVector3D& position, positions) {
+      add(position, 0.0f, 0.0f);
+    }
+
+    part.mode = GL_TRIANGLES;
+    for (int i = 0; i < 3; i++) {
+      part.materialOffset = i;
+      part.indices = indices[i];
+      cache.localParts.append(part);
+    }
+
+    part.indices.clear();
+  }
+
+  if (!part.indices.isEmpty()) {
+    cache.localParts.append(part);
+  }
+}
+
+// Wheel surfaces as triangles in internal coordinates, split into tread, tyre
+// sides and rims, which use the primitive's first three materials.
+void ShapeRenderer::wheel(const VerticesFList& v, int steps, QVector<QVector3D>& positions, QVector<quint32> (&parts)[3])
+{
+  int stride = MAX_CIRCLE_STEPS / steps;
+
+  QVector3D v0 = v[0].toQ(), v1 = v[1].toQ(), v2 = v[2].toQ(), v3 = v[3].toQ(), v5 = v[5].toQ();
+
+  float radius2h = (v5 - v3).length();
+  float radius2v = (v1 - v0).length();
+  float radius1h = radius2h * WHEEL_TYRE_RATIO;
+  float radius1v = radius2v * WHEEL_TYRE_RATIO;
+
+  QVector3D center = (v0 + v3) / 2.0f;
+  float halfWidth = (v0 - center).length();
+
+  QVector3D normal = QVector3D::normal(v1 - v0, v2 - v0);
+
+  QMatrix4x4 transform;
+  transform.translate(center);
+  transform.rotate(atan2(normal.x(), normal.z()) * (180.0f / M_PI), 0.0f, 1.0f, 0.0f);
+
+  auto add = [&](float x, float y, float z) -> quint32 {
+    positions.append(transform.map(QVector3D(x, y, z)));
+    return positions.size() - 1;
+  };
+
+  // Quad strips and fans as triangles, keeping the winding.
+  auto quadStrip = [](QVector<quint32>& indices, const QVector<quint32>& strip) {
+    for (int i = 0; i + 3 < strip.size(); i += 2) {
+      indices << strip[i] << strip[i + 1] << strip[i + 3];
+      indices << strip[i] << strip[i + 3] << strip[i + 2];
+    }
+  };
+
+  auto fan = [](QVector<quint32>& indices, const QVector<quint32>& fan) {
+    for (int i = 1; i + 1 < fan.size(); i++) {
+      indices << fan[0] << fan[i] << fan[i + 1];
+    }
+  };
+
+  float x1[MAX_CIRCLE_STEPS], y1[MAX_CIRCLE_STEPS], x2[MAX_CIRCLE_STEPS], y2[MAX_CIRCLE_STEPS];
+  for (int i = 0; i < steps; i++) {
+    float x = CIRCLE.cos((i + 1) * stride - 1);
+    float y = CIRCLE.sin((i + 1) * stride - 1);
+    x1[i] = x * radius1h;
+    y1[i] = y * radius1v;
+    x2[i] = x * radius2h;
+    y2[i] = y * radius2v;
+  }
+
+  QVector<quint32> tread, innerTyre, outerTyre, innerRim, outerRim;
+
+  tread << add(radius2h, 0.0f, halfWidth) << add(radius2h, 0.0f, -halfWidth);
+  innerTyre << add(radius1h, 0.0f, -halfWidth) << add(radius2h, 0.0f, -halfWidth);
+  outerTyre << add(radius1h, 0.0f, halfWidth) << add(radius2h, 0.0f, halfWidth);
+
+  for (int i = 0; i < steps; i++) {
+    tread << add(x2[i], y2[i], halfWidth) << add(x2[i], y2[i], -halfWidth);
+    innerTyre << add(x1[i], -y1[i], -halfWidth) << add(x2[i], -y2[i], -halfWidth);
+    outerTyre << add(x1[i], y1[i], halfWidth) << add(x2[i], y2[i], halfWidth);
+  }
+
+  for (int i = steps - 1; i >= 0; i--) {
+    innerRim << add(x1[i], y1[i], -halfWidth);
+  }
+  for (int i = 0; i < steps; i++) {
+    outerRim << add(x1[i], y1[i], halfWidth);
+  }
+
+  quadStrip(parts[0], tread);
+  quadStrip(parts[1], innerTyre);
+  quadStrip(parts[1], outerTyre);
+  fan(parts[2], innerRim);
+  fan(parts[2], outerRim);
+}
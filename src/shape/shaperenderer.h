@@ -0,0 +1,187 @@
+#pragma once
+
+#include <QBitArray>
+#include <QMatrix4x4>
+#include <QObject>
+#include <QOpenGLBuffer>
+#include <QOpenGLFunctions_3_3_Core>
+#include <QOpenGLVertexArrayObject>
+#include <QPointer>
+#include <QRect>
+#include <QVector>
+#include <QVector4D>
+
+#include "types.h"
+
+class QModelIndex;
+class QOpenGLFramebufferObject;
+class QOpenGLShaderProgram;
+class QSurfaceFormat;
+class ShapeModel;
+class VerticesModel;
+
+// Retained geometry for a shape model, drawn with an OpenGL 3.3 core profile
+// context. Primitives are tessellated once into a shared vertex buffer. The
+// index buffer holds every primitive in model order, for picking and
+// highlighting, followed by one set of batches per paint-job grouped by
+// material and flags. Picking reads from a cached id buffer. A primitive is
+// tessellated and uploaded again only when its vertices model or its row
+// reports a change. Stipple patterns and flat shading are done in the
+// fragment shader, spheres are billboards expanded in the vertex shader.
+// renderInstances() draws copies of the shape with one call per batch.
+class ShapeRenderer : public QObject, protected QOpenGLFunctions_3_3_Core
+{
+  Q_OBJECT
+
+public:
+  typedef struct {
+    float           x, y, z;
+    quint8          r, g, b, a;
+  } OverlayVertex;
+
+  // Counters for the last render() and the overlays drawn after it.
+  typedef struct {
+    int             drawCalls;
+    int             primitives;
+  } Stats;
+
+  ShapeRenderer(QObject* parent = 0);
+  ~ShapeRenderer();
+
+  void              setModel(ShapeModel* model);
+  void              setWireframe(bool enable);
+  void              setShading(bool enable);
+  void              setCircleSteps(int steps);
+  void              invalidateMaterials();
+
+  // These need the same current GL context on every call.
+  bool              initialize(ShapeRenderer* shared = 0);
+  void              destroy();
+  bool              isInitialized() const { return m_program != 0; }
+  QString           log() const           { return m_log; }
+  const Stats&      stats() const         { return m_stats; }
+
+  void              render(const QMatrix4x4& projection, const QMatrix4x4& modelView, int paintJob, const QBitArray& selected = QBitArray(), const QVector<quint8>& visible = QVector<quint8>());
+  void              renderInstances(const QMatrix4x4& projection, const QMatrix4x4& modelView, int paintJob, const QVector<QVector3D>& offsets);
+  void              drawOverlay(int mode, const QVector<OverlayVertex>& vertices, bool onTop);
+
+  // Pixels are framebuffer coordinates with the origin at the bottom left.
+  // Rows hidden in the visible flags, as for render(), cannot be picked.
+  int               pick(const QMatrix4x4& projection, const QMatrix4x4& modelView, int paintJob, const QSize& size, const QPoint& pixel, const QVector<quint8>& visible = QVector<quint8>());
+  QList<int>        pick(const QMatrix4x4& projection, const QMatrix4x4& modelView, int paintJob, const QSize& size, const QRect& rect, const QVector<quint8>& visible = QVector<quint8>());
+
+  static QSurfaceFormat format();
+  static QMatrix4x4 projection(const QSize& size);
+  static void       frame(ShapeModel* model, QMatrix4x4& translation, QMatrix4x4& rotation);
+  static void       wheel(const VerticesFList& v, int steps, QVector<QVector3D>& positions, QVector<quint32> (&parts)[3]);
+
+  static const int  CIRCLE_STEPS = 16;
+  static const int  MAX_CIRCLE_STEPS = 64;
+  static const quint8 PATTERNS[6][0x80];
+  static const float WHEEL_TYRE_RATIO;
+  static const float SPHERE_RADIUS_RATIO;
+
+private slots:
+  void              invalidateRows(const QModelIndex& topLeft, const QModelIndex& bottomRight);
+  void              invalidateVertices();
+  void              invalidateAll();
+
+private:
+  enum Uniform { UNIFORM_PROJECTION, UNIFORM_MODEL_VIEW, UNIFORM_COLOR, UNIFORM_VERTEX_COLOR, UNIFORM_PATTERN, UNIFORM_PATTERNS, UNIFORM_SHADING, UNIFORM_COUNT };
+
+  typedef struct {
+    float           x, y, z;
+    float           dx, dy;
+  } RenderVertex;
+
+  typedef struct {
+    int             mode;
+    int             offset;
+    int             count;
+    int             materialOffset;
+  } Part;
+
+  typedef struct {
+    int             mode;
+    int             offset;
+    int             count;
+    int             material;
+    bool            twoSided;
+    bool            zBias;
+  } Batch;
+
+  typedef struct {
+    int             mode;
+    int             materialOffset;
+    QVector<quint32> indices;
+  } LocalPart;
+
+  typedef struct {
+    QPointer<VerticesModel> verticesModel;
+    bool            dirty;
+    quint8          type;
+    bool            twoSided;
+    bool            zBias;
+    VerticesFList   source;
+    MaterialsList   materials;
+    QVector<RenderVertex> positions;
+    QVector<LocalPart> localParts;
+    QVector<Part>   parts;
+    int             vertexOffset;
+  } Cache;
+
+  // Colors of a material as uniform values, the pattern is 0 for solid.
+  typedef struct {
+    QVector4D       color;
+    QVector4D       selectedColor;
+    GLint           pattern;
+  } MaterialColors;
+
+  bool              createProgram();
+  bool              sync();
+  void              tessellate(Cache& cache) const;
+  void              buildIndices();
+  bool              updatePickBuffer(const QMatrix4x4& projection, const QMatrix4x4& modelView, int paintJob, const QSize& size, const QVector<quint8>& visible);
+  void              buildMaterials();
+  void              clear(const QColor& color);
+  void              begin(const QMatrix4x4& projection, const QMatrix4x4& modelView);
+  void              setFlags(bool twoSided, bool zBias);
+  void              setMaterial(int material, int mode, bool selected, int pickRow = -1);
+  void              drawPrimitive(int row, int paintJob, bool selected);
+  void              drawRange(int mode, int offset, int count);
+  void              countDraw(int mode, int vertices);
+
+  ShapeModel*       m_model;
+  QVector<Cache>    m_cache;
+  QVector<QVector<Batch> > m_batches;
+  QOpenGLShaderProgram* m_program;
+  bool              m_ownsProgram;
+  int               m_uniforms[UNIFORM_COUNT];
+  QVector<MaterialColors> m_materials;
+  QString           m_log;
+  Stats             m_stats;
+  QOpenGLVertexArrayObject m_vertexArray;
+  QOpenGLVertexArrayObject m_overlayArray;
+  QOpenGLBuffer     m_vertexBuffer;
+  QOpenGLBuffer     m_indexBuffer;
+  QOpenGLBuffer     m_instanceBuffer;
+  QOpenGLBuffer     m_overlayBuffer;
+  QOpenGLFramebufferObject* m_pickBuffer;
+  QVector<quint8>   m_pickIds;
+  QMatrix4x4        m_pickProjection;
+  QMatrix4x4        m_pickModelView;
+  int               m_pickPaintJob;
+  QVector<quint8>   m_pickVisible;
+  bool              m_pickValid;
+  bool              m_wireframe;
+  bool              m_shading;
+  int               m_circleSteps;
+  bool              m_dirty;
+  bool              m_dirtyAll;
+
+  static const float ZBIAS_DEPTH;
+
+  static const char* const UNIFORM_NAMES[UNIFORM_COUNT];
+  static const char VERTEX_SHADER[];
+  static const char FRAGMENT_SHADER[];
+};
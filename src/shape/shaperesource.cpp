@@ -5,12 +5,15 @@
 #include <QInputDialog>
 #include <QMenu>
 #include <QMessageBox>
-#include <QTextStream>
+#include <QMutex>
 
 #include "app/settings.h"
+#include "app/taskbatch.h"
 #include "flagdelegate.h"
 #include "materialdelegate.h"
 #include "materialsmodel.h"
+#include "meshsimplifier.h"
+#include "shapeio.h"
 #include "shapemodel.h"
 #include "shaperesource.h"
 #include "typedelegate.h"
@@ -22,16 +25,13 @@ QString       ShapeResource::m_currentFilePath;
 QString       ShapeResource::m_currentFileFilter;
 
 const int     ShapeResource::MAX_VERTICES;
+const int     ShapeResource::MAX_PRIMITIVES;
 
 const char    ShapeResource::FILE_SETTINGS_PATH[]  = "paths/shape";
-const char    ShapeResource::FILE_FILTERS[]        = "Wavefront OBJ (*.obj);;All files (*)";
+const char    ShapeResource::FILE_FILTERS[]        = "Wavefront OBJ (*.obj);;Binary glTF (*.glb);;Binary PLY (*.ply);;All files (*)";
 const char    ShapeResource::MTL_SRC[]             = ":/shape/materials.mtl";
 const char    ShapeResource::MTL_DST[]             = "stunts.mtl";
 
-const QRegExp ShapeResource::OBJ_REGEXP_WHITESPACE = QRegExp("\\s+");
-const QRegExp ShapeResource::OBJ_REGEXP_VERTEX     = QRegExp("^v(\\s+([+-]?\\d*\\.?\\d*)){3,4}\\s*$");
-const QRegExp ShapeResource::OBJ_REGEXP_FACE       = QRegExp("^(fo?|[lp])((\\s+-?\\d+)(/-?\\d*){,2}){1,10}\\s*$");
-
 ShapeResource::ShapeResource(QString id, QWidget* parent, Qt::WindowFlags flags)
 : Resource(id, parent, flags),
   m_ui(new Ui::ShapeResource)
@@ -214,7 +214,8 @@ void ShapeResource::write(QDataStream* out) const
 {
   // Generate list of unique vertices, include bound box for all shapes but
   // explosion debris.
-  VerticesList vertices = buildVerticesList(!id().contains(QRegExp("exp[0-3]{1,1}$")));
+  VertexIndexMap indices;
+  VerticesList vertices = buildVerticesList(indices, !id().contains(QRegExp("exp[0-3]{1,1}$")));
 
   // Write header.
   *out << (quint8)vertices.size() << (quint8)m_shapeModel->rowCount() << (quint8)m_ui->paintJobSpinBox->maximum() << (quint8)0;
@@ -255,7 +256,7 @@ void ShapeResource::write(QDataStream* out) const
 
     // Vertex indices.
     foreach (const Vertex& vertex, *(primitive.verticesModel->verticesList())) {
-      *out << (quint8)vertices.indexOf(vertex);
+      *out << (quint8)indices.value(vertex);
     }
     checkError(out, tr("vertex indices in primitive %1").arg(i));
 
@@ -292,9 +293,6 @@ void ShapeResource::setModels(const QModelIndex& index)
 
   m_ui->shapeView->setCurrentIndex(index);
   m_ui->shapeView->setVertexSelectionModel(m_ui->verticesView->selectionModel());
-
-  connect(m_ui->verticesView->selectionModel(), SIGNAL(selectionChanged(QItemSelection, QItemSelection)),
-      m_ui->shapeView, SLOT(selectionChanged(QItemSelection, QItemSelection)));
 }
 
 void ShapeResource::setNumPaintJobs()
@@ -600,11 +598,19 @@ void ShapeResource::exportFile()
     m_currentFilePath = Settings().getFilePath(FILE_SETTINGS_PATH);
   }
 
+  QString suffix = "obj";
+  if (m_currentFileFilter.contains("*.glb")) {
+    suffix = "glb";
+  }
+  else if (m_currentFileFilter.contains("*.ply")) {
+    suffix = "ply";
+  }
+
   QFileInfo fileInfo(m_currentFilePath);
   fileInfo.setFile(
       fileInfo.absolutePath() +
       QDir::separator() +
-      QString("%1-%2.obj").arg(QString(fileName()).replace('.', '_'), id()));
+      QString("%1-%2.%3").arg(QString(fileName()).replace('.', '_'), id(), suffix));
   m_currentFilePath = fileInfo.absoluteFilePath();
 
   QString outFileName = QFileDialog::getSaveFileName(
@@ -619,72 +625,88 @@ void ShapeResource::exportFile()
     fileInfo.setFile(m_currentFilePath);
 
     try {
-      QFile objFile(m_currentFilePath);
-      if (objFile.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
-        QTextStream out(&objFile);
-        out << "# " << Settings::APP_NAME << " - " << Settings::APP_DESC << Qt::endl;
-        out << "# " << Settings::ORG_URL << Qt::endl;
-        out << tr("# Shape \"%1\" exported from file \"%2\"").arg(id(), fileName()) << Qt::endl << Qt::endl;
-
-        out << "mtllib " << MTL_DST << Qt::endl << Qt::endl;
-
-        VerticesList vertices = buildVerticesList();
-        foreach (const Vertex& vertex, vertices) {
-          out << "v" << qSetFieldWidth(10) << Qt::right << Qt::fixed << qSetRealNumberPrecision(1)
-              << (float)vertex.x << (float)vertex.y << (float)vertex.z << Qt::reset << Qt::endl;
-        }
+      suffix = fileInfo.suffix().toLower();
 
-        out << Qt::endl;
-
-        int prevMat = -1, curMat;
-        foreach (const Primitive& primitive, *(m_shapeModel->primitivesList())) {
-          curMat = primitive.materialsModel->materialsList()->at(m_ui->paintJobSpinBox->value() - 1);
-          if (curMat != prevMat) {
-            prevMat = curMat;
-            out << QString("usemtl Stunts%1").arg(curMat, 3, 10, QChar('0')) << Qt::endl;
-          }
-
-          switch (primitive.type) {
-            case PRIM_TYPE_PARTICLE:
-              out << "p";
-              break;
-
-            case PRIM_TYPE_LINE:
-            case PRIM_TYPE_SPHERE:
-              out << "l";
-              break;
-
-            default:
-              out << "f";
-          }
-
-          out << qSetFieldWidth(4) << Qt::right;
-          foreach (const Vertex& vertex, *(primitive.verticesModel->verticesList())) {
-            out << vertices.indexOf(vertex) + 1;
-          }
-          out << Qt::reset << Qt::endl;
-
-          if (out.status()) {
-            throw tr("Couldn't write to file.");
-          }
-        }
-
-        objFile.close();
+      Mesh mesh = buildMesh();
+      QByteArray data;
 
-        QFileInfo mtlFileInfo(fileInfo.dir(), MTL_DST);
-        QFile::copy(MTL_SRC, mtlFileInfo.absoluteFilePath());
+      if (suffix == "glb") {
+        data = ShapeIO::writeGlb(mesh, id());
+      }
+      else if (suffix == "ply") {
+        data = ShapeIO::writePly(mesh, id());
       }
       else {
+        data = ShapeIO::writeObj(
+            mesh,
+            m_ui->paintJobSpinBox->value() - 1,
+            tr("Shape \"%1\" exported from file \"%2\"").arg(id(), fileName()),
+            MTL_DST);
+      }
+
+      QFile outFile(m_currentFilePath);
+      if (!outFile.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
         throw tr("Couldn't open file for writing.");
       }
+
+      if (outFile.write(data) != data.size()) {
+        throw tr("Couldn't write to file.");
+      }
+
+      outFile.close();
+
+      if (suffix != "glb" && suffix != "ply") {
+        QFileInfo mtlFileInfo(fileInfo.dir(), MTL_DST);
+        QFile::copy(MTL_SRC, mtlFileInfo.absoluteFilePath());
+      }
     }
     catch (QString msg) {
       QMessageBox::critical(
           this,
           QCoreApplication::applicationName(),
-          tr("Error exporting shape resource \"%1\" to Wavefront OBJ file \"%2\": %3").arg(id(), m_currentFilePath, msg));
+          tr("Error exporting shape resource \"%1\" to file \"%2\": %3").arg(id(), m_currentFilePath, msg));
+    }
+  }
+}
+
+// Writes each shape with all paint-jobs to its own file in the directory.
+// Meshes are collected here, serialization and file writes run on the
+// batch, which reports the errors, if any, when it has finished.
+TaskBatch* ShapeResource::exportShapes(const QList<ShapeResource*>& shapes, const QString& dirPath, const QString& suffix, QObject* parent)
+{
+  TaskBatch* batch = new TaskBatch(parent);
+  QDir dir(dirPath);
+
+  foreach (ShapeResource* shape, shapes) {
+    try {
+      QString filePath = dir.absoluteFilePath(
+          QString("%1-%2.%3").arg(QString(fileName()).replace('.', '_'), shape->id(), suffix));
+
+      batch->start(new ShapeExportTask(
+          shape->buildMesh(),
+          shape->id(),
+          tr("Shape \"%1\" exported from file \"%2\"").arg(shape->id(), fileName()),
+          filePath,
+          MTL_DST,
+          batch->errors(),
+          batch->mutex()));
     }
+    catch (QString msg) {
+      QMutexLocker locker(batch->mutex());
+      batch->errors()->append(QString("%1: %2").arg(shape->id(), msg));
+    }
+  }
+
+  if (suffix == "obj" && !shapes.isEmpty()) {
+    QString mtlPath = dir.absoluteFilePath(MTL_DST);
+    connect(batch, &TaskBatch::finished, [mtlPath]() {
+      QFile::copy(MTL_SRC, mtlPath);
+    });
   }
+
+  batch->close();
+
+  return batch;
 }
 
 void ShapeResource::importFile()
@@ -704,139 +726,166 @@ void ShapeResource::importFile()
     Settings().setFilePath(FILE_SETTINGS_PATH, m_currentFilePath = inFileName);
 
     try {
-      QFile objFile(m_currentFilePath);
-      if (objFile.open(QIODevice::ReadOnly)) {
-        QTextStream in(&objFile);
-
-        PrimitivesList primitives;
-        VerticesList vertices;
-        quint8 material = 0;
-
-        int lineNum = 0;
-        try {
-          QString line;
-          while (!(line = in.readLine()).isNull()) {
-            lineNum++;
-
-            switch (line[0].toLatin1()) {
-              case 'v':
-                if (line.contains(OBJ_REGEXP_VERTEX)) {
-                  QStringList tokens = line.split(OBJ_REGEXP_WHITESPACE);
-
-                  Vertex vertex;
-                  vertex.x = (qint16)tokens[1].toFloat();
-                  vertex.y = (qint16)tokens[2].toFloat();
-                  vertex.z = (qint16)tokens[3].toFloat();
-                  vertices.append(vertex);
-                }
-                break;
-
-              case 'f':
-              case 'l':
-              case 'p':
-                if (line.contains(OBJ_REGEXP_FACE)) {
-                  if (vertices.isEmpty()) {
-                    throw tr("Found primitive before any vertices.");
-                  }
-
-                  QStringList tokens = line.split(OBJ_REGEXP_WHITESPACE, Qt::SkipEmptyParts);
-
-                  Primitive primitive;
-                  int numVertices = tokens.size() - 1;
-
-                  if (line[0].toLatin1() == 'l' && numVertices == 6) {
-                    primitive.type = PRIM_TYPE_WHEEL;
-                  }
-                  else {
-                    primitive.type = numVertices;
-                  }
-                  primitive.twoSided = false;
-                  primitive.zBias = false;
-
-                  VerticesList faceVertices;
-                  for (int i = 0; i < numVertices; i++) {
-                    int index = tokens[i + 1].section('/', 0, 0).toInt();
-
-                    if (index < 0) {
-                      index = vertices.size() + index + 1;
-                    }
-
-                    if (index < 1 || index > vertices.size()) {
-                      throw tr("Vertex index %1 out of bounds (1 - %2).").arg(index).arg(vertices.size());
-                    }
-                    faceVertices.append(vertices[index - 1]);
-                  }
-
-                  primitive.verticesModel = new VerticesModel(faceVertices, m_shapeModel);
-                  primitive.materialsModel = new MaterialsModel(material, m_shapeModel);
-                  m_shapeModel->computeCull(primitive);
-                  primitives.append(primitive);
-                }
-                break;
-
-              case 'u':
-                if (line.startsWith("usemtl")) {
-                  material = line.trimmed().right(3).toUInt();
-                }
-                break;
-            }
-          }
-
-          if (in.status()) {
-            throw tr("Couldn't read from file.");
-          }
-        }
-        catch (QString msg) {
-          // Clean-up.
-          foreach (const Primitive& primitive, primitives) {
-            delete primitive.verticesModel;
-            delete primitive.materialsModel;
-          }
-
-          throw tr("Parsing error at line %1: %2").arg(lineNum).arg(msg);
-        }
-
-        objFile.close();
+      QFile inFile(m_currentFilePath);
+      if (!inFile.open(QIODevice::ReadOnly)) {
+        throw tr("Couldn't open file for reading.");
+      }
 
-        if (primitives.isEmpty()) {
-          throw tr("No faces found in file.");
-        }
+      Mesh mesh;
+      QString suffix = QFileInfo(m_currentFilePath).suffix().toLower();
 
-        m_shapeModel->setShape(primitives);
-        m_ui->shapeView->reset();
+      if (suffix == "glb") {
+        mesh = ShapeIO::readGlb(inFile.readAll());
+      }
+      else if (suffix == "ply") {
+        mesh = ShapeIO::readPly(inFile.readAll());
+      }
+      else {
+        mesh = ShapeIO::readObj(inFile.readAll());
+      }
 
-        m_ui->numPaintJobsSpinBox->setValue(1);
-        m_ui->paintJobSpinBox->setMaximum(1);
+      inFile.close();
 
-        isModified();
+      if (mesh.faces.isEmpty()) {
+        throw tr("No faces found in file.");
       }
-      else {
-        throw tr("Couldn't open file for reading.");
+
+      // Leave room for the bound box written in front of the vertices.
+      MeshSimplifier simplifier(mesh);
+      if (!simplifier.fits(MAX_VERTICES - 8, MAX_PRIMITIVES)) {
+        if (!simplifier.simplify(MAX_VERTICES - 8, MAX_PRIMITIVES)) {
+          throw tr("Couldn't reduce mesh to %1 vertices and %2 primitives.").arg(MAX_VERTICES - 8).arg(MAX_PRIMITIVES);
+        }
+
+        mesh = simplifier.result();
+
+        QMessageBox::information(
+            this,
+            QCoreApplication::applicationName(),
+            tr("Mesh exceeded shape limits and was simplified from %1 vertices and %2 faces to %3 vertices and %4 primitives. No input vertex is more than %5 units from the simplified surface.")
+              .arg(simplifier.numInputVertices())
+              .arg(simplifier.numInputFaces())
+              .arg(mesh.positions.size())
+              .arg(mesh.faces.size())
+              .arg(simplifier.deviation(), 0, 'f', 1));
       }
+
+      PrimitivesList primitives = buildPrimitives(mesh);
+
+      m_shapeModel->setShape(primitives);
+      m_ui->shapeView->reset();
+
+      m_ui->numPaintJobsSpinBox->setValue(m_shapeModel->numPaintJobs());
+      m_ui->paintJobSpinBox->setMaximum(m_shapeModel->numPaintJobs());
+
+      isModified();
     }
     catch (QString msg) {
       QMessageBox::critical(
           this,
           QCoreApplication::applicationName(),
-          tr("Error importing Wavefront OBJ file \"%1\" to shape resource \"%2\": %3").arg(m_currentFilePath, id(), msg));
+          tr("Error importing file \"%1\" to shape resource \"%2\": %3").arg(m_currentFilePath, id(), msg));
     }
   }
 }
 
-VerticesList ShapeResource::buildVerticesList(bool boundBox) const
+PrimitivesList ShapeResource::buildPrimitives(const Mesh& mesh)
+{
+  PrimitivesList primitives;
+
+  // All primitives need the same number of paint-jobs.
+  int numPaintJobs = 1;
+  foreach (const MeshFace& face, mesh.faces) {
+    numPaintJobs = qMax(numPaintJobs, face.materials.size());
+  }
+
+  foreach (const MeshFace& face, mesh.faces) {
+    VerticesList faceVertices;
+    foreach (int index, face.indices) {
+      const QVector3D& position = mesh.positions[index];
+
+      Vertex vertex;
+      vertex.x = qRound(position.x());
+      vertex.y = qRound(position.y());
+      vertex.z = qRound(position.z());
+      faceVertices.append(vertex);
+    }
+
+    MaterialsList materials = face.materials;
+    while (materials.size() < numPaintJobs) {
+      materials.append(materials.isEmpty() ? 0 : materials.last());
+    }
+
+    Primitive primitive;
+    primitive.type = face.type;
+    primitive.twoSided = face.twoSided;
+    primitive.zBias = face.zBias;
+    primitive.verticesModel = new VerticesModel(faceVertices, m_shapeModel);
+    primitive.materialsModel = new MaterialsModel(materials, m_shapeModel);
+
+    if (face.hasCull) {
+      primitive.cull1 = face.cull1;
+      primitive.cull2 = face.cull2;
+    }
+    else {
+      m_shapeModel->computeCull(primitive);
+    }
+
+    primitives.append(primitive);
+  }
+
+  return primitives;
+}
+
+Mesh ShapeResource::buildMesh() const
+{
+  Mesh mesh;
+
+  VertexIndexMap indices;
+  VerticesList vertices = buildVerticesList(indices);
+  foreach (const Vertex& vertex, vertices) {
+    mesh.positions.append(vertex.toQ());
+  }
+
+  foreach (const Primitive& primitive, *(m_shapeModel->primitivesList())) {
+    MeshFace face;
+    face.type = primitive.type;
+    face.materials = *(primitive.materialsModel->materialsList());
+    face.twoSided = primitive.twoSided;
+    face.zBias = primitive.zBias;
+    face.hasCull = true;
+    face.cull1 = primitive.cull1;
+    face.cull2 = primitive.cull2;
+
+    foreach (const Vertex& vertex, *(primitive.verticesModel->verticesList())) {
+      face.indices.append(indices.value(vertex));
+    }
+
+    mesh.faces.append(face);
+  }
+
+  return mesh;
+}
+
+VerticesList ShapeResource::buildVerticesList(VertexIndexMap& indices, bool boundBox) const
 {
   VerticesList vertices;
+  indices.clear();
 
   if (boundBox) {
     Vertex* bound = m_shapeModel->boundBox();
     for (int i = 0; i < 8; i++) {
+      if (!indices.contains(bound[i])) {
+        indices.insert(bound[i], vertices.size());
+      }
       vertices.append(bound[i]);
     }
   }
 
   foreach (const Primitive& primitive, *(m_shapeModel->primitivesList())) {
     foreach (const Vertex& vertex, *(primitive.verticesModel->verticesList())) {
-      if (!vertices.contains(vertex)) {
+      if (!indices.contains(vertex)) {
+        indices.insert(vertex, vertices.size());
         vertices.append(vertex);
       }
       if (vertices.size() > MAX_VERTICES) {
@@ -850,6 +899,6 @@ VerticesList ShapeResource::buildVerticesList(bool boundBox) const
 
 void ShapeResource::isModified()
 {
-  m_ui->shapeView->viewport()->update();
+  m_ui->shapeView->requestFrame();
   Resource::isModified();
 }
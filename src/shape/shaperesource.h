@@ -9,6 +9,7 @@ namespace Ui
 }
 
 class ShapeModel;
+class TaskBatch;
 
 class ShapeResource : public Resource
 {
@@ -23,6 +24,10 @@ public:
   QString           type() const       { return "shape"; }
   Resource*         clone() const      { return new ShapeResource(*this); }
   Primitive*        currentPrimitive() { return m_currentPrimitive; }
+  ShapeModel*       shapeModel()       { return m_shapeModel; }
+  Mesh              buildMesh() const;
+
+  static TaskBatch*  exportShapes(const QList<ShapeResource*>& shapes, const QString& dirPath, const QString& suffix, QObject* parent = 0);
 
 signals:
   void              paintJobMoved(int oldPosition, int newPosition);
@@ -72,7 +77,8 @@ private slots:
 private:
   void              setup();
   void              showEvent(QShowEvent* event);
-  VerticesList      buildVerticesList(bool boundBox = false) const;
+  PrimitivesList    buildPrimitives(const Mesh& mesh);
+  VerticesList      buildVerticesList(VertexIndexMap& indices, bool boundBox = false) const;
 
   Ui::ShapeResource* m_ui;
 
@@ -83,13 +89,10 @@ private:
   static QString    m_currentFileFilter;
 
   static const int  MAX_VERTICES = 256;
+  static const int  MAX_PRIMITIVES = 255;
 
   static const char FILE_SETTINGS_PATH[];
   static const char FILE_FILTERS[];
   static const char MTL_SRC[];
   static const char MTL_DST[];
-
-  static const QRegExp OBJ_REGEXP_WHITESPACE;
-  static const QRegExp OBJ_REGEXP_VERTEX;
-  static const QRegExp OBJ_REGEXP_FACE;
 };
@@ -0,0 +1,305 @@
+#include <QCryptographicHash>
+#include <QDataStream>
+#include <QHash>
+#include <QMouseEvent>
+#include <QOpenGLContext>
+#include <QOpenGLFunctions>
+#include <QPainter>
+#include <QWheelEvent>
+
+#include <math.h>
+
+#include "materialsmodel.h"
+#include "shapemodel.h"
+#include "shaperenderer.h"
+#include "shapesceneview.h"
+#include "verticesmodel.h"
+
+const float ShapeSceneView::CELL_MARGIN = 1.25f;
+const float ShapeSceneView::LOD_PIXELS_PER_STEP = 2.0f;
+
+ShapeSceneView::ShapeSceneView(QWidget* parent)
+: QOpenGLWidget(parent),
+  m_sceneRadius(1.0f),
+  m_cellSize(1.0f),
+  m_distance(1.0f),
+  m_yaw(0.0f),
+  m_pitch(30.0f)
+{
+  setFormat(ShapeRenderer::format());
+}
+
+ShapeSceneView::~ShapeSceneView()
+{
+  if (context()) {
+    disconnect(context(), 0, this, 0);
+  }
+
+  destroyGL();
+}
+
+// Call once, before the view is shown. Every shape gets a cell large enough
+// for the biggest one, centred on its bound box.
+void ShapeSceneView::setShapes(const QList<ShapeModel*>& models, const QStringList& names)
+{
+  QHash<QByteArray, int> groups;
+  float maxRadius = 1.0f;
+
+  for (int i = 0; i < models.size(); i++) {
+    ShapeModel* model = models[i];
+    if (model->primitivesList()->isEmpty()) {
+      continue;
+    }
+
+    QByteArray key = geometryKey(model);
+    int group = groups.value(key, -1);
+
+    if (group < 0) {
+      Group newGroup;
+      newGroup.renderer = new ShapeRenderer(this);
+      newGroup.renderer->setModel(model);
+
+      Vertex* bound = model->boundBox();
+      QVector3D min = VerticesModel::toInternal(bound[0]).toQ(), max = min;
+      for (int j = 1; j < 8; j++) {
+        QVector3D corner = VerticesModel::toInternal(bound[j]).toQ();
+        min = QVector3D(qMin(min.x(), corner.x()), qMin(min.y(), corner.y()), qMin(min.z(), corner.z()));
+        max = QVector3D(qMax(max.x(), corner.x()), qMax(max.y(), corner.y()), qMax(max.z(), corner.z()));
+      }
+      newGroup.center = (min + max) / 2.0f;
+      newGroup.radius = qMax(1.0f, (max - min).length() / 2.0f);
+
+      newGroup.curved = false;
+      foreach (const Primitive& primitive, *model->primitivesList()) {
+        newGroup.curved |= primitive.type == PRIM_TYPE_SPHERE || primitive.type == PRIM_TYPE_WHEEL;
+      }
+
+      group = m_groups.size();
+      m_groups.append(newGroup);
+      groups.insert(key, group);
+    }
+
+    maxRadius = qMax(maxRadius, m_groups[group].radius);
+
+    Instance instance;
+    instance.name = names.value(i);
+    instance.group = group;
+    m_instances.append(instance);
+  }
+
+  m_cellSize = 2.0f * maxRadius * CELL_MARGIN;
+
+  int columns = qMax(1, (int)ceil(sqrt((double)m_instances.size())));
+  int rows = qMax(1, (m_instances.size() + columns - 1) / columns);
+
+  for (int i = 0; i < m_instances.size(); i++) {
+    const Group& group = m_groups[m_instances[i].group];
+    QVector3D cell(
+        (i % columns - (columns - 1) / 2.0f) * m_cellSize,
+        0.0f,
+        (i / columns - (rows - 1) / 2.0f) * m_cellSize);
+
+    m_instances[i].offset = cell - QVector3D(group.center.x(), 0.0f, group.center.z());
+  }
+
+  m_sceneRadius = sqrt((float)(columns * columns + rows * rows)) * m_cellSize / 2.0f + maxRadius;
+  m_distance = m_sceneRadius * 2.5f;
+  m_target = QVector3D();
+
+  update();
+}
+
+void ShapeSceneView::initializeGL()
+{
+  // The context is recreated when the widget is reparented.
+  connect(context(), SIGNAL(aboutToBeDestroyed()), this, SLOT(destroyGL()), Qt::UniqueConnection);
+
+  // All renderers use the shader program of the first one.
+  for (int i = 0; i < m_groups.size(); i++) {
+    if (!m_groups[i].renderer->initialize(i ? m_groups[0].renderer : 0)) {
+      qWarning("Shape renderer: %s", qPrintable(m_groups[i].renderer->log()));
+      break;
+    }
+  }
+}
+
+void ShapeSceneView::destroyGL()
+{
+  if (m_groups.isEmpty() || !m_groups[0].renderer->isInitialized()) {
+    return;
+  }
+
+  makeCurrent();
+  for (int i = m_groups.size() - 1; i >= 0; i--) {
+    m_groups[i].renderer->destroy();
+  }
+  doneCurrent();
+}
+
+void ShapeSceneView::paintGL()
+{
+  QOpenGLFunctions* gl = context()->functions();
+  gl->glClearColor(1.0f, 1.0f, 1.0f, 1.0f);
+  gl->glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+  QMatrix4x4 projection = this->projection();
+  QMatrix4x4 view = this->view();
+  QMatrix4x4 transform = projection * view;
+
+  // Frustum planes from the combined matrix, pointing inwards.
+  QVector4D planes[6];
+  for (int i = 0; i < 3; i++) {
+    planes[i * 2] = transform.row(3) + transform.row(i);
+    planes[i * 2 + 1] = transform.row(3) - transform.row(i);
+  }
+  for (int i = 0; i < 6; i++) {
+    planes[i] /= planes[i].toVector3D().length();
+  }
+
+  QVector<float> nearest(m_groups.size(), INFINITY);
+  QVector<int> drawn;
+
+  for (int i = 0; i < m_groups.size(); i++) {
+    m_groups[i].visible.clear();
+  }
+
+  for (int i = 0; i < m_instances.size(); i++) {
+    const Instance& instance = m_instances[i];
+    Group& group = m_groups[instance.group];
+    QVector3D center = group.center + instance.offset;
+
+    bool inside = true;
+    for (int j = 0; j < 6 && inside; j++) {
+      inside = QVector3D::dotProduct(planes[j].toVector3D(), center) + planes[j].w() >= -group.radius;
+    }
+
+    if (inside) {
+      group.visible.append(instance.offset);
+      nearest[instance.group] = qMin(nearest[instance.group], -view.map(center).z());
+      drawn.append(i);
+    }
+  }
+
+  int drawCalls = 0;
+
+  for (int i = 0; i < m_groups.size(); i++) {
+    Group& group = m_groups[i];
+    if (group.visible.isEmpty()) {
+      continue;
+    }
+
+    // Circle steps by the on-screen radius of the closest copy.
+    if (group.curved) {
+      float pixels = group.radius * projection(1, 1) / qMax(1.0f, nearest[i]) * height() / 2.0f;
+      group.renderer->setCircleSteps(qRound(pixels / LOD_PIXELS_PER_STEP));
+    }
+
+    group.renderer->renderInstances(projection, view, 0, group.visible);
+    drawCalls += group.renderer->stats().drawCalls;
+  }
+
+  paintLabels(projection, view, drawn, drawCalls);
+}
+
+// Names are only drawn when the cells are large enough to tell them apart.
+void ShapeSceneView::paintLabels(const QMatrix4x4& projection, const QMatrix4x4& view, const QVector<int>& drawn, int drawCalls)
+{
+  QPainter painter(this);
+  painter.setPen(Qt::black);
+
+  QMatrix4x4 transform = projection * view;
+
+  foreach (int i, drawn) {
+    const Instance& instance = m_instances[i];
+    const Group& group = m_groups[instance.group];
+    QVector3D base = instance.offset + QVector3D(group.center.x(), group.center.y() - group.radius, group.center.z());
+
+    float distance = -view.map(base).z();
+    if (distance <= 0.0f || m_cellSize * projection(1, 1) / distance * height() / 2.0f < LABEL_MIN_PIXELS) {
+      continue;
+    }
+
+    QVector3D ndc = transform.map(base);
+    QPointF point((ndc.x() + 1.0f) * width() / 2.0f, (1.0f - ndc.y()) * height() / 2.0f);
+    painter.drawText(QRectF(point.x() - 100.0, point.y(), 200.0, 20.0), Qt::AlignHCenter | Qt::AlignTop, instance.name);
+  }
+
+  painter.drawText(rect().adjusted(4, 4, -4, -4), Qt::AlignLeft | Qt::AlignTop,
+      tr("%1 of %2 shapes, %3 unique, %4 draw calls").arg(drawn.size()).arg(m_instances.size()).arg(m_groups.size()).arg(drawCalls));
+}
+
+QMatrix4x4 ShapeSceneView::projection() const
+{
+  float farPlane = m_distance + m_sceneRadius * 2.0f;
+
+  QMatrix4x4 projection;
+  projection.perspective(45.0f, (float)width() / (float)qMax(1, height()), qMax(1.0f, farPlane / 5000.0f), farPlane);
+
+  return projection;
+}
+
+QMatrix4x4 ShapeSceneView::view() const
+{
+  QMatrix4x4 view;
+  view.translate(0.0f, 0.0f, -m_distance);
+  view.rotate(m_pitch, 1.0f, 0.0f, 0.0f);
+  view.rotate(m_yaw, 0.0f, 1.0f, 0.0f);
+  view.translate(-m_target);
+
+  return view;
+}
+
+// Geometry and first paint-job materials, the rest does not change the
+// picture.
+QByteArray ShapeSceneView::geometryKey(ShapeModel* model)
+{
+  QByteArray data;
+  QDataStream out(&data, QIODevice::WriteOnly);
+
+  foreach (const Primitive& primitive, *model->primitivesList()) {
+    out << primitive.type << primitive.twoSided << primitive.zBias;
+    out << primitive.materialsModel->materialsList()->value(0);
+
+    foreach (const Vertex& vertex, *primitive.verticesModel->verticesList()) {
+      out << vertex.x << vertex.y << vertex.z;
+    }
+  }
+
+  return QCryptographicHash::hash(data, QCryptographicHash::Sha1);
+}
+
+void ShapeSceneView::mousePressEvent(QMouseEvent* event)
+{
+  event->accept();
+  m_lastMousePosition = event->pos();
+}
+
+void ShapeSceneView::mouseMoveEvent(QMouseEvent* event)
+{
+  event->accept();
+
+  QPoint delta = event->pos() - m_lastMousePosition;
+  m_lastMousePosition = event->pos();
+
+  if (event->buttons() & Qt::LeftButton) {
+    m_yaw += delta.x() * 0.25f;
+    m_pitch = qBound(-89.0f, m_pitch + delta.y() * 0.25f, 89.0f);
+  }
+  else if (event->buttons() & (Qt::MiddleButton | Qt::RightButton)) {
+    // Pan on the ground plane, scaled by the distance.
+    QMatrix4x4 heading;
+    heading.rotate(-m_yaw, 0.0f, 1.0f, 0.0f);
+    float scale = m_distance * 0.002f;
+    m_target -= heading.map(QVector3D(delta.x() * scale, 0.0f, delta.y() * scale));
+  }
+
+  update();
+}
+
+void ShapeSceneView::wheelEvent(QWheelEvent* event)
+{
+  event->accept();
+
+  m_distance = qBound(m_cellSize * 0.1f, m_distance * powf(0.999f, event->angleDelta().y()), m_sceneRadius * 10.0f);
+  update();
+}
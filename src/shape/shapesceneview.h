@@ -0,0 +1,74 @@
+#pragma once
+
+#include <QMatrix4x4>
+#include <QOpenGLWidget>
+#include <QStringList>
+#include <QVector>
+#include <QVector3D>
+
+class ShapeModel;
+class ShapeRenderer;
+
+// Shows many shapes at once, laid out on a grid on the ground plane. Shapes
+// with identical geometry and materials share one renderer and are drawn
+// with instancing. Each instance is culled against the view frustum by the
+// bounding sphere of its bound box, and the circle detail of spheres and
+// wheels follows the on-screen size of the closest instance.
+class ShapeSceneView : public QOpenGLWidget
+{
+  Q_OBJECT
+
+public:
+  ShapeSceneView(QWidget* parent = 0);
+  ~ShapeSceneView();
+
+  // The models must stay alive while the view exists.
+  void              setShapes(const QList<ShapeModel*>& models, const QStringList& names);
+
+protected:
+  void              initializeGL();
+  void              paintGL();
+
+  void              mousePressEvent(QMouseEvent* event);
+  void              mouseMoveEvent(QMouseEvent* event);
+  void              wheelEvent(QWheelEvent* event);
+
+private slots:
+  void              destroyGL();
+
+private:
+  typedef struct {
+    ShapeRenderer*  renderer;
+    QVector3D       center;
+    float           radius;
+    bool            curved;
+    QVector<QVector3D> visible;
+  } Group;
+
+  typedef struct {
+    QString         name;
+    int             group;
+    QVector3D       offset;
+  } Instance;
+
+  QMatrix4x4        projection() const;
+  QMatrix4x4        view() const;
+  void              paintLabels(const QMatrix4x4& projection, const QMatrix4x4& view, const QVector<int>& drawn, int drawCalls);
+
+  static QByteArray geometryKey(ShapeModel* model);
+
+  QVector<Group>    m_groups;
+  QVector<Instance> m_instances;
+  float             m_sceneRadius;
+  float             m_cellSize;
+
+  QVector3D         m_target;
+  float             m_distance;
+  float             m_yaw;
+  float             m_pitch;
+  QPoint            m_lastMousePosition;
+
+  static const float CELL_MARGIN;
+  static const float LOD_PIXELS_PER_STEP;
+  static const int  LABEL_MIN_PIXELS = 48;
+};
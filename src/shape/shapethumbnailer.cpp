@@ -0,0 +1,212 @@
+#include <QCryptographicHash>
+#include <QDataStream>
+#include <QDir>
+#include <QFile>
+#include <QImage>
+#include <QMutexLocker>
+#include <QSaveFile>
+
+#include "app/settings.h"
+#include "materialsmodel.h"
+#include "shapemodel.h"
+#include "shapeoffscreen.h"
+#include "shaperasterizer.h"
+#include "shaperenderer.h"
+#include "shapethumbnailer.h"
+#include "verticesmodel.h"
+
+const char ShapeThumbnailer::CACHE_DIR[] = "cache";
+
+ShapeThumbnailer::ShapeThumbnailer(const QString& dirPath, const QSize& size, bool software)
+: m_dirPath(dirPath),
+  m_size(software ? QSize(ShapeRasterizer::WIDTH, ShapeRasterizer::HEIGHT) : size),
+  m_software(software),
+  m_next(0),
+  m_rendered(0),
+  m_cached(0)
+{
+  QDir(m_dirPath).mkpath(CACHE_DIR);
+}
+
+// The hash covers the geometry, flags, cull words and the resolved colour and
+// pattern of the first paint-job, which is the one drawn.
+void ShapeThumbnailer::add(ShapeModel* model, const QString& name)
+{
+  if (model->primitivesList()->isEmpty()) {
+    return;
+  }
+
+  Job job;
+  job.name = name;
+
+  QByteArray data;
+  QDataStream out(&data, QIODevice::WriteOnly);
+  out << (qint32)HASH_VERSION << m_size << m_software;
+
+  foreach (Primitive primitive, *(model->primitivesList())) {
+    job.vertices.append(*(primitive.verticesModel->verticesList()));
+    job.materials.append(*(primitive.materialsModel->materialsList()));
+
+    out << primitive.type << primitive.twoSided << primitive.zBias << primitive.cull1 << primitive.cull2;
+    foreach (const Vertex& vertex, job.vertices.last()) {
+      out << vertex.x << vertex.y << vertex.z;
+    }
+
+    // Wheels draw their tread and hub with the two following materials.
+    int count = primitive.type == PRIM_TYPE_WHEEL ? 3 : 1;
+    for (int i = 0; i < count; i++) {
+      quint8 material = qMin(job.materials.last().value(0) + i, (int)MaterialsModel::VAL_MAX);
+      Material properties = Settings::m_loadedMaterials.value(material);
+      out << material << Settings::m_loadedPalette.value(properties.color) << (qint32)properties.pattern;
+    }
+
+    primitive.verticesModel = 0;
+    primitive.materialsModel = 0;
+    job.primitives.append(primitive);
+  }
+
+  job.cachePath = QDir(m_dirPath).absoluteFilePath(QString("%1/%2.png")
+      .arg(CACHE_DIR, QString(QCryptographicHash::hash(data, QCryptographicHash::Sha1).toHex())));
+
+  if (QFile::exists(job.cachePath)) {
+    if (publish(job)) {
+      m_cached++;
+    }
+  }
+  else {
+    m_jobs.append(job);
+  }
+}
+
+// Renders the shapes that were not found in the cache and returns the errors,
+// if any. Contexts are created here and handed to one worker thread each,
+// which take jobs from a shared counter until all are done.
+QStringList ShapeThumbnailer::run(int threads)
+{
+  QList<Worker*> workers;
+  int count = qBound(1, threads, qMax(1, m_jobs.size()));
+
+  for (int i = 0; i < count && !m_jobs.isEmpty(); i++) {
+    if (m_software) {
+      workers.append(new Worker(this, 0));
+      continue;
+    }
+
+    ShapeOffscreen* offscreen = new ShapeOffscreen(m_size);
+
+    if (!offscreen->isValid()) {
+      if (workers.isEmpty()) {
+        m_errors.append(tr("Offscreen rendering is not available: %1").arg(offscreen->log()));
+      }
+
+      delete offscreen;
+      break;
+    }
+
+    Worker* worker = new Worker(this, offscreen);
+    offscreen->moveToThread(worker);
+    workers.append(worker);
+  }
+
+  foreach (Worker* worker, workers) {
+    worker->start();
+  }
+
+  foreach (Worker* worker, workers) {
+    worker->wait();
+    delete worker;
+  }
+
+  m_jobs.clear();
+  m_next = 0;
+
+  return m_errors;
+}
+
+void ShapeThumbnailer::render(ShapeOffscreen* offscreen, const Job& job)
+{
+  // The submodels are children of the model and go with it.
+  ShapeModel model;
+  PrimitivesList primitives = job.primitives;
+  for (int i = 0; i < primitives.size(); i++) {
+    primitives[i].verticesModel = new VerticesModel(job.vertices.at(i), &model);
+    primitives[i].materialsModel = new MaterialsModel(job.materials.at(i), &model);
+  }
+
+  model.setShape(primitives);
+
+  QImage image;
+  if (offscreen) {
+    image = offscreen->render(&model);
+  }
+  else {
+    QMatrix4x4 translation, rotation;
+    ShapeRenderer::frame(&model, translation, rotation);
+    image = ShapeRasterizer().render(&model, ShapeRasterizer::projection(), translation * rotation);
+  }
+
+  if (image.isNull()) {
+    error(job, tr("Rendering failed."));
+    return;
+  }
+
+  // Identical shapes may be rendered by two threads at once, the atomic
+  // rename makes the last one win.
+  QSaveFile file(job.cachePath);
+  if (!file.open(QIODevice::WriteOnly) || !image.save(&file, "PNG") || !file.commit()) {
+    error(job, tr("Couldn't write to file \"%1\".").arg(job.cachePath));
+    return;
+  }
+
+  if (publish(job)) {
+    QMutexLocker locker(&m_mutex);
+    m_rendered++;
+  }
+}
+
+bool ShapeThumbnailer::publish(const Job& job)
+{
+  QString filePath = QDir(m_dirPath).absoluteFilePath(job.name + ".png");
+
+  QFile::remove(filePath);
+  if (!QFile::copy(job.cachePath, filePath)) {
+    error(job, tr("Couldn't write to file \"%1\".").arg(filePath));
+    return false;
+  }
+
+  return true;
+}
+
+void ShapeThumbnailer::error(const Job& job, const QString& msg)
+{
+  QMutexLocker locker(&m_mutex);
+  m_errors.append(QString("%1: %2").arg(job.name, msg));
+}
+
+ShapeThumbnailer::Worker::Worker(ShapeThumbnailer* thumbnailer, ShapeOffscreen* offscreen)
+: m_thumbnailer(thumbnailer),
+  m_offscreen(offscreen)
+{
+}
+
+// Runs after wait() on the GUI thread, where the context was moved back to.
+ShapeThumbnailer::Worker::~Worker()
+{
+  delete m_offscreen;
+}
+
+void ShapeThumbnailer::Worker::run()
+{
+  for (;;) {
+    int i = m_thumbnailer->m_next.fetchAndAddOrdered(1);
+    if (i >= m_thumbnailer->m_jobs.size()) {
+      break;
+    }
+
+    m_thumbnailer->render(m_offscreen, m_thumbnailer->m_jobs.at(i));
+  }
+
+  if (m_offscreen) {
+    m_offscreen->moveToThread(QCoreApplication::instance()->thread());
+  }
+}
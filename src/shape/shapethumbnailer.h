@@ -0,0 +1,74 @@
+#pragma once
+
+#include <QAtomicInt>
+#include <QCoreApplication>
+#include <QMutex>
+#include <QSize>
+#include <QStringList>
+#include <QThread>
+
+#include "types.h"
+
+class ShapeModel;
+class ShapeOffscreen;
+
+// Renders preview images of many shapes to PNG files. Shapes are copied when
+// added, so the source models can be deleted before run(). Every worker
+// thread renders with its own GL context. Images are cached in a
+// subdirectory under the hash of everything that affects the picture, so
+// unchanged shapes are only copied on the next run. In software mode the
+// images come from ShapeRasterizer at its native size and need no GL at all.
+class ShapeThumbnailer
+{
+  Q_DECLARE_TR_FUNCTIONS(ShapeThumbnailer)
+
+public:
+  ShapeThumbnailer(const QString& dirPath, const QSize& size, bool software = false);
+
+  void              add(ShapeModel* model, const QString& name);
+  QStringList       run(int threads = QThread::idealThreadCount());
+
+  int               rendered() const { return m_rendered; }
+  int               cached() const   { return m_cached; }
+
+  static const char CACHE_DIR[];
+
+private:
+  typedef struct {
+    QString         name;
+    QString         cachePath;
+    PrimitivesList  primitives;
+    QList<VerticesList> vertices;
+    QList<MaterialsList> materials;
+  } Job;
+
+  class Worker : public QThread
+  {
+  public:
+    Worker(ShapeThumbnailer* thumbnailer, ShapeOffscreen* offscreen);
+    ~Worker();
+
+  protected:
+    void            run();
+
+  private:
+    ShapeThumbnailer* m_thumbnailer;
+    ShapeOffscreen* m_offscreen;
+  };
+
+  void              render(ShapeOffscreen* offscreen, const Job& job);
+  bool              publish(const Job& job);
+  void              error(const Job& job, const QString& msg);
+
+  QString           m_dirPath;
+  QSize             m_size;
+  bool              m_software;
+  QList<Job>        m_jobs;
+  QAtomicInt        m_next;
+  QStringList       m_errors;
+  QMutex            m_mutex;
+  int               m_rendered;
+  int               m_cached;
+
+  static const int  HASH_VERSION = 2;
+};
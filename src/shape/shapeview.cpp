@@ -1,135 +1,142 @@
-#if defined(_WIN32)
-#include <windows.h>
-#endif
-#include <GL/glu.h>
-#include <QGLWidget>
-#include <QPaintEvent>
-#include <QVector3D>
-#define _USE_MATH_DEFINES
-#include <math.h>
-
-#include "app/settings.h"
-#include "materialsmodel.h"
+#include <QMouseEvent>
+#include <QOpenGLContext>
+#include <QOpenGLTimerQuery>
+#include <QOpenGLWidget>
+#include <QPainter>
+#include <QRubberBand>
+
+#include "app/palettemanager.h"
+#include "circletable.h"
+#include "shaperenderer.h"
 #include "shapeview.h"
 #include "verticesmodel.h"
 
-// Convert 8-bit primitive index to unique RGB color used for picking.
-#define CODE2COLOR(i) QColor(i & 0xE0, (i & 0x1C) << 3, (i & 0x3) << 6)
-#define COLOR2CODE(c) (c[0] | c[1] >> 3 | c[2] >> 6)
-
-const quint8 ShapeView::PATTERNS[6][0x80] = {
-  { // Transparent
-    0x00
-  },
-  { // Grate
-    0xCF, 0xCF, 0xCF, 0xCF, 0xCF, 0xCF, 0xCF, 0xCF, 0xFC, 0xFC, 0xFC, 0xFC, 0xFC, 0xFC, 0xFC, 0xFC,
-    0xCF, 0xCF, 0xCF, 0xCF, 0xCF, 0xCF, 0xCF, 0xCF, 0xFC, 0xFC, 0xFC, 0xFC, 0xFC, 0xFC, 0xFC, 0xFC,
-    0xCF, 0xCF, 0xCF, 0xCF, 0xCF, 0xCF, 0xCF, 0xCF, 0xFC, 0xFC, 0xFC, 0xFC, 0xFC, 0xFC, 0xFC, 0xFC,
-    0xCF, 0xCF, 0xCF, 0xCF, 0xCF, 0xCF, 0xCF, 0xCF, 0xFC, 0xFC, 0xFC, 0xFC, 0xFC, 0xFC, 0xFC, 0xFC,
-    0xCF, 0xCF, 0xCF, 0xCF, 0xCF, 0xCF, 0xCF, 0xCF, 0xFC, 0xFC, 0xFC, 0xFC, 0xFC, 0xFC, 0xFC, 0xFC,
-    0xCF, 0xCF, 0xCF, 0xCF, 0xCF, 0xCF, 0xCF, 0xCF, 0xFC, 0xFC, 0xFC, 0xFC, 0xFC, 0xFC, 0xFC, 0xFC,
-    0xCF, 0xCF, 0xCF, 0xCF, 0xCF, 0xCF, 0xCF, 0xCF, 0xFC, 0xFC, 0xFC, 0xFC, 0xFC, 0xFC, 0xFC, 0xFC,
-    0xCF, 0xCF, 0xCF, 0xCF, 0xCF, 0xCF, 0xCF, 0xCF, 0xFC, 0xFC, 0xFC, 0xFC, 0xFC, 0xFC, 0xFC, 0xFC
-  },
-  { // Grille
-    0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0x0F, 0x0F, 0x0F, 0x0F, 0x0F, 0x0F, 0x0F, 0x0F,
-    0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0x0F, 0x0F, 0x0F, 0x0F, 0x0F, 0x0F, 0x0F, 0x0F,
-    0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0x0F, 0x0F, 0x0F, 0x0F, 0x0F, 0x0F, 0x0F, 0x0F,
-    0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0x0F, 0x0F, 0x0F, 0x0F, 0x0F, 0x0F, 0x0F, 0x0F,
-    0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0x0F, 0x0F, 0x0F, 0x0F, 0x0F, 0x0F, 0x0F, 0x0F,
-    0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0x0F, 0x0F, 0x0F, 0x0F, 0x0F, 0x0F, 0x0F, 0x0F,
-    0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0x0F, 0x0F, 0x0F, 0x0F, 0x0F, 0x0F, 0x0F, 0x0F,
-    0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0x0F, 0x0F, 0x0F, 0x0F, 0x0F, 0x0F, 0x0F, 0x0F
-  },
-  { // Inverse grille
-    0x0F, 0x0F, 0x0F, 0x0F, 0x0F, 0x0F, 0x0F, 0x0F, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0,
-    0x0F, 0x0F, 0x0F, 0x0F, 0x0F, 0x0F, 0x0F, 0x0F, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0,
-    0x0F, 0x0F, 0x0F, 0x0F, 0x0F, 0x0F, 0x0F, 0x0F, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0,
-    0x0F, 0x0F, 0x0F, 0x0F, 0x0F, 0x0F, 0x0F, 0x0F, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0,
-    0x0F, 0x0F, 0x0F, 0x0F, 0x0F, 0x0F, 0x0F, 0x0F, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0,
-    0x0F, 0x0F, 0x0F, 0x0F, 0x0F, 0x0F, 0x0F, 0x0F, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0,
-    0x0F, 0x0F, 0x0F, 0x0F, 0x0F, 0x0F, 0x0F, 0x0F, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0,
-    0x0F, 0x0F, 0x0F, 0x0F, 0x0F, 0x0F, 0x0F, 0x0F, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0
-  },
-  { // Glass
-    0xF3, 0x3C, 0xF3, 0x3C, 0xF3, 0x3C, 0xF3, 0x3C, 0x3C, 0xCF, 0x3C, 0xCF, 0x3C, 0xCF, 0x3C, 0xCF,
-    0xF3, 0x3C, 0xF3, 0x3C, 0xF3, 0x3C, 0xF3, 0x3C, 0x3C, 0xCF, 0x3C, 0xCF, 0x3C, 0xCF, 0x3C, 0xCF,
-    0xF3, 0x3C, 0xF3, 0x3C, 0xF3, 0x3C, 0xF3, 0x3C, 0x3C, 0xCF, 0x3C, 0xCF, 0x3C, 0xCF, 0x3C, 0xCF,
-    0xF3, 0x3C, 0xF3, 0x3C, 0xF3, 0x3C, 0xF3, 0x3C, 0x3C, 0xCF, 0x3C, 0xCF, 0x3C, 0xCF, 0x3C, 0xCF,
-    0xF3, 0x3C, 0xF3, 0x3C, 0xF3, 0x3C, 0xF3, 0x3C, 0x3C, 0xCF, 0x3C, 0xCF, 0x3C, 0xCF, 0x3C, 0xCF,
-    0xF3, 0x3C, 0xF3, 0x3C, 0xF3, 0x3C, 0xF3, 0x3C, 0x3C, 0xCF, 0x3C, 0xCF, 0x3C, 0xCF, 0x3C, 0xCF,
-    0xF3, 0x3C, 0xF3, 0x3C, 0xF3, 0x3C, 0xF3, 0x3C, 0x3C, 0xCF, 0x3C, 0xCF, 0x3C, 0xCF, 0x3C, 0xCF,
-    0xF3, 0x3C, 0xF3, 0x3C, 0xF3, 0x3C, 0xF3, 0x3C, 0x3C, 0xCF, 0x3C, 0xCF, 0x3C, 0xCF, 0x3C, 0xCF
-  },
-  { // Inverse glass
-    0x0C, 0xC3, 0x0C, 0xC3, 0x0C, 0xC3, 0x0C, 0xC3, 0xC3, 0x30, 0xC3, 0x30, 0xC3, 0x30, 0xC3, 0x30,
-    0x0C, 0xC3, 0x0C, 0xC3, 0x0C, 0xC3, 0x0C, 0xC3, 0xC3, 0x30, 0xC3, 0x30, 0xC3, 0x30, 0xC3, 0x30,
-    0x0C, 0xC3, 0x0C, 0xC3, 0x0C, 0xC3, 0x0C, 0xC3, 0xC3, 0x30, 0xC3, 0x30, 0xC3, 0x30, 0xC3, 0x30,
-    0x0C, 0xC3, 0x0C, 0xC3, 0x0C, 0xC3, 0x0C, 0xC3, 0xC3, 0x30, 0xC3, 0x30, 0xC3, 0x30, 0xC3, 0x30,
-    0x0C, 0xC3, 0x0C, 0xC3, 0x0C, 0xC3, 0x0C, 0xC3, 0xC3, 0x30, 0xC3, 0x30, 0xC3, 0x30, 0xC3, 0x30,
-    0x0C, 0xC3, 0x0C, 0xC3, 0x0C, 0xC3, 0x0C, 0xC3, 0xC3, 0x30, 0xC3, 0x30, 0xC3, 0x30, 0xC3, 0x30,
-    0x0C, 0xC3, 0x0C, 0xC3, 0x0C, 0xC3, 0x0C, 0xC3, 0xC3, 0x30, 0xC3, 0x30, 0xC3, 0x30, 0xC3, 0x30,
-    0x0C, 0xC3, 0x0C, 0xC3, 0x0C, 0xC3, 0x0C, 0xC3, 0xC3, 0x30, 0xC3, 0x30, 0xC3, 0x30, 0xC3, 0x30
+// OpenGL viewport, painting is forwarded to the view.
+class ShapeViewport : public QOpenGLWidget
+{
+public:
+  ShapeViewport(ShapeView* view)
+  : QOpenGLWidget(view),
+    m_view(view)
+  {
+    setFormat(ShapeRenderer::format());
   }
+
+protected:
+  void              initializeGL() { m_view->initializeGL(); }
+  void              paintGL()      { m_view->paintGL(); }
+
+private:
+  ShapeView*        m_view;
 };
 
+static const int CULL_STEPS = 15;
+static constexpr CircleTable<CULL_STEPS> CULL_CIRCLE;
+
 const float ShapeView::VERTEX_HIGHLIGHT_OFFSET = 20.0f;
-const float ShapeView::PI2 = M_PI * 2.0f;
-const float ShapeView::SPHERE_RADIUS_RATIO = 2.0f / 3.0f;
-const float ShapeView::WHEEL_TYRE_RATIO = 3.0f / 5.0f;
+const int ShapeView::FRAME_TIMEOUT = 100;
 
 ShapeView::ShapeView(QWidget* parent)
 : QAbstractItemView(parent)
 {
   m_shapeModel = 0;
   m_currentPaintJob = 0;
-  m_wireframe = false;
   m_showCullData = false;
+  m_showStats = false;
+  m_gameLook = false;
+  m_gameCulling = false;
+  m_selectedRowsValid = false;
   m_vertexSelection = 0;
+  m_cullWordsValid = false;
 
-  m_glWidget = new QGLWidget(this);
-  m_glWidget->makeCurrent();
-  m_glWidget->qglClearColor(Qt::white);
+  m_framePending = false;
+  m_frameRequested = false;
+  m_swapInterval = 0;
+  m_timerQueryPending = false;
+  m_gpuTime = 0;
+
+  m_renderer = new ShapeRenderer(this);
+  m_glWidget = new ShapeViewport(this);
+  m_timerQuery = new QOpenGLTimerQuery(this);
 
-  glEnable(GL_DEPTH_TEST);
-  glEnable(GL_CULL_FACE);
-  glShadeModel(GL_FLAT);
+  m_frameTimer.setSingleShot(true);
+  m_frameTimer.setInterval(FRAME_TIMEOUT);
+  connect(&m_frameTimer, SIGNAL(timeout()), this, SLOT(frameTimeout()));
 
   setViewport(m_glWidget);
+  connect(m_glWidget, SIGNAL(frameSwapped()), this, SLOT(frameSwapped()));
+  connect(PaletteManager::instance(), SIGNAL(paletteChanged()), this, SLOT(updatePalette()));
+
+  m_rubberBand = new QRubberBand(QRubberBand::Rectangle, viewport());
+}
+
+ShapeView::~ShapeView()
+{
+  if (m_glWidget->context()) {
+    disconnect(m_glWidget->context(), 0, this, 0);
+  }
+
+  destroyGL();
 }
 
 void ShapeView::setModel(QAbstractItemModel* model)
 {
   m_shapeModel = qobject_cast<ShapeModel*>(model);
+  m_renderer->setModel(m_shapeModel);
 
   QAbstractItemView::setModel(model);
 }
 
-void ShapeView::reset()
+void ShapeView::setSelectionModel(QItemSelectionModel* selectionModel)
 {
-  m_translation.setToIdentity();
-  m_rotation.setToIdentity();
+  QAbstractItemView::setSelectionModel(selectionModel);
+  m_selectedRowsValid = false;
+}
 
-  if (m_shapeModel) {
-    Vertex* bound = m_shapeModel->boundBox();
-    m_translation.translate(
-        0.0f,
-        -((bound[4].y + bound[0].y) / 2) * VerticesModel::Y_RATIO,
-        0.0f);
-    m_translation.translate(
-        0.0f,
-        0.0f,
-        -distance(VerticesModel::toInternal(bound[2]), VerticesModel::toInternal(bound[5])));
-    m_rotation.rotate(10.0f, 1.0f, 0.0f, 0.0f);
+// Only the rows are kept, so that drawing does not query the selection.
+void ShapeView::setVertexSelectionModel(QItemSelectionModel* selection)
+{
+  if (m_vertexSelection) {
+    disconnect(m_vertexSelection.data(), 0, this, 0);
   }
 
+  m_vertexSelection = selection;
+
+  if (m_vertexSelection) {
+    connect(m_vertexSelection.data(), SIGNAL(selectionChanged(QItemSelection, QItemSelection)), this, SLOT(vertexSelectionChanged()));
+  }
+
+  vertexSelectionChanged();
+}
+
+void ShapeView::reset()
+{
+  m_selectedRowsValid = false;
+  m_cullWordsValid = false;
+  ShapeRenderer::frame(m_shapeModel, m_translation, m_rotation);
+
   QAbstractItemView::reset();
+  requestFrame();
+}
+
+// Schedules a repaint. While the last frame has not been swapped yet, the
+// requests are collected and flushed by frameSwapped(), so that at most one
+// frame is drawn per display refresh however often the models change. The
+// frame timer flushes them if a swap is never reported.
+void ShapeView::requestFrame()
+{
+  if (m_framePending) {
+    m_frameRequested = true;
+    return;
+  }
+
+  m_glWidget->update();
 }
 
 void ShapeView::setCurrentPaintJob(int paintJob)
 {
   m_currentPaintJob = qMax(0, paintJob - 1);
-  viewport()->update();
+  requestFrame();
 }
 
 void ShapeView::adjustCurrentPaintJobAfterMove(int oldPosition, int newPosition)
@@ -145,418 +152,412 @@ void ShapeView::adjustCurrentPaintJobAfterMove(int oldPosition, int newPosition)
   }
 }
 
+void ShapeView::updatePalette()
+{
+  m_renderer->invalidateMaterials();
+  requestFrame();
+}
+
 void ShapeView::toggleWireframe(bool enable)
 {
-  m_wireframe = enable;
-  glPolygonMode(GL_FRONT_AND_BACK, (enable ? GL_LINE : GL_FILL));
-  viewport()->update();
+  m_renderer->setWireframe(enable);
+  requestFrame();
+}
+
+void ShapeView::toggleShading(bool enable)
+{
+  m_renderer->setShading(enable);
+  requestFrame();
+}
+
+void ShapeView::setDetail(int level)
+{
+  m_renderer->setCircleSteps(ShapeRenderer::CIRCLE_STEPS / 2 << level);
+  requestFrame();
 }
 
 void ShapeView::toggleShowCullData(bool enable)
 {
   m_showCullData = enable;
-  viewport()->update();
+  requestFrame();
 }
 
-void ShapeView::updateGeometries()
+void ShapeView::toggleShowStats(bool enable)
 {
-  int width = viewport()->width();
-  int height = qMax(1, viewport()->height());
+  m_showStats = enable;
+  requestFrame();
+}
 
-  m_glWidget->makeCurrent();
-  glViewport(0, 0, width, height);
+void ShapeView::toggleGameLook(bool enable)
+{
+  m_gameLook = enable;
+  requestFrame();
+}
 
-  glMatrixMode(GL_PROJECTION);
-  glLoadIdentity();
-  gluPerspective(45.0f, (GLfloat)width / (GLfloat)height, 0.1f, 5000.0f);
+// Hides the primitives the game would not draw from the current camera.
+void ShapeView::toggleGameCulling(bool enable)
+{
+  m_gameCulling = enable;
+  requestFrame();
+}
 
-  glMatrixMode(GL_MODELVIEW);
+void ShapeView::dataChanged(const QModelIndex& /*topLeft*/, const QModelIndex& /*bottomRight*/, const QVector<int>& /*roles*/)
+{
+  m_cullWordsValid = false;
+  requestFrame();
+}
 
-  QAbstractItemView::updateGeometries();
+// The selected rows are tracked from the changes, a range outside the known
+// rows makes updateSelectedRows() read them all again.
+void ShapeView::selectionChanged(const QItemSelection& selected, const QItemSelection& deselected)
+{
+  foreach (const QItemSelectionRange& range, deselected) {
+    if (range.bottom() >= m_selectedRows.size()) {
+      m_selectedRowsValid = false;
+      break;
+    }
+    m_selectedRows.fill(false, range.top(), range.bottom() + 1);
+  }
+
+  foreach (const QItemSelectionRange& range, selected) {
+    if (range.bottom() >= m_selectedRows.size()) {
+      m_selectedRowsValid = false;
+      break;
+    }
+    m_selectedRows.fill(true, range.top(), range.bottom() + 1);
+  }
+
+  requestFrame();
 }
 
-void ShapeView::showEvent(QShowEvent* event)
+void ShapeView::rowsInserted(const QModelIndex& parent, int start, int end)
 {
-  m_glWidget->makeCurrent();
-  QAbstractItemView::showEvent(event);
+  m_selectedRowsValid = false;
+  m_cullWordsValid = false;
+  QAbstractItemView::rowsInserted(parent, start, end);
 }
 
-void ShapeView::paintEvent(QPaintEvent* event)
+void ShapeView::rowsAboutToBeRemoved(const QModelIndex& parent, int start, int end)
 {
-  event->accept();
+  m_selectedRowsValid = false;
+  m_cullWordsValid = false;
+  QAbstractItemView::rowsAboutToBeRemoved(parent, start, end);
+}
+
+void ShapeView::vertexSelectionChanged()
+{
+  m_selectedVertices.clear();
 
-  draw(false);
+  if (m_vertexSelection) {
+    foreach (const QModelIndex& index, m_vertexSelection->selectedRows()) {
+      m_selectedVertices.append(index.row());
+    }
+  }
 
-  m_glWidget->swapBuffers();
+  requestFrame();
 }
 
-void ShapeView::draw(bool pick)
+void ShapeView::destroyGL()
 {
-  if (!m_shapeModel) {
-    return;
+  if (m_renderer->isInitialized()) {
+    m_glWidget->makeCurrent();
+    m_renderer->destroy();
+    m_timerQuery->destroy();
+    m_timerQueryPending = false;
+    m_glWidget->doneCurrent();
   }
+}
 
-  glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-  glLoadIdentity();
+void ShapeView::frameSwapped()
+{
+  m_swapInterval = m_swapTimer.isValid() ? m_swapTimer.restart() : 0;
+  if (!m_swapTimer.isValid()) {
+    m_swapTimer.start();
+  }
 
-  glPushMatrix();
-  glMultMatrixf(m_translation.constData());
-  glMultMatrixf(m_rotation.constData());
+  m_frameTimer.stop();
+  m_framePending = false;
 
-  int i = 0;
-  QItemSelectionModel* selections = selectionModel();
+  if (m_frameRequested) {
+    m_frameRequested = false;
+    m_glWidget->update();
+  }
+}
 
-  foreach (const Primitive& primitive, *m_shapeModel->primitivesList()) {
-    VerticesFList* verticesFList = primitive.verticesModel->verticesFList();
-    MaterialsList* materialsList = primitive.materialsModel->materialsList();
+// No swap was reported for the last frame, draw the requested one anyway.
+void ShapeView::frameTimeout()
+{
+  m_framePending = false;
 
-    int material = materialsList->at(m_currentPaintJob);
-    QColor color;
+  if (m_frameRequested) {
+    m_frameRequested = false;
+    m_glWidget->update();
+  }
+}
 
-    bool selected = false, pattern = false;
+bool ShapeView::viewportEvent(QEvent* event)
+{
+  // The OpenGL widget paints and resizes its framebuffer itself.
+  if (event->type() == QEvent::Paint || event->type() == QEvent::Resize) {
+    return false;
+  }
 
-    if (pick) {
-      m_glWidget->qglColor(CODE2COLOR(i));
-    }
-    else {
-      if (m_vertexSelection && primitive.verticesModel == m_vertexSelection->model()) {
-        foreach (const QModelIndex& index, m_vertexSelection->selectedRows()) {
-          drawHighlightedVertex(verticesFList->at(index.row()));
-        }
-      }
+  return QAbstractItemView::viewportEvent(event);
+}
 
-      if (selections->isSelected(m_shapeModel->index(i, 0))) {
-        selected = true;
+void ShapeView::initializeGL()
+{
+  // The context is recreated when the viewport is reparented.
+  connect(m_glWidget->context(), SIGNAL(aboutToBeDestroyed()), this, SLOT(destroyGL()), Qt::UniqueConnection);
 
-        if (m_showCullData) {
-          drawCullData(primitive);
-        }
-      }
-    }
+  if (!m_renderer->initialize()) {
+    qWarning("Shape renderer: %s", qPrintable(m_renderer->log()));
+  }
 
-    setMaterial(material, pattern, selected, pick);
+  // Timer queries are core in OpenGL 3.3, failing only disables the GPU time.
+  m_timerQuery->create();
+}
 
-    if (primitive.twoSided | m_wireframe) {
-      glDisable(GL_CULL_FACE);
-    }
+void ShapeView::paintGL()
+{
+  m_paintTimer.start();
+  m_frameTimer.start();
+  m_framePending = true;
+  m_frameRequested = false;
 
-    if (primitive.zBias) {
-      glDepthRange(0.0f, 1.0f);
-    }
+  // The query result arrives a frame or more later, only one is in flight.
+  if (m_timerQueryPending && m_timerQuery->isResultAvailable()) {
+    m_gpuTime = m_timerQuery->waitForResult();
+    m_timerQueryPending = false;
+  }
 
-    if (primitive.type == PRIM_TYPE_PARTICLE) {
-      glBegin(GL_POINT);
-      glVertex3f(verticesFList->at(0).x, verticesFList->at(0).y, verticesFList->at(0).z);
-      glEnd();
-    }
-    else if (primitive.type == PRIM_TYPE_LINE) {
-      glBegin(GL_LINES);
-      foreach (const VertexF& vertex, *verticesFList) {
-        glVertex3f(vertex.x, vertex.y, vertex.z);
-      }
-      glEnd();
-    }
-    else if (primitive.type > PRIM_TYPE_LINE && primitive.type < PRIM_TYPE_SPHERE) { // Polygon
-      glBegin(GL_POLYGON);
-      for (int j = verticesFList->size() - 1; j >= 0; j--) {
-        glVertex3f(verticesFList->at(j).x, verticesFList->at(j).y, verticesFList->at(j).z);
+  bool timing = m_showStats && m_timerQuery->isCreated() && !m_timerQueryPending;
+  if (timing) {
+    m_timerQuery->begin();
+  }
+
+  QVector<ShapeRenderer::OverlayVertex> lines, triangles;
+
+  if (m_shapeModel) {
+    updateSelectedRows();
+
+    // The vertices model is gone if its primitive was removed.
+    VerticesModel* verticesModel = m_vertexSelection ? qobject_cast<VerticesModel*>(m_vertexSelection->model()) : 0;
+    if (verticesModel) {
+      const VerticesFList* vertices = verticesModel->verticesFList();
+      foreach (int row, m_selectedVertices) {
+        if (row < vertices->size()) {
+          appendHighlightedVertex(lines, vertices->at(row));
+        }
       }
-      glEnd();
     }
-    else if (m_wireframe && (primitive.type == PRIM_TYPE_SPHERE || primitive.type == PRIM_TYPE_WHEEL)) {
-      glBegin(GL_LINE_STRIP);
-      foreach (const VertexF& vertex, *verticesFList) {
-        glVertex3f(vertex.x, vertex.y, vertex.z);
+
+    if (m_showCullData) {
+      const PrimitivesList* primitives = m_shapeModel->primitivesList();
+      for (int i = 0; i < m_selectedRows.size() && i < primitives->size(); i++) {
+        if (m_selectedRows.testBit(i)) {
+          appendCullData(triangles, primitives->at(i));
+        }
       }
-      glEnd();
-    }
-    else if (primitive.type == PRIM_TYPE_SPHERE) {
-      drawSphere(verticesFList);
-    }
-    else if (primitive.type == PRIM_TYPE_WHEEL) {
-      drawWheel(verticesFList, material, pattern, selected, pick);
     }
+  }
 
-    if (primitive.zBias) {
-      glDepthRange(0.025f, 1.0f);
-    }
+  int culled = updateVisibleRows();
 
-    if (pattern) {
-      glDisable(GL_POLYGON_STIPPLE);
-    }
+  QMatrix4x4 projection = ShapeRenderer::projection(m_glWidget->size());
 
-    if (primitive.twoSided | m_wireframe) {
-      glEnable(GL_CULL_FACE);
-    }
+  if (m_gameLook) {
+    // Same camera, so picking on the GL geometry still matches.
+    QPainter painter(m_glWidget);
+    painter.drawImage(m_glWidget->rect(), m_rasterizer.render(m_shapeModel, projection, m_translation * m_rotation, m_currentPaintJob));
+  }
+  else {
+    m_renderer->render(projection, m_translation * m_rotation, m_currentPaintJob, m_selectedRows, m_visibleRows);
+    m_renderer->drawOverlay(GL_TRIANGLES, triangles, false);
+    m_renderer->drawOverlay(GL_LINES, lines, true);
+  }
 
-    i++;
+  if (timing) {
+    m_timerQuery->end();
+    m_timerQueryPending = true;
   }
 
-  glPopMatrix();
+  if (m_showStats) {
+    paintStats(m_paintTimer.nsecsElapsed(), culled);
+  }
 }
 
-void ShapeView::drawSphere(const VerticesFList* vertices)
+// CPU time is spent in paintGL() including tessellation and uploads, GPU time
+// is from the last finished timer query and the interval is between the two
+// last swaps, so it only shows the frame rate while redrawing continuously.
+void ShapeView::paintStats(qint64 paintTime, int culled)
 {
-  float radius = distance(vertices->at(0), vertices->at(1)) * SPHERE_RADIUS_RATIO;
-
-  glPushMatrix();
-  glTranslatef(vertices->at(0).x, vertices->at(0).y, vertices->at(0).z);
-
-  // Billboard face by using inverse shape rotation matrix.
-  glMultMatrixf(m_rotation.transposed().constData());
+  QString text = tr("CPU: %1 ms\nGPU: %2 ms\nInterval: %3 ms\nDraw calls: %4\nPrimitives: %5")
+      .arg(paintTime / 1000000.0, 0, 'f', 2)
+      .arg(m_gpuTime / 1000000.0, 0, 'f', 2)
+      .arg(m_swapInterval)
+      .arg(m_renderer->stats().drawCalls)
+      .arg(m_renderer->stats().primitives);
 
-  glBegin(GL_TRIANGLE_FAN);
-  for (int j = 0; j < CIRCLE_STEPS; j++) {
-    glVertex3f(
-        cos((PI2 * (j + 1)) / CIRCLE_STEPS) * radius,
-        sin((PI2 * (j + 1)) / CIRCLE_STEPS) * radius,
-        0.0f);
+  if (m_gameCulling) {
+    text += tr("\nCulled: %1").arg(culled);
   }
-  glEnd();
 
-  glPopMatrix();
+  QPainter painter(m_glWidget);
+  painter.setPen(Qt::black);
+  painter.drawText(m_glWidget->rect().adjusted(4, 4, -4, -4), Qt::AlignLeft | Qt::AlignTop, text);
 }
 
-void ShapeView::drawWheel(const VerticesFList* vertices, int& material, bool& pattern, const bool& selected, const bool& pick)
+void ShapeView::updateSelectedRows()
 {
-  float radius2h = distance(vertices->at(3), vertices->at(5));
-  float radius2v = distance(vertices->at(0), vertices->at(1));
-  float radius1h = radius2h * WHEEL_TYRE_RATIO;
-  float radius1v = radius2v * WHEEL_TYRE_RATIO;
+  if (m_selectedRowsValid) {
+    return;
+  }
 
-  VertexF center = centroid(vertices->at(0), vertices->at(3));
-  float halfWidth = distance(vertices->at(0), center);
+  m_selectedRows.fill(false, m_shapeModel->rowCount());
 
-  glPushMatrix();
-  glTranslatef(center.x, center.y, center.z);
+  if (selectionModel()) {
+    foreach (const QModelIndex& index, selectionModel()->selectedRows()) {
+      m_selectedRows.setBit(index.row());
+    }
+  }
 
-  // Wheel rotation
-  QVector3D edge1 = vertices->at(1).toQ() - vertices->at(0).toQ();
-  QVector3D edge2 = vertices->at(2).toQ() - vertices->at(0).toQ();
-  QVector3D normal = QVector3D::normal(edge1, edge2);
+  m_selectedRowsValid = true;
+}
 
-  float rotation  = atan2(normal.x(), normal.z()) * (180.0f / M_PI);
-  glRotatef(rotation, 0.0f, 1.0f, 0.0f);
+// Evaluates the cull words of all primitives for the camera at once, returns
+// how many are hidden. The rows stay empty while game culling is off.
+int ShapeView::updateVisibleRows()
+{
+  m_visibleRows.clear();
 
-  // X/Y coordinates
-  float x1[CIRCLE_STEPS], y1[CIRCLE_STEPS], x2[CIRCLE_STEPS], y2[CIRCLE_STEPS];
-  for (int i = 0; i < CIRCLE_STEPS; i++) {
-    float x = cos((PI2 * (i + 1)) / CIRCLE_STEPS);
-    float y = sin((PI2 * (i + 1)) / CIRCLE_STEPS);
-    x1[i] = x * radius1h;
-    y1[i] = y * radius1v;
-    x2[i] = x * radius2h;
-    y2[i] = y * radius2v;
+  if (!m_gameCulling || !m_shapeModel) {
+    return 0;
   }
 
-  // Tyre tread
-  glBegin(GL_QUAD_STRIP);
-  glVertex3f(radius2h, 0.0f, halfWidth);
-  glVertex3f(radius2h, 0.0f, -halfWidth);
-  for (int i = 0; i < CIRCLE_STEPS; i++) {
-    glVertex3f(x2[i], y2[i], halfWidth);
-    glVertex3f(x2[i], y2[i], -halfWidth);
-  }
-  glEnd();
+  const PrimitivesList* primitives = m_shapeModel->primitivesList();
 
-  if (material < MaterialsModel::VAL_MAX) {
-    setMaterial(++material, pattern, selected, pick);
-  }
-
-  // Inner tyre
-  glBegin(GL_QUAD_STRIP);
-  glVertex3f(radius1h, 0.0f, -halfWidth);
-  glVertex3f(radius2h, 0.0f, -halfWidth);
-  for (int i = 0; i < CIRCLE_STEPS; i++) {
-    glVertex3f(x1[i], -y1[i], -halfWidth);
-    glVertex3f(x2[i], -y2[i], -halfWidth);
-  }
-  glEnd();
-  // Outer tyre
-  glBegin(GL_QUAD_STRIP);
-  glVertex3f(radius1h, 0.0f, halfWidth);
-  glVertex3f(radius2h, 0.0f, halfWidth);
-  for (int i = 0; i < CIRCLE_STEPS; i++) {
-    glVertex3f(x1[i], y1[i], halfWidth);
-    glVertex3f(x2[i], y2[i], halfWidth);
+  if (!m_cullWordsValid) {
+    m_cull1.resize(primitives->size());
+    m_cull2.resize(primitives->size());
+    for (int i = 0; i < primitives->size(); i++) {
+      m_cull1[i] = primitives->at(i).cull1;
+      m_cull2[i] = primitives->at(i).cull2;
+    }
+    m_cullWordsValid = true;
   }
-  glEnd();
 
-  if (material < MaterialsModel::VAL_MAX) {
-    setMaterial(++material, pattern, selected, pick);
-  }
+  m_visibleRows.resize(m_cull1.size());
+  ShapeRasterizer::cullVisible(m_cull1.constData(), m_cull2.constData(), m_cull1.size(),
+      ShapeRasterizer::cullView(m_translation * m_rotation), m_visibleRows.data());
 
-  // Inner rim
-  glBegin(GL_TRIANGLE_FAN);
-  for (int i = CIRCLE_STEPS - 1; i >= 0; i--) {
-    glVertex3f(x1[i], y1[i], -halfWidth);
-  }
-  glEnd();
-  // Outer rim
-  glBegin(GL_TRIANGLE_FAN);
-  for (int i = 0; i < CIRCLE_STEPS; i++) {
-    glVertex3f(x1[i], y1[i], halfWidth);
+  int culled = 0;
+  foreach (quint8 visible, m_visibleRows) {
+    culled += !visible;
   }
-  glEnd();
 
-  glPopMatrix();
+  return culled;
 }
 
-void ShapeView::drawHighlightedVertex(const VertexF& vertex)
+void ShapeView::appendHighlightedVertex(QVector<ShapeRenderer::OverlayVertex>& lines, const VertexF& vertex)
 {
-  glDepthRange(0.0f, 1.0f);
+  lines << overlayVertex(vertex.x, vertex.y + VERTEX_HIGHLIGHT_OFFSET, vertex.z, Qt::red);
+  lines << overlayVertex(vertex.x, vertex.y - VERTEX_HIGHLIGHT_OFFSET, vertex.z, Qt::red);
 
-  glBegin(GL_LINES);
-  m_glWidget->qglColor(Qt::red);
-  glVertex3f(vertex.x, vertex.y + VERTEX_HIGHLIGHT_OFFSET, vertex.z);
-  glVertex3f(vertex.x, vertex.y - VERTEX_HIGHLIGHT_OFFSET, vertex.z);
+  lines << overlayVertex(vertex.x + VERTEX_HIGHLIGHT_OFFSET, vertex.y, vertex.z, Qt::blue);
+  lines << overlayVertex(vertex.x - VERTEX_HIGHLIGHT_OFFSET, vertex.y, vertex.z, Qt::blue);
 
-  m_glWidget->qglColor(Qt::blue);
-  glVertex3f(vertex.x + VERTEX_HIGHLIGHT_OFFSET, vertex.y, vertex.z);
-  glVertex3f(vertex.x - VERTEX_HIGHLIGHT_OFFSET, vertex.y, vertex.z);
-
-  m_glWidget->qglColor(Qt::green);
-  glVertex3f(vertex.x, vertex.y, vertex.z + VERTEX_HIGHLIGHT_OFFSET);
-  glVertex3f(vertex.x, vertex.y, vertex.z - VERTEX_HIGHLIGHT_OFFSET);
-  glEnd();
-
-  glDepthRange(0.025f, 1.0f);
+  lines << overlayVertex(vertex.x, vertex.y, vertex.z + VERTEX_HIGHLIGHT_OFFSET, Qt::green);
+  lines << overlayVertex(vertex.x, vertex.y, vertex.z - VERTEX_HIGHLIGHT_OFFSET, Qt::green);
 }
 
-void ShapeView::drawCullData(const Primitive& primitive)
+void ShapeView::appendCullData(QVector<ShapeRenderer::OverlayVertex>& triangles, const Primitive& primitive)
 {
   const float radius1 = 40.0f;
   const float radius2 = 60.0f;
   const float radius3 = 80.0f;
-  const int steps = 15;
-  float x, z;
+  const int steps = CULL_STEPS;
 
   VertexF center = centroid(primitive);
 
-  if (m_wireframe) {
-    glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
-  }
+  // Rings 1+, 1-, 2+ and 2-, one quad per sector.
+  for (int ring = 0; ring < 4; ring++) {
+    bool first = ring < 2;
+    bool negative = ring % 2;
+    quint32 cull = first ? primitive.cull1 : primitive.cull2;
+    float inner = first ? radius2 : radius1;
+    float outer = first ? radius3 : radius2;
+    float x1 = 1.0f, z1 = 0.0f;
+
+    for (int j = 0; j < steps; j++) {
+      QColor color;
+      if (cull & (1u << (negative ? j + 2 : steps + steps - j + 1))) {
+        color = first ? (j % 2 ? Qt::darkRed : Qt::red) : (j % 2 ? Qt::darkMagenta : Qt::magenta);
+      }
+      else {
+        color = first ? (j % 2 ? Qt::darkGreen : Qt::green) : (j % 2 ? Qt::darkYellow : Qt::yellow);
+      }
 
-  // 1+
-  glBegin(GL_QUAD_STRIP);
-  glVertex3f(radius2 + center.x, center.y, center.z);
-  glVertex3f(radius3 + center.x, center.y, center.z);
-  for (int j = 0; j < steps; j++) {
-    if (primitive.cull1 & (1 << (steps + steps - j + 1))) {
-      if (j % 2) m_glWidget->qglColor(Qt::darkRed);
-      else       m_glWidget->qglColor(Qt::red);
-    }
-    else {
-      if (j % 2) m_glWidget->qglColor(Qt::darkGreen);
-      else       m_glWidget->qglColor(Qt::green);
-    }
-    x =  cos((PI2 * (j + 1)) / steps);
-    z = -sin((PI2 * (j + 1)) / steps);
-    glVertex3f(x * radius2 + center.x, center.y, z * radius2 + center.z);
-    glVertex3f(x * radius3 + center.x, center.y, z * radius3 + center.z);
-  }
-  glEnd();
-  // 1-
-  glBegin(GL_QUAD_STRIP);
-  glVertex3f(radius2 + center.x, center.y, center.z);
-  glVertex3f(radius3 + center.x, center.y, center.z);
-  for (int j = 0; j < steps; j++) {
-    if (primitive.cull1 & (1 << (j + 2))) {
-      if (j % 2) m_glWidget->qglColor(Qt::darkRed);
-      else       m_glWidget->qglColor(Qt::red);
-    }
-    else {
-      if (j % 2) m_glWidget->qglColor(Qt::darkGreen);
-      else       m_glWidget->qglColor(Qt::green);
-    }
-    x = cos((PI2 * (j + 1)) / steps);
-    z = sin((PI2 * (j + 1)) / steps);
-    glVertex3f(x * radius2 + center.x, center.y, z * radius2 + center.z);
-    glVertex3f(x * radius3 + center.x, center.y, z * radius3 + center.z);
-  }
-  glEnd();
-  // 2+
-  glBegin(GL_QUAD_STRIP);
-  glVertex3f(radius1 + center.x, center.y, center.z);
-  glVertex3f(radius2 + center.x, center.y, center.z);
-  for (int j = 0; j < steps; j++) {
-    if (primitive.cull2 & (1 << (steps + steps - j + 1))) {
-      if (j % 2) m_glWidget->qglColor(Qt::darkMagenta);
-      else       m_glWidget->qglColor(Qt::magenta);
-    }
-    else {
-      if (j % 2) m_glWidget->qglColor(Qt::darkYellow);
-      else       m_glWidget->qglColor(Qt::yellow);
-    }
-    x =  cos((PI2 * (j + 1)) / steps);
-    z = -sin((PI2 * (j + 1)) / steps);
-    glVertex3f(x * radius1 + center.x, center.y, z * radius1 + center.z);
-    glVertex3f(x * radius2 + center.x, center.y, z * radius2 + center.z);
-  }
-  glEnd();
-  // 2-
-  glBegin(GL_QUAD_STRIP);
-  glVertex3f(radius1 + center.x, center.y, center.z);
-  glVertex3f(radius2 + center.x, center.y, center.z);
-  for (int j = 0; j < steps; j++) {
-    if (primitive.cull2 & (1 << (j + 2))) {
-      if (j % 2) m_glWidget->qglColor(Qt::darkMagenta);
-      else       m_glWidget->qglColor(Qt::magenta);
-    }
-    else {
-      if (j % 2) m_glWidget->qglColor(Qt::darkYellow);
-      else       m_glWidget->qglColor(Qt::yellow);
+      float x2 = CULL_CIRCLE.cos(j);
+      float z2 = negative ? CULL_CIRCLE.sin(j) : -CULL_CIRCLE.sin(j);
+
+      ShapeRenderer::OverlayVertex a = overlayVertex(x1 * inner + center.x, center.y, z1 * inner + center.z, color);
+      ShapeRenderer::OverlayVertex b = overlayVertex(x1 * outer + center.x, center.y, z1 * outer + center.z, color);
+      ShapeRenderer::OverlayVertex c = overlayVertex(x2 * inner + center.x, center.y, z2 * inner + center.z, color);
+      ShapeRenderer::OverlayVertex d = overlayVertex(x2 * outer + center.x, center.y, z2 * outer + center.z, color);
+      triangles << a << b << d << a << d << c;
+
+      x1 = x2;
+      z1 = z2;
     }
-    x = cos((PI2 * (j + 1)) / steps);
-    z = sin((PI2 * (j + 1)) / steps);
-    glVertex3f(x * radius1 + center.x, center.y, z * radius1 + center.z);
-    glVertex3f(x * radius2 + center.x, center.y, z * radius2 + center.z);
   }
-  glEnd();
+}
 
-  if (m_wireframe) {
-    glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
-  }
+ShapeRenderer::OverlayVertex ShapeView::overlayVertex(float x, float y, float z, const QColor& color)
+{
+  ShapeRenderer::OverlayVertex vertex = { x, y, z, (quint8)color.red(), (quint8)color.green(), (quint8)color.blue(), 0xFF };
+  return vertex;
 }
 
-void ShapeView::setMaterial(const int& material, bool& pattern, const bool& selected, const bool& pick)
+void ShapeView::setSelection(const QRect& rect, QItemSelectionModel::SelectionFlags command)
 {
-  if (!pick) {
-    QColor color = Settings::m_loadedPalette[Settings::m_loadedMaterials[material].color];
+  if (!m_shapeModel) {
+    return;
+  }
 
-    if (selected) {
-      color.setRed(qMin(0xFF, color.red() + 0x7F));
-      color.setGreen(qMax(0, color.green() - 0x7F));
-      color.setBlue(qMax(0, color.blue() - 0x7F));
-    }
+  int ratio = m_glWidget->devicePixelRatio();
+  // Each logical pixel covers ratio x ratio device pixels, rows counted from the bottom.
+  int height = m_glWidget->height();
+  QRect pixels(QPoint(rect.left() * ratio, (height - 1 - rect.bottom()) * ratio),
+      QPoint((rect.right() + 1) * ratio - 1, (height - rect.top()) * ratio - 1));
 
-    m_glWidget->qglColor(color);
-  }
+  // Culled primitives are not drawn, so they cannot be picked either.
+  updateVisibleRows();
 
-  if (!m_wireframe) {
-    if (Settings::m_loadedMaterials[material].pattern && (Settings::m_loadedMaterials[material].pattern <= 6)) {
-      if (!pattern) {
-        glEnable(GL_POLYGON_STIPPLE);
-      }
-      pattern = true;
-      glPolygonStipple(PATTERNS[Settings::m_loadedMaterials[material].pattern - 1]);
-    }
-    else if (pattern) {
-      glDisable(GL_POLYGON_STIPPLE);
-      pattern = false;
-    }
+  m_glWidget->makeCurrent();
+  QList<int> rows = m_renderer->pick(ShapeRenderer::projection(m_glWidget->size()), m_translation * m_rotation, m_currentPaintJob, m_glWidget->size() * ratio, pixels, m_visibleRows);
+  m_glWidget->doneCurrent();
+
+  QItemSelection selection;
+  foreach (int row, rows) {
+    selection.select(m_shapeModel->index(row, 0), m_shapeModel->index(row, 0));
   }
+
+  selectionModel()->select(selection, command | QItemSelectionModel::Rows);
 }
 
-int ShapeView::pick()
+int ShapeView::pick(const QPoint& pos)
 {
-  draw(true);
+  int ratio = m_glWidget->devicePixelRatio();
+  QPoint pixel(pos.x() * ratio, (m_glWidget->height() - pos.y()) * ratio - 1);
 
-  GLubyte pixel[3];
-  glReadPixels(m_lastMousePosition.x(), viewport()->height() - m_lastMousePosition.y(),
-      1, 1, GL_RGB, GL_UNSIGNED_BYTE, (void*)pixel);
+  updateVisibleRows();
 
-  return COLOR2CODE(pixel);
+  m_glWidget->makeCurrent();
+  int row = m_renderer->pick(ShapeRenderer::projection(m_glWidget->size()), m_translation * m_rotation, m_currentPaintJob, m_glWidget->size() * ratio, pixel, m_visibleRows);
+  m_glWidget->doneCurrent();
+
+  return row;
 }
 
 VertexF ShapeView::centroid(const Primitive& primitive)
@@ -601,31 +602,45 @@ VertexF ShapeView::centroid(const VertexF& v1, const VertexF& v2)
   return res;
 }
 
-float ShapeView::distance(const VertexF& v1, const VertexF& v2)
-{
-  float dx = v2.x - v1.x;
-  float dy = v2.y - v1.y;
-  float dz = v2.z - v1.z;
-
-  return sqrt(dx * dx + dy * dy + dz * dz);
-}
-
 void ShapeView::mousePressEvent(QMouseEvent* event)
 {
   event->accept();
   m_lastMousePosition = event->pos();
 
-  int row = pick();
+  // Shift and drag for marquee selection.
+  if (event->button() == Qt::LeftButton && (event->modifiers() & Qt::ShiftModifier)) {
+    m_rubberBandOrigin = event->pos();
+    m_rubberBand->setGeometry(QRect(m_rubberBandOrigin, QSize()));
+    m_rubberBand->show();
+    return;
+  }
+
+  int row = pick(event->pos());
 
-  if (m_shapeModel && row < ShapeModel::ROWS_MAX) {
+  if (m_shapeModel && row >= 0 && row < ShapeModel::ROWS_MAX) {
     selectionModel()->setCurrentIndex(m_shapeModel->index(row, 0),
         QItemSelectionModel::Toggle | QItemSelectionModel::Rows);
   }
 }
 
+void ShapeView::mouseReleaseEvent(QMouseEvent* event)
+{
+  event->accept();
+
+  if (m_rubberBand->isVisible()) {
+    m_rubberBand->hide();
+    setSelection(m_rubberBand->geometry(), QItemSelectionModel::Select);
+  }
+}
+
 void ShapeView::mouseMoveEvent(QMouseEvent* event)
 {
   event->accept();
+
+  if (m_rubberBand->isVisible()) {
+    m_rubberBand->setGeometry(QRect(m_rubberBandOrigin, event->pos()).normalized());
+    return;
+  }
   QPoint delta = event->pos() - m_lastMousePosition;
   m_lastMousePosition = event->pos();
 
@@ -643,5 +658,5 @@ void ShapeView::mouseMoveEvent(QMouseEvent* event)
     m_translation.translate(delta.x() * 5.0f, 0.0f, -delta.y() * 5.0f);
   }
 
-  viewport()->update();
+  requestFrame();
 }
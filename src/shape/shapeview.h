@@ -1,11 +1,19 @@
 #pragma once
 
 #include <QAbstractItemView>
+#include <QBitArray>
+#include <QElapsedTimer>
 #include <QMatrix4x4>
+#include <QPointer>
+#include <QTimer>
 
 #include "shapemodel.h"
+#include "shaperasterizer.h"
+#include "shaperenderer.h"
 
-class QGLWidget;
+class QOpenGLTimerQuery;
+class QOpenGLWidget;
+class QRubberBand;
 
 class ShapeView : public QAbstractItemView
 {
@@ -13,16 +21,19 @@ class ShapeView : public QAbstractItemView
 
 public:
   ShapeView(QWidget* parent = 0);
+  ~ShapeView();
 
   void              setModel(QAbstractItemModel* model);
   QRect             visualRect(const QModelIndex& /*index*/) const                      { return viewport()->rect(); }
   void              scrollTo(const QModelIndex& /*index*/, ScrollHint /*hint*/ = EnsureVisible) { }
   QModelIndex       indexAt(const QPoint& /*point*/) const                              { return QModelIndex(); }
 
-  void              setVertexSelectionModel(QItemSelectionModel* selection)             { m_vertexSelection = selection; }
+  void              setSelectionModel(QItemSelectionModel* selectionModel);
+  void              setVertexSelectionModel(QItemSelectionModel* selection);
 
 public slots:
   void              reset();
+  void              requestFrame();
 
 signals:
   void              selectedPaintJobChangeRequested(int paintJob);
@@ -31,54 +42,94 @@ protected slots:
   void              setCurrentPaintJob(int paintJob);
   void              adjustCurrentPaintJobAfterMove(int oldPosition, int newPosition);
   void              toggleWireframe(bool enable);
+  void              toggleShading(bool enable);
+  void              setDetail(int level);
   void              toggleShowCullData(bool enable);
+  void              toggleShowStats(bool enable);
+  void              toggleGameLook(bool enable);
+  void              toggleGameCulling(bool enable);
+
+  void              dataChanged(const QModelIndex& topLeft, const QModelIndex& bottomRight, const QVector<int>& roles = QVector<int>());
+  void              selectionChanged(const QItemSelection& selected, const QItemSelection& deselected);
+  void              rowsInserted(const QModelIndex& parent, int start, int end);
+  void              rowsAboutToBeRemoved(const QModelIndex& parent, int start, int end);
+
+private slots:
+  void              vertexSelectionChanged();
+  void              updatePalette();
+  void              destroyGL();
+  void              frameSwapped();
+  void              frameTimeout();
 
 protected:
   QModelIndex       moveCursor(CursorAction /*cursorAction*/, Qt::KeyboardModifiers /*modifiers*/) { return QModelIndex(); }
 
-  void              updateGeometries();
   int               horizontalOffset() const                                            { return 0; }
   int               verticalOffset() const                                              { return 0; }
 
   bool              isIndexHidden(const QModelIndex& /*index*/) const                   { return 0; }
 
-  void              setSelection(const QRect& /*rect*/, QItemSelectionModel::SelectionFlags /*command*/) { }
+  void              setSelection(const QRect& rect, QItemSelectionModel::SelectionFlags command);
   QRegion           visualRegionForSelection(const QItemSelection& /*selection*/) const { return QRegion(viewport()->rect()); }
 
-  void              showEvent(QShowEvent* event);
-  void              paintEvent(QPaintEvent* event);
+  bool              viewportEvent(QEvent* event);
   void              mouseMoveEvent(QMouseEvent* event);
   void              mousePressEvent(QMouseEvent* event);
+  void              mouseReleaseEvent(QMouseEvent* event);
 
 private:
-  void              draw(bool pick);
-  inline void       drawSphere(const VerticesFList* vertices);
-  inline void       drawWheel(const VerticesFList* vertices, int& material, bool& pattern, const bool& selected, const bool& pick);
-  inline void       drawHighlightedVertex(const VertexF& vertex);
-  inline void       drawCullData(const Primitive& primitive);
-  void              setMaterial(const int& material, bool& pattern, const bool& selected, const bool& pick);
-  int               pick();
+  friend class ShapeViewport;
+
+  void              initializeGL();
+  void              paintGL();
+  void              updateSelectedRows();
+  int               updateVisibleRows();
+  void              appendHighlightedVertex(QVector<ShapeRenderer::OverlayVertex>& lines, const VertexF& vertex);
+  void              appendCullData(QVector<ShapeRenderer::OverlayVertex>& triangles, const Primitive& primitive);
+  void              paintStats(qint64 paintTime, int culled);
+  int               pick(const QPoint& pos);
+
+  static ShapeRenderer::OverlayVertex overlayVertex(float x, float y, float z, const QColor& color);
 
   static VertexF    centroid(const Primitive& primitive);
   static VertexF    centroid(const VertexF& v1, const VertexF& v2);
-  static float      distance(const VertexF& v1, const VertexF& v2);
 
-  QGLWidget*        m_glWidget;
+  QOpenGLWidget*    m_glWidget;
+  ShapeRenderer*    m_renderer;
+  ShapeRasterizer   m_rasterizer;
   ShapeModel*       m_shapeModel;
   QPoint            m_lastMousePosition;
+  QRubberBand*      m_rubberBand;
+  QPoint            m_rubberBandOrigin;
   QMatrix4x4        m_rotation;
   QMatrix4x4        m_translation;
   int               m_currentPaintJob;
-  bool              m_wireframe;
   bool              m_showCullData;
-
-  QItemSelectionModel* m_vertexSelection;
-
-  static const quint8 PATTERNS[6][0x80];
+  bool              m_showStats;
+  bool              m_gameLook;
+  bool              m_gameCulling;
+
+  bool              m_framePending;
+  bool              m_frameRequested;
+  QTimer            m_frameTimer;
+  QElapsedTimer     m_paintTimer;
+  QElapsedTimer     m_swapTimer;
+  qint64            m_swapInterval;
+  QOpenGLTimerQuery* m_timerQuery;
+  bool              m_timerQueryPending;
+  qint64            m_gpuTime;
+
+  QBitArray         m_selectedRows;
+  bool              m_selectedRowsValid;
+  QPointer<QItemSelectionModel> m_vertexSelection;
+  QVector<int>      m_selectedVertices;
+
+  // Cull words by field, refreshed when the primitives change.
+  QVector<quint32>  m_cull1;
+  QVector<quint32>  m_cull2;
+  bool              m_cullWordsValid;
+  QVector<quint8>   m_visibleRows;
 
   static const float  VERTEX_HIGHLIGHT_OFFSET;
-  static const float  PI2;
-  static const float  SPHERE_RADIUS_RATIO;
-  static const float  WHEEL_TYRE_RATIO;
-  static const int    CIRCLE_STEPS = 16;
+  static const int    FRAME_TIMEOUT;
 };
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <QList>
+#include <QVector>
 #include <QVector3D>
 
 typedef struct {
@@ -40,3 +41,24 @@ typedef struct {
 } Primitive;
 
 typedef QList<Primitive> PrimitivesList;
+
+// Intermediate face of an imported or exported mesh. Type is a primitive
+// type, or 0 for a polygon with more vertices than a primitive can hold.
+// Culling words are only meaningful if hasCull is set.
+typedef struct {
+  quint8            type;
+  QVector<int>      indices;
+  MaterialsList     materials;
+  bool              twoSided;
+  bool              zBias;
+  bool              hasCull;
+  quint32           cull1;
+  quint32           cull2;
+} MeshFace;
+
+typedef QList<MeshFace> MeshFacesList;
+
+typedef struct {
+  QVector<QVector3D> positions;
+  MeshFacesList     faces;
+} Mesh;
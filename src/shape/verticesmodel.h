@@ -1,6 +1,7 @@
 #pragma once
 
 #include <QAbstractTableModel>
+#include <QHash>
 
 #include "types.h"
 
@@ -11,6 +12,13 @@ inline bool operator==(const Vertex& v1, const Vertex& v2)
   return v1.x == v2.x && v1.y == v2.y && v1.z == v2.z;
 }
 
+inline uint qHash(const Vertex& v, uint seed = 0)
+{
+  return qHash(((quint64)(quint16)v.x << 32) | ((quint64)(quint16)v.y << 16) | (quint16)v.z, seed);
+}
+
+typedef QHash<Vertex, int> VertexIndexMap;
+
 class VerticesModel : public QAbstractTableModel
 {
   Q_OBJECT